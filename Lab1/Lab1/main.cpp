@@ -16,7 +16,13 @@ void playerB() {//Sender.
 	cout << "IP: 127.0.0.1" << endl << "Port: 28001" << endl;
 }
 
-int main() {
+//B sends to port 28000, where A listens, unless given another port. To try the
+//pair over a bad link, put NetEmu (in the Moving.Dot solution) in between:
+//  NetEmu --listen 28100 --target 127.0.0.1:28000 --no-tcp --latency 100 --loss 10
+//  Lab1 28100
+int main(int argc, char* argv[]) {
+
+	int destinationPort = argc > 1 ? atoi(argv[1]) : 28000;
 
 	net.initialise();
 
@@ -37,7 +43,7 @@ int main() {
 		playerB();
 
 		system("PAUSE");
-		cout << net.sendData("127.0.0.1", 28000, "test") << endl;
+		cout << net.sendData("127.0.0.1", destinationPort, "test") << endl;
 	}
 
 	//net.receiveData("127.0.0.1", 28000, message);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+
+//Micro-benchmarks for the game's hot paths. Each bench prints its own table.
+//Build in Release; Debug numbers are meaningless.
+
+typedef std::chrono::high_resolution_clock BenchClock;
+
+//Nanoseconds elapsed since start, divided over count operations.
+inline double nsPerOp(BenchClock::time_point start, long long count)
+{
+	std::chrono::duration<double, std::nano> elapsed = BenchClock::now() - start;
+	return elapsed.count() / (double)count;
+}
+
+//Stops the optimiser from throwing away work whose result is never used.
+extern volatile long long benchSink;
+
+void runProtocolBench();
+void runCollisionBench();
@@ -0,0 +1,170 @@
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Bench.h"
+#include "Collision.h"
+#include "Simulation.h"
+
+//Compares finding every touching pair of dots the old way against CollisionGrid.
+//The per-pair path is a faithful copy of the client's original Dot::handleCollision:
+//the other dot passed by value, the distance through sqrt. It has to be called
+//for every pair, so it is also timed with the game's own test, dotsCollideSwept
+//on dots standing still, which drops the copy and the sqrt and wraps round the
+//field like the grid does, but still tests every pair. The grid has to find
+//exactly the pairs that does. (The old path doesn't wrap, so it finds a few less.)
+//
+//Then what checking less often costs in missed catches: runner and chaser
+//pairs drift about for a while, checked only every few steps, once where they
+//are at the end of each tick and once swept over it with dotsCollideSwept. Swept
+//should catch every pair that touched (and a few that only grazed between frames).
+
+static const int SIZES[] = { 100, 1000, 4000, 16000 };
+static const long long MIN_TESTS = 20000000;	//repeat small sizes until at least this many pair tests
+
+static const int STEPS_PER_TICK[] = { 1, 2, 4, 6, 10, 20 };	//1 is checking every frame, as the game does
+static const int SWEPT_PAIRS = 20000;
+static const int SWEPT_STEPS = 10 * FRAMES_PER_SECOND;
+
+//The client's Dot as it was, minus rendering.
+class OldDot
+{
+public:
+	static const int DOT_WIDTH = 20;
+	int m_playerNum;
+
+	OldDot(int x, int y) : m_playerNum(2), mPosX(x), mPosY(y), mVelX(0), mVelY(0) {}
+
+	bool handleCollision(OldDot other);
+	int getX();
+	int getY();
+
+private:
+	int mPosX, mPosY;
+	int mVelX, mVelY;
+};
+
+int OldDot::getX() { return mPosX; }
+int OldDot::getY() { return mPosY; }
+
+bool OldDot::handleCollision(OldDot other)
+{
+	int distance = (int)sqrt((double)(((other.getX() - mPosX) * (other.getX() - mPosX)) + ((other.getY() - mPosY) * (other.getY() - mPosY))));
+	return distance <= DOT_WIDTH;
+}
+
+void runCollisionBench()
+{
+	std::cout << "== collision: every touching pair among N dots on the play field ==\n";
+	std::printf("%8s %10s %14s %14s %14s %9s\n", "dots", "contacts", "by value us", "every pair us", "grid us", "speedup");
+
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> xs(FIELD_MIN_X, FIELD_MIN_X + FIELD_WIDTH - 1);
+	std::uniform_int_distribution<int> ys(FIELD_MIN_Y, FIELD_MIN_Y + FIELD_HEIGHT - 1);
+	CollisionGrid grid;
+	std::vector<Contact> contacts;
+
+	for (int s = 0; s < (int)(sizeof(SIZES) / sizeof(SIZES[0])); s++)
+	{
+		int count = SIZES[s];
+		std::vector<OldDot> dots;
+		std::vector<int> x(count), y(count);
+		for (int i = 0; i < count; i++)
+		{
+			x[i] = xs(random);
+			y[i] = ys(random);
+			dots.push_back(OldDot(x[i], y[i]));
+		}
+		long long pairs = (long long)count * (count - 1) / 2;
+		int repeats = pairs >= MIN_TESTS ? 1 : (int)(MIN_TESTS / pairs);
+
+		long long byValue = 0;
+		BenchClock::time_point start = BenchClock::now();
+		for (int r = 0; r < repeats; r++)
+			for (int i = 0; i < count; i++)
+				for (int j = i + 1; j < count; j++)
+					byValue += dots[i].handleCollision(dots[j]);
+		double byValueUs = nsPerOp(start, repeats) / 1000;
+
+		long long shared = 0;
+		start = BenchClock::now();
+		for (int r = 0; r < repeats; r++)
+			for (int i = 0; i < count; i++)
+				for (int j = i + 1; j < count; j++)
+					shared += dotsCollideSwept(x[i], y[i], x[i], y[i], x[j], y[j], x[j], y[j]);
+		double sharedUs = nsPerOp(start, repeats) / 1000;
+
+		//The grid is fast enough to time over many more rounds; refilling it is part of each one.
+		int gridRepeats = repeats * 10;
+		start = BenchClock::now();
+		for (int r = 0; r < gridRepeats; r++)
+		{
+			grid.clear();
+			for (int i = 0; i < count; i++)
+				grid.add(x[i], y[i]);
+			grid.findContacts(contacts);
+		}
+		double gridUs = nsPerOp(start, gridRepeats) / 1000;
+
+		std::printf("%8d %10d %14.1f %14.1f %14.1f %8.1fx\n", count, (int)contacts.size(), byValueUs, sharedUs, gridUs, byValueUs / gridUs);
+		if (shared != (long long)contacts.size() * repeats)
+			std::cout << "  MISMATCH: every pair found " << shared / repeats << ", the grid " << contacts.size() << '\n';
+		benchSink = benchSink + byValue + shared + (long long)contacts.size();
+	}
+	std::cout << '\n';
+
+	std::cout << "== collision: pairs caught when checking every few frames (" << SWEPT_PAIRS << " pairs, " << SWEPT_STEPS << " frames each) ==\n";
+	std::printf("%8s %10s %14s %14s\n", "ticks/s", "touched", "ends caught", "swept caught");
+
+	//Each pair runs at a random velocity, both dots at once, faster than a
+	//player can steer so the bigger gaps show up sooner.
+	std::uniform_int_distribution<int> velocities(-3 * DOT_SPEED, 3 * DOT_SPEED);
+	std::vector<int> start(SWEPT_PAIRS * 8);
+	for (int i = 0; i < SWEPT_PAIRS * 8; i += 2)
+	{
+		start[i] = xs(random);
+		start[i + 1] = ys(random);
+	}
+	for (int i = 4; i < SWEPT_PAIRS * 8; i += 8)
+	{
+		for (int j = 0; j < 4; j++)
+			start[i + j] = velocities(random);
+	}
+
+	for (int t = 0; t < (int)(sizeof(STEPS_PER_TICK) / sizeof(STEPS_PER_TICK[0])); t++)
+	{
+		int stepsPerTick = STEPS_PER_TICK[t];
+		int touched = 0, endsCaught = 0, sweptCaught = 0;
+		for (int p = 0; p < SWEPT_PAIRS; p++)
+		{
+			const int* pair = &start[p * 8];
+			int ax = pair[0], ay = pair[1], bx = pair[2], by = pair[3];
+			bool touch = false, ends = false, swept = false;
+
+			//Touching at any single frame is the truth: dots move a few pixels a frame, far less than their width.
+			//Every column uses the same wrap-aware test; a path of no length is a point.
+			for (int step = 0; step < SWEPT_STEPS && !touch; step += stepsPerTick)
+			{
+				int fromAX = ax, fromAY = ay, fromBX = bx, fromBY = by;
+				for (int s = 0; s < stepsPerTick; s++)
+				{
+					stepDot(ax, ay, pair[4], pair[5]);
+					stepDot(bx, by, pair[6], pair[7]);
+					touch = touch || dotsCollideSwept(ax, ay, ax, ay, bx, by, bx, by);
+				}
+				ends = ends || dotsCollideSwept(ax, ay, ax, ay, bx, by, bx, by);
+				swept = swept || dotsCollideSwept(fromAX, fromAY, ax, ay, fromBX, fromBY, bx, by);
+			}
+			touched += touch;
+			endsCaught += ends;
+			sweptCaught += swept;
+		}
+		std::printf("%8d %10d %14d %14d\n", FRAMES_PER_SECOND / stepsPerTick, touched, endsCaught, sweptCaught);
+		if (sweptCaught < touched)
+			std::cout << "  MISSED: swept missed " << touched - sweptCaught << " pairs that touched\n";
+		benchSink = benchSink + sweptCaught;
+	}
+	std::cout << '\n';
+}
@@ -0,0 +1,100 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <iostream>
+
+#include "Bench.h"
+#include "Protocol.h"
+
+//Compares the original ASCII "1 id x y" messages against the binary protocol.
+//The text path is a faithful copy of what the client and server used to do:
+//std::to_string concatenation + memcpy + strlen to send, a digit loop on the
+//server to find the type, and sscanf on the client to pull the fields out.
+
+static const long long ITERATIONS = 2000000;
+
+static int textEncode(char* buffer, int id, int x, int y)
+{
+	std::string msg = "1 " + std::to_string(id) + " " + std::to_string(x) + " " + std::to_string(y) + '\0';
+	memcpy(buffer, msg.c_str(), msg.size());
+	return (int)strlen(buffer) + 1;
+}
+
+static int textDecode(const char* buffer, int& id, int& x, int& y)
+{
+	//Server side: read the type, then relay strlen + 1 bytes.
+	int num = buffer[0] - '0';
+	int j = 1;
+	while (buffer[j] >= '0' && buffer[j] <= '9')
+	{
+		num *= 10;
+		num += buffer[j] - '0';
+		j++;
+	}
+	//Client side: pull the fields out.
+	sscanf(buffer, "1 %d %d %d", &id, &x, &y);
+	return num;
+}
+
+void runProtocolBench()
+{
+	char buffer[MAX_MESSAGE_SIZE];
+	long long sum = 0;
+	int textBytes = 0;
+	int binaryBytes = 0;
+
+	std::cout << "== protocol: one MSG_MOVE, " << ITERATIONS << " iterations ==\n";
+
+	BenchClock::time_point start = BenchClock::now();
+	for (long long i = 0; i < ITERATIONS; i++)
+	{
+		textBytes = textEncode(buffer, 2, (int)(i % 640), (int)(i % 480));
+		sum += buffer[textBytes / 2];
+	}
+	double textEncodeNs = nsPerOp(start, ITERATIONS);
+
+	start = BenchClock::now();
+	for (long long i = 0; i < ITERATIONS; i++)
+	{
+		int id, x, y;
+		buffer[4] = (char)('0' + i % 10);
+		sum += textDecode(buffer, id, x, y) + x;
+	}
+	double textDecodeNs = nsPerOp(start, ITERATIONS);
+
+	start = BenchClock::now();
+	for (long long i = 0; i < ITERATIONS; i++)
+	{
+		binaryBytes = encodeMove(buffer, 2, (int16_t)(i % 640), (int16_t)(i % 480), 0);
+		sum += buffer[binaryBytes / 2];
+	}
+	double binaryEncodeNs = nsPerOp(start, ITERATIONS);
+
+	start = BenchClock::now();
+	for (long long i = 0; i < ITERATIONS; i++)
+	{
+		MessageHeader header;
+		MoveMessage move;
+		buffer[HEADER_SIZE] = (char)(i & 0x7F);
+		if (readHeader(buffer, binaryBytes, header) && decodeMove(buffer + HEADER_SIZE, header.length, move))
+			sum += header.type + move.x;
+	}
+	double binaryDecodeNs = nsPerOp(start, ITERATIONS);
+
+	benchSink = sum;
+
+	printf("%-8s %12s %12s %12s\n", "format", "encode ns", "decode ns", "bytes/msg");
+	printf("%-8s %12.1f %12.1f %12d\n", "text", textEncodeNs, textDecodeNs, textBytes);
+	printf("%-8s %12.1f %12.1f %12d\n", "binary", binaryEncodeNs, binaryDecodeNs, binaryBytes);
+
+	//Every player sends one move per frame and the relay forwards it to everyone else.
+	printf("\nrelay bytes per frame (N players, N*(N-1) forwarded moves)\n");
+	printf("%8s %14s %14s\n", "players", "text", "binary");
+	const int counts[] = { 3, 30, 300, 3000 };
+	for (int n : counts)
+	{
+		long long forwards = (long long)n * (n - 1);
+		printf("%8d %14lld %14lld\n", n, forwards * textBytes, forwards * binaryBytes);
+	}
+	printf("\n");
+}
@@ -0,0 +1,34 @@
+#include <cstring>
+#include <iostream>
+
+#include "Bench.h"
+
+volatile long long benchSink = 0;
+
+//Usage: Bench [name]
+//With no name every benchmark runs in turn.
+int main(int argc, char** argv)
+{
+	const char* which = argc > 1 ? argv[1] : "all";
+	bool all = strcmp(which, "all") == 0;
+	bool ran = false;
+
+	if (all || strcmp(which, "protocol") == 0)
+	{
+		runProtocolBench();
+		ran = true;
+	}
+	if (all || strcmp(which, "collision") == 0)
+	{
+		runCollisionBench();
+		ran = true;
+	}
+
+	if (!ran)
+	{
+		std::cout << "Unknown benchmark: " << which << '\n';
+		std::cout << "Available: all, protocol, collision\n";
+		return 1;
+	}
+	return 0;
+}
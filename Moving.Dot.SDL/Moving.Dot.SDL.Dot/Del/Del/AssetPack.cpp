@@ -0,0 +1,70 @@
+#include "AssetPack.h"
+
+#include <string.h>
+
+#include "Protocol.h"
+
+AssetPack::AssetPack()
+	: mCount(0)
+{
+}
+
+bool AssetPack::open(const char* path)
+{
+	close();
+	if (!mFile.open(path))
+		return false;
+
+	const char* data = mFile.data();
+	size_t size = mFile.size();
+	if (size < (size_t)ASSET_PACK_HEADER_SIZE || memcmp(data, ASSET_PACK_MAGIC, sizeof(ASSET_PACK_MAGIC)) != 0 ||
+		readU8(data + sizeof(ASSET_PACK_MAGIC)) != ASSET_PACK_VERSION)
+	{
+		close();
+		return false;
+	}
+	uint32_t count = readU32(data + sizeof(ASSET_PACK_MAGIC) + 2);
+	if (count > (size - ASSET_PACK_HEADER_SIZE) / ASSET_ENTRY_SIZE)
+	{
+		close();
+		return false;
+	}
+
+	//Check every entry now, so find never has to.
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const char* entry = data + ASSET_PACK_HEADER_SIZE + i * ASSET_ENTRY_SIZE;
+		size_t pixels = (size_t)readU16(entry + ASSET_NAME_SIZE) * readU16(entry + ASSET_NAME_SIZE + 2) * 4;
+		uint32_t offset = readU32(entry + ASSET_NAME_SIZE + 4);
+		if (offset % 4 != 0 || offset > size || pixels > size - offset)
+		{
+			close();
+			return false;
+		}
+	}
+	mCount = (int)count;
+	return true;
+}
+
+void AssetPack::close()
+{
+	mFile.close();
+	mCount = 0;
+}
+
+bool AssetPack::find(const char* name, PackedImage& image) const
+{
+	//A handful of images, looked up once each: a straight scan is plenty.
+	for (int i = 0; i < mCount; i++)
+	{
+		const char* entry = mFile.data() + ASSET_PACK_HEADER_SIZE + i * ASSET_ENTRY_SIZE;
+		if (strncmp(entry, name, ASSET_NAME_SIZE) == 0)
+		{
+			image.width = readU16(entry + ASSET_NAME_SIZE);
+			image.height = readU16(entry + ASSET_NAME_SIZE + 2);
+			image.pixels = (const uint32_t*)(mFile.data() + readU32(entry + ASSET_NAME_SIZE + 4));
+			return true;
+		}
+	}
+	return false;
+}
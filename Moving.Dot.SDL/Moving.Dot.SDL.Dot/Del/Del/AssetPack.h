@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "MappedFile.h"
+
+//The client's images, decoded ahead of time into one file (Del --pack-assets).
+//Pixels are stored exactly as the textures want them, so loading an image is
+//a lookup in the mapped file and one texture upload: nothing is decoded,
+//colour-keyed or converted at startup, and nothing is copied on the way.
+//
+//File layout, little-endian like the protocol:
+//  ASSET_PACK_HEADER_SIZE bytes: ASSET_PACK_MAGIC, format version (u8), zero (u8),
+//    u32 image count, zero padding.
+//  count directory entries of ASSET_ENTRY_SIZE bytes:
+//    name (ASSET_NAME_SIZE bytes, NUL padded): the image file it was made from
+//    u16 width, u16 height
+//    u32 where its pixels start, from the start of the file; a multiple of 4
+//  pixels: width * height u32 per image, 0xAARRGGBB (SDL_PIXELFORMAT_ARGB8888),
+//    rows top to bottom. The colour key is already applied: cyan is alpha 0.
+//Pixels are read in place as native u32s, so this assumes a little-endian
+//machine, which every platform the game builds for is.
+
+const char ASSET_PACK_MAGIC[6] = { 'D', 'O', 'T', 'P', 'A', 'K' };
+const uint8_t ASSET_PACK_VERSION = 1;
+const int ASSET_PACK_HEADER_SIZE = 16;
+const int ASSET_NAME_SIZE = 32;
+const int ASSET_ENTRY_SIZE = ASSET_NAME_SIZE + 8;
+
+//Where the client looks for its pack, beside the images it was made from.
+const char* const ASSET_PACK_FILE = "assets.pak";
+
+//One image, inside the mapping.
+struct PackedImage
+{
+	int width;
+	int height;
+	const uint32_t* pixels;
+};
+
+class AssetPack
+{
+public:
+	AssetPack();
+
+	//Maps the pack. Returns false if it can't be read or isn't a valid pack.
+	bool open(const char* path);
+	void close();
+
+	bool isOpen() const { return mFile.isOpen(); }
+	int count() const { return mCount; }
+
+	//The image made from the file called name. False if it isn't in the pack.
+	bool find(const char* name, PackedImage& image) const;
+
+private:
+	MappedFile mFile;
+	int mCount;
+};
@@ -0,0 +1,233 @@
+#include "Assets.h"
+
+#include <SDL_image.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Protocol.h"
+
+//Cyan pixels in the images are see-through.
+static const Uint32 COLOUR_KEY = 0x0000FFFF;
+static const Uint32 RGB_MASK = 0x00FFFFFF;
+
+TextureHandle::TextureHandle()
+	: mShared(NULL)
+{
+}
+
+TextureHandle::TextureHandle(SDL_Texture* texture)
+	: mShared(NULL)
+{
+	if (texture != NULL)
+	{
+		mShared = new Shared();
+		mShared->texture = texture;
+		SDL_QueryTexture(texture, NULL, NULL, &mShared->width, &mShared->height);
+		mShared->references = 1;
+	}
+}
+
+TextureHandle::TextureHandle(const TextureHandle& other)
+	: mShared(other.mShared)
+{
+	if (mShared != NULL)
+	{
+		mShared->references++;
+	}
+}
+
+TextureHandle& TextureHandle::operator=(const TextureHandle& other)
+{
+	//Take the new reference first, in case both are the same texture.
+	if (other.mShared != NULL)
+	{
+		other.mShared->references++;
+	}
+	reset();
+	mShared = other.mShared;
+	return *this;
+}
+
+TextureHandle::~TextureHandle()
+{
+	reset();
+}
+
+void TextureHandle::reset()
+{
+	if (mShared != NULL && --mShared->references == 0)
+	{
+		SDL_DestroyTexture(mShared->texture);
+		delete mShared;
+	}
+	mShared = NULL;
+}
+
+//Loads an image file into an ARGB8888 surface with cyan made transparent.
+static SDL_Surface* decodeImage(const char* name)
+{
+	SDL_Surface* loaded = IMG_Load(name);
+	if (loaded == NULL)
+	{
+		printf("Unable to load image %s! SDL_image Error: %s\n", name, IMG_GetError());
+		return NULL;
+	}
+	SDL_Surface* converted = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(loaded);
+	if (converted == NULL)
+	{
+		printf("Unable to convert image %s! SDL Error: %s\n", name, SDL_GetError());
+		return NULL;
+	}
+
+	SDL_LockSurface(converted);
+	for (int y = 0; y < converted->h; y++)
+	{
+		Uint32* row = (Uint32*)((Uint8*)converted->pixels + y * converted->pitch);
+		for (int x = 0; x < converted->w; x++)
+		{
+			if ((row[x] & RGB_MASK) == COLOUR_KEY)
+			{
+				row[x] = 0;
+			}
+		}
+	}
+	SDL_UnlockSurface(converted);
+	SDL_SetSurfaceBlendMode(converted, SDL_BLENDMODE_BLEND);
+	return converted;
+}
+
+bool AssetCache::openPack(const char* path)
+{
+	return mPack.open(path);
+}
+
+TextureHandle AssetCache::texture(SDL_Renderer* renderer, const char* name)
+{
+	std::unordered_map<std::string, TextureHandle>::iterator found = mTextures.find(name);
+	if (found != mTextures.end())
+	{
+		return found->second;
+	}
+
+	SDL_Texture* texture = NULL;
+	PackedImage image;
+	if (mPack.find(name, image))
+	{//Straight from the mapping to the texture.
+		texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, image.width, image.height);
+		if (texture != NULL)
+		{
+			SDL_UpdateTexture(texture, NULL, image.pixels, image.width * 4);
+		}
+	}
+	else
+	{
+		SDL_Surface* decoded = decodeImage(name);
+		if (decoded != NULL)
+		{
+			texture = SDL_CreateTextureFromSurface(renderer, decoded);
+			SDL_FreeSurface(decoded);
+		}
+	}
+	if (texture == NULL)
+	{
+		printf("Unable to create texture from %s! SDL Error: %s\n", name, SDL_GetError());
+		return TextureHandle();
+	}
+	SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+	TextureHandle handle(texture);
+	mTextures[name] = handle;
+	return handle;
+}
+
+SDL_Surface* AssetCache::surface(const char* name)
+{
+	PackedImage image;
+	if (mPack.find(name, image))
+	{
+		SDL_Surface* wrapped = SDL_CreateRGBSurfaceFrom((void*)image.pixels, image.width, image.height, 32, image.width * 4,
+			0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+		if (wrapped == NULL)
+		{
+			printf("Unable to use packed image %s! SDL Error: %s\n", name, SDL_GetError());
+		}
+		return wrapped;
+	}
+	return decodeImage(name);
+}
+
+void AssetCache::clear()
+{
+	mTextures.clear();
+}
+
+bool writeAssetPack(const char* path, const char* const names[], int count)
+{
+	std::vector<SDL_Surface*> images(count, (SDL_Surface*)NULL);
+	bool success = true;
+	for (int i = 0; i < count && success; i++)
+	{
+		if (strlen(names[i]) >= (size_t)ASSET_NAME_SIZE)
+		{
+			printf("Image name too long for the asset pack: %s\n", names[i]);
+			success = false;
+		}
+		else
+		{
+			images[i] = decodeImage(names[i]);
+			success = images[i] != NULL;
+		}
+	}
+
+	FILE* file = success ? fopen(path, "wb") : NULL;
+	if (success && file == NULL)
+	{
+		printf("Unable to create %s\n", path);
+		success = false;
+	}
+	if (success)
+	{
+		//Header and directory first, then every image's pixels in the same order.
+		std::vector<char> header(ASSET_PACK_HEADER_SIZE + count * ASSET_ENTRY_SIZE, 0);
+		memcpy(&header[0], ASSET_PACK_MAGIC, sizeof(ASSET_PACK_MAGIC));
+		writeU8(&header[sizeof(ASSET_PACK_MAGIC)], ASSET_PACK_VERSION);
+		writeU32(&header[sizeof(ASSET_PACK_MAGIC) + 2], (uint32_t)count);
+		uint32_t offset = (uint32_t)header.size();
+		offset = (offset + 3) / 4 * 4;
+		for (int i = 0; i < count; i++)
+		{
+			char* entry = &header[ASSET_PACK_HEADER_SIZE + i * ASSET_ENTRY_SIZE];
+			strncpy(entry, names[i], ASSET_NAME_SIZE);
+			writeU16(entry + ASSET_NAME_SIZE, (uint16_t)images[i]->w);
+			writeU16(entry + ASSET_NAME_SIZE + 2, (uint16_t)images[i]->h);
+			writeU32(entry + ASSET_NAME_SIZE + 4, offset);
+			offset += images[i]->w * images[i]->h * 4;
+		}
+		header.resize((header.size() + 3) / 4 * 4, 0);
+		success = fwrite(&header[0], 1, header.size(), file) == header.size();
+
+		for (int i = 0; i < count && success; i++)
+		{
+			SDL_LockSurface(images[i]);
+			for (int y = 0; y < images[i]->h && success; y++)
+			{
+				const char* row = (const char*)images[i]->pixels + y * images[i]->pitch;
+				success = fwrite(row, 4, images[i]->w, file) == (size_t)images[i]->w;
+			}
+			SDL_UnlockSurface(images[i]);
+		}
+		success = fclose(file) == 0 && success;
+		if (!success)
+		{
+			printf("Unable to write %s\n", path);
+		}
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		SDL_FreeSurface(images[i]);
+	}
+	return success;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <SDL.h>
+#include <string>
+#include <unordered_map>
+
+#include "AssetPack.h"
+
+//Shared ownership of one SDL texture.
+//Copying a handle copies a pointer and bumps a count; the texture is destroyed
+//when the last handle to it goes. So textures can be passed around and kept
+//by value freely without ever being copied or destroyed twice. Not thread
+//safe, like the renderer the textures belong to: keep handles on the thread
+//that draws.
+class TextureHandle
+{
+public:
+	TextureHandle();
+
+	//Takes ownership of texture (NULL gives an empty handle).
+	explicit TextureHandle(SDL_Texture* texture);
+
+	TextureHandle(const TextureHandle& other);
+	TextureHandle& operator=(const TextureHandle& other);
+	~TextureHandle();
+
+	SDL_Texture* get() const { return mShared != NULL ? mShared->texture : NULL; }
+	int width() const { return mShared != NULL ? mShared->width : 0; }
+	int height() const { return mShared != NULL ? mShared->height : 0; }
+	bool empty() const { return mShared == NULL; }
+
+	//Lets go of the texture, destroying it if this was the last handle.
+	void reset();
+
+private:
+	struct Shared
+	{
+		SDL_Texture* texture;
+		int width;
+		int height;
+		int references;
+	};
+
+	Shared* mShared;
+};
+
+//Every image the client draws, loaded once.
+//Images come out of the asset pack (AssetPack.h) when there is one, and are
+//decoded from their own files otherwise. Textures are kept by name, so asking
+//again for the same one hands out another handle to the same texture.
+//All textures are made for one renderer: clear the cache before destroying it.
+class AssetCache
+{
+public:
+	//Maps the pack at path; images are looked for there first. Returns false if
+	//there's no usable pack, in which case every image comes from its own file.
+	bool openPack(const char* path);
+
+	bool hasPack() const { return mPack.isOpen(); }
+
+	//The texture made from the image file name. An empty handle if it can't be loaded.
+	TextureHandle texture(SDL_Renderer* renderer, const char* name);
+
+	//The image's pixels as an ARGB8888 surface, cyan already transparent, for
+	//building something else out of them (like a sprite atlas). Out of the pack
+	//it points straight into the mapping; don't write to it. Free it with
+	//SDL_FreeSurface. NULL if it can't be loaded.
+	SDL_Surface* surface(const char* name);
+
+	//Forgets every texture. Those still held elsewhere live until their handles go.
+	void clear();
+
+private:
+	AssetPack mPack;
+	std::unordered_map<std::string, TextureHandle> mTextures;
+};
+
+//Decodes each image file, applies the colour key and writes them all into one asset pack at path.
+bool writeAssetPack(const char* path, const char* const names[], int count);
@@ -1,6 +1,6 @@
 #include "Dot.h"
 
-Dot::Dot(int width, int height, LTexture dotTexture)
+Dot::Dot(int width, int height, const LTexture& dotTexture)
 {
 	//Initialize the offsets
 	mPosX = 0;
@@ -16,7 +16,7 @@ public:
 	static const int DOT_VEL = 10;
 
 	//Initializes the variables
-	Dot(int width, int height, LTexture dotTexture);
+	Dot(int width, int height, const LTexture& dotTexture);
 
 	//Takes key presses and adjusts the dot's velocity
 	void handleEvent(SDL_Event& e);
@@ -0,0 +1,106 @@
+#include "EntityWorld.h"
+
+#include "Simulation.h"
+
+const int EntityWorld::NO_ENTITY;
+
+Team teamOf(int playerID)
+{
+	return playerID == 1 ? TEAM_RUNNER : TEAM_CHASER;
+}
+
+int EntityWorld::add(uint16_t playerID)
+{
+	//Each player starts in the same place as on the server.
+	int startX, startY;
+	startPosition(playerID, startX, startY);
+	return add(playerID, startX, startY);
+}
+
+int EntityWorld::add(uint16_t playerID, int startX, int startY)
+{
+	int index = find(playerID);
+	if (index != NO_ENTITY)
+		return index;
+
+	if (playerID >= mIndexOf.size())
+		mIndexOf.resize(playerID + 1, NO_ENTITY);
+	index = size();
+	mIndexOf[playerID] = index;
+
+	id.push_back(playerID);
+	team.push_back((uint8_t)teamOf(playerID));
+	x.push_back(startX);
+	y.push_back(startY);
+	prevX.push_back(startX);
+	prevY.push_back(startY);
+	checkedX.push_back(startX);
+	checkedY.push_back(startY);
+	velX.push_back(0);
+	velY.push_back(0);
+	return index;
+}
+
+void EntityWorld::remove(uint16_t playerID)
+{
+	int index = find(playerID);
+	if (index == NO_ENTITY)
+		return;
+
+	//Fill the hole with the last dot, so the columns stay packed.
+	int last = size() - 1;
+	if (index != last)
+	{
+		id[index] = id[last];
+		team[index] = team[last];
+		x[index] = x[last];
+		y[index] = y[last];
+		prevX[index] = prevX[last];
+		prevY[index] = prevY[last];
+		checkedX[index] = checkedX[last];
+		checkedY[index] = checkedY[last];
+		velX[index] = velX[last];
+		velY[index] = velY[last];
+		mIndexOf[id[index]] = index;
+	}
+	id.pop_back();
+	team.pop_back();
+	x.pop_back();
+	y.pop_back();
+	prevX.pop_back();
+	prevY.pop_back();
+	checkedX.pop_back();
+	checkedY.pop_back();
+	velX.pop_back();
+	velY.pop_back();
+	mIndexOf[playerID] = NO_ENTITY;
+}
+
+int EntityWorld::find(uint16_t playerID) const
+{
+	return playerID < mIndexOf.size() ? mIndexOf[playerID] : NO_ENTITY;
+}
+
+void EntityWorld::place(int index, int newX, int newY)
+{
+	x[index] = newX;
+	y[index] = newY;
+	prevX[index] = newX;
+	prevY[index] = newY;
+}
+
+void EntityWorld::step()
+{
+	int count = size();
+	prevX = x;
+	prevY = y;
+	for (int i = 0; i < count; i++)
+		stepDot(x[i], y[i], velX[i], velY[i]);
+}
+
+void EntityWorld::step(int index)
+{
+	prevX[index] = x[index];
+	prevY[index] = y[index];
+	stepDot(x[index], y[index], velX[index], velY[index]);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+//Which side of the chase a dot is on. Player 1 runs; everyone else chases.
+enum Team
+{
+	TEAM_RUNNER = 0,
+	TEAM_CHASER = 1
+};
+
+Team teamOf(int playerID);
+
+//Every dot in the match, stored column by column.
+//Each field is its own array, with one entry per dot in the same order, so a
+//pass that only needs positions (stepping, drawing, collision) walks only
+//those, straight through memory. Dots are looked up by the server's player ID
+//through a small table; removing one moves the last dot into its place, so
+//hold IDs rather than indices across a removal.
+class EntityWorld
+{
+public:
+	static const int NO_ENTITY = -1;
+
+	//Adds player id's dot at its start position, or finds the one already there. Returns its index.
+	int add(uint16_t playerID);
+
+	//The same, but a new dot starts at (startX, startY): for one first heard of
+	//part way through a match, which has long since left its start position.
+	int add(uint16_t playerID, int startX, int startY);
+
+	//Does nothing if there's no such dot.
+	void remove(uint16_t playerID);
+
+	//Index of player id's dot, or NO_ENTITY.
+	int find(uint16_t playerID) const;
+
+	int size() const { return (int)id.size(); }
+
+	//Puts a dot somewhere without drawing it sliding there.
+	//It still counts as having moved there for the next collision check.
+	void place(int index, int newX, int newY);
+
+	//Moves every dot one simulation step by its velocity (see Simulation.h).
+	void step();
+
+	//Moves one dot one step, as step() would.
+	void step(int index);
+
+	//The columns.
+	std::vector<uint16_t> id;
+	std::vector<uint8_t> team;
+	std::vector<int> x;
+	std::vector<int> y;
+	std::vector<int> prevX;		//where each dot was before the last step, to draw it in between
+	std::vector<int> prevY;
+	std::vector<int> checkedX;	//where each dot was at the last collision check, to sweep from there to where it is now
+	std::vector<int> checkedY;
+	std::vector<int> velX;
+	std::vector<int> velY;
+
+private:
+	std::vector<int> mIndexOf;	//by player ID; NO_ENTITY where there's no dot
+};
@@ -2,16 +2,11 @@
 
 LTexture::LTexture()
 {
-
+	gRenderer = NULL;
 }
 
 LTexture::LTexture(SDL_Renderer* g)
 {
-	//Initialize
-	mTexture = NULL;
-	mWidth = 0;
-	mHeight = 0;
-
 	gRenderer = g;
 }
 
@@ -26,9 +21,6 @@ bool LTexture::loadFromFile(std::string path)
 	//Get rid of preexisting texture
 	free();
 
-	//The final texture
-	SDL_Texture* newTexture = NULL;
-
 	//Load image at specified path
 	SDL_Surface* loadedSurface = IMG_Load(path.c_str());
 	if (loadedSurface == NULL)
@@ -41,25 +33,18 @@ bool LTexture::loadFromFile(std::string path)
 		SDL_SetColorKey(loadedSurface, SDL_TRUE, SDL_MapRGB(loadedSurface->format, 0, 0xFF, 0xFF));
 
 		//Create texture from surface pixels
-		newTexture = SDL_CreateTextureFromSurface(gRenderer, loadedSurface);
-		if (newTexture == NULL)
+		mTexture = TextureHandle(SDL_CreateTextureFromSurface(gRenderer, loadedSurface));
+		if (mTexture.empty())
 		{
 			printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
 		}
-		else
-		{
-			//Get image dimensions
-			mWidth = loadedSurface->w;
-			mHeight = loadedSurface->h;
-		}
 
 		//Get rid of old loaded surface
 		SDL_FreeSurface(loadedSurface);
 	}
 
 	//Return success
-	mTexture = newTexture;
-	return mTexture != NULL;
+	return !mTexture.empty();
 }
 
 #ifdef _SDL_TTF_H
@@ -73,17 +58,11 @@ bool LTexture::loadFromRenderedText(std::string textureText, SDL_Color textColor
 	if (textSurface != NULL)
 	{
 		//Create texture from surface pixels
-		mTexture = SDL_CreateTextureFromSurface(gRenderer, textSurface);
-		if (mTexture == NULL)
+		mTexture = TextureHandle(SDL_CreateTextureFromSurface(gRenderer, textSurface));
+		if (mTexture.empty())
 		{
 			printf("Unable to create texture from rendered text! SDL Error: %s\n", SDL_GetError());
 		}
-		else
-		{
-			//Get image dimensions
-			mWidth = textSurface->w;
-			mHeight = textSurface->h;
-		}
 
 		//Get rid of old surface
 		SDL_FreeSurface(textSurface);
@@ -95,44 +74,38 @@ bool LTexture::loadFromRenderedText(std::string textureText, SDL_Color textColor
 
 
 	//Return success
-	return mTexture != NULL;
+	return !mTexture.empty();
 }
 #endif
 
 void LTexture::free()
 {
-	//Free texture if it exists
-	if (mTexture != NULL)
-	{
-		SDL_DestroyTexture(mTexture);
-		mTexture = NULL;
-		mWidth = 0;
-		mHeight = 0;
-	}
+	//The texture itself goes once nothing else holds it
+	mTexture.reset();
 }
 
 void LTexture::setColor(Uint8 red, Uint8 green, Uint8 blue)
 {
 	//Modulate texture rgb
-	SDL_SetTextureColorMod(mTexture, red, green, blue);
+	SDL_SetTextureColorMod(mTexture.get(), red, green, blue);
 }
 
 void LTexture::setBlendMode(SDL_BlendMode blending)
 {
 	//Set blending function
-	SDL_SetTextureBlendMode(mTexture, blending);
+	SDL_SetTextureBlendMode(mTexture.get(), blending);
 }
 
 void LTexture::setAlpha(Uint8 alpha)
 {
 	//Modulate texture alpha
-	SDL_SetTextureAlphaMod(mTexture, alpha);
+	SDL_SetTextureAlphaMod(mTexture.get(), alpha);
 }
 
 void LTexture::render(int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip)
 {
 	//Set rendering space and render to screen
-	SDL_Rect renderQuad = { x, y, mWidth, mHeight };
+	SDL_Rect renderQuad = { x, y, mTexture.width(), mTexture.height() };
 
 	//Set clip rendering dimensions
 	if (clip != NULL)
@@ -142,15 +115,15 @@ void LTexture::render(int x, int y, SDL_Rect* clip, double angle, SDL_Point* cen
 	}
 
 	//Render to screen
-	SDL_RenderCopyEx(gRenderer, mTexture, clip, &renderQuad, angle, center, flip);
+	SDL_RenderCopyEx(gRenderer, mTexture.get(), clip, &renderQuad, angle, center, flip);
 }
 
 int LTexture::getWidth()
 {
-	return mWidth;
+	return mTexture.width();
 }
 
 int LTexture::getHeight()
 {
-	return mHeight;
+	return mTexture.height();
 }
\ No newline at end of file
@@ -4,7 +4,9 @@
 #include <SDL.h>
 #include <SDL_image.h>
 
-//Texture wrapper class
+#include "Assets.h"
+
+//Texture wrapper class. Copies share the one texture (see TextureHandle).
 class LTexture
 {
 public:
@@ -23,7 +25,7 @@ public:
 	bool loadFromRenderedText(std::string textureText, SDL_Color textColor);
 #endif
 
-	//Deallocates texture
+	//Lets go of the texture
 	void free();
 
 	//Set color modulation
@@ -43,12 +45,8 @@ public:
 	int getHeight();
 
 private:
-	//The actual hardware texture
-	SDL_Texture* mTexture;
+	//The actual hardware texture, and its dimensions
+	TextureHandle mTexture;
 
 	SDL_Renderer* gRenderer;
-
-	//Image dimensions
-	int mWidth;
-	int mHeight;
 };
\ No newline at end of file
@@ -0,0 +1,389 @@
+#include "Network.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Log.h"
+
+Network::Network()
+	: mTcp(NULL), mUdp(NULL), mSendPacket(NULL), mReceivePacket(NULL),
+	mPlayerID(0), mAuthoritative(false), mToken(0), mSendSequence(0), mReceiveSequence(0), mNextPing(0), mReplayStart(0),
+	mThread(NULL), mRunning(false), mLost(false), mRoundTrip(0)
+{
+	memset(&mServer, 0, sizeof(mServer));
+	mSockets = SDLNet_AllocSocketSet(2);
+	mIncoming = new SpscQueue<Incoming, QUEUE_SIZE>();
+	mOutgoing = new SpscQueue<Outgoing, QUEUE_SIZE>();
+}
+
+Network::~Network()
+{
+	stop();
+	closeChannel();
+	if (mTcp != NULL)
+		SDLNet_TCP_Close(mTcp);
+	SDLNet_FreeSocketSet(mSockets);
+	delete mIncoming;
+	delete mOutgoing;
+}
+
+uint16_t Network::connect(IPaddress& address)
+{
+	mServer = address;
+	mTcp = SDLNet_TCP_Open(&address);
+	if (mTcp == NULL)
+	{
+		printf("Could not connect to the server! SDL_net Error: %s\n", SDLNet_GetError());
+		return 0;
+	}
+	SDLNet_TCP_AddSocket(mSockets, mTcp);
+
+	//Wait for the welcome message; it carries our player ID. Anything that
+	//arrives with it stays in mFrames for the network thread.
+	MessageHeader header;
+	char* message = NULL;
+	FrameBuffer::Result result = FrameBuffer::FRAME_INCOMPLETE;
+	while (result == FrameBuffer::FRAME_INCOMPLETE)
+	{
+		int received = SDLNet_TCP_Recv(mTcp, mFrames.writePtr(), mFrames.writeSpace());
+		if (received <= 0)
+			break;
+		mFrames.commit(received);
+		result = mFrames.next(header, message);
+	}
+	if (result == FrameBuffer::FRAME_READY && header.type == MSG_WELCOME)
+	{
+		mRecorder.record(RECORD_IN, RECORD_TCP, 0, message, messageSize(header));
+		uint8_t flags;
+		if (decodeWelcome(message + HEADER_SIZE, header.length, mPlayerID, flags))
+			mAuthoritative = (flags & WELCOME_AUTHORITATIVE) != 0;
+	}
+	return mPlayerID;
+}
+
+bool Network::record(const char* path)
+{
+	if (!mRecorder.open(path, RECORD_CLIENT))
+	{
+		printf("Could not create %s; not recording\n", path);
+		return false;
+	}
+	return true;
+}
+
+uint16_t Network::replay(const char* path)
+{
+	if (!mReplay.open(path) || mReplay.source() != RECORD_CLIENT)
+	{
+		printf("Could not play back %s: not a client recording\n", path);
+		mReplay.close();
+		return 0;
+	}
+
+	//Everything starts from the welcome, as it did for the recorded client.
+	ReplayRecord record;
+	while (mReplay.next(record))
+	{
+		uint8_t flags;
+		if (record.kind == RECORD_IN && record.header.type == MSG_WELCOME &&
+			decodeWelcome(record.message + HEADER_SIZE, record.header.length, mPlayerID, flags))
+		{
+			mAuthoritative = (flags & WELCOME_AUTHORITATIVE) != 0;
+			mReplayStart = record.time;
+			break;
+		}
+	}
+	return mPlayerID;
+}
+
+bool Network::start()
+{
+	if (mTcp == NULL && !mReplay.isOpen())
+		return false;
+	mRunning.store(true, std::memory_order_release);
+	mThread = SDL_CreateThread(threadMain, "Network", this);
+	if (mThread == NULL)
+	{
+		printf("Could not start the network thread! SDL Error: %s\n", SDL_GetError());
+		mRunning.store(false, std::memory_order_release);
+		return false;
+	}
+	return true;
+}
+
+void Network::stop()
+{
+	if (mThread == NULL)
+		return;
+	mRunning.store(false, std::memory_order_release);
+	SDL_WaitThread(mThread, NULL);
+	mThread = NULL;
+}
+
+bool Network::send(const char* message, int length, bool reliable)
+{
+	Outgoing* slot = mOutgoing->claim();
+	if (slot == NULL)
+		return false;
+	slot->length = length;
+	slot->reliable = reliable;
+	memcpy(slot->message, message, length);
+	mOutgoing->publish();
+	return true;
+}
+
+int Network::threadMain(void* data)
+{
+	((Network*)data)->run();
+	return 0;
+}
+
+void Network::run()
+{
+	if (mReplay.isOpen())
+	{
+		runReplay();
+		return;
+	}
+	while (mRunning.load(std::memory_order_acquire))
+	{
+		flushOutgoing();
+
+		Uint32 now = SDL_GetTicks();
+		if ((Sint32)(now - mNextPing) >= 0)
+		{//The server echoes this straight back as MSG_PONG.
+			char ping[HEADER_SIZE + 4];
+			int length = encodePing(ping, mPlayerID, nowUs());
+			mRecorder.record(RECORD_OUT, RECORD_TCP, 0, ping, length);
+			if (SDLNet_TCP_Send(mTcp, ping, length) < length)
+			{
+				logError("Lost connection to the server");
+				mLost.store(true, std::memory_order_release);
+				break;
+			}
+			mNextPing = now + PING_MS;
+		}
+
+		//Wakes as soon as either socket has something; otherwise after 1ms to pick up what the game wants sent.
+		if (SDLNet_CheckSockets(mSockets, 1) < 0)
+		{
+			SDL_Delay(1);
+			continue;
+		}
+		if (!readTcp())
+		{
+			mLost.store(true, std::memory_order_release);
+			break;
+		}
+		readUdp();
+	}
+}
+
+//Hands every complete message in mFrames to the game thread, reading the
+//socket again each time they run out. Stops early if the game thread is
+//behind: the rest waits in the socket and TCP slows the server down for us.
+bool Network::readTcp()
+{
+	for (;;)
+	{
+		MessageHeader header;
+		char* message = NULL;
+		FrameBuffer::Result result = FrameBuffer::FRAME_INCOMPLETE;
+		Incoming* slot;
+		while ((slot = mIncoming->claim()) != NULL && (result = mFrames.next(header, message)) == FrameBuffer::FRAME_READY)
+		{
+			mRecorder.record(RECORD_IN, RECORD_TCP, 0, message, messageSize(header));
+			const char* payload = message + HEADER_SIZE;
+			if (header.type == MSG_PONG)
+			{
+				uint32_t sent;
+				if (decodePing(payload, header.length, sent))
+					mRoundTrip.store(nowUs() - sent, std::memory_order_relaxed);
+				continue;
+			}
+			if (header.type == MSG_PING)
+			{//The server checking we're still there; the send already told it.
+				continue;
+			}
+			if (header.type == MSG_CHANNEL)
+			{//The server can take positions over UDP. Open our end and say hello on it so it knows where we are.
+				uint32_t token;
+				if (mUdp == NULL && decodeChannel(payload, header.length, token) && openChannel(token))
+				{
+					char hello[HEADER_SIZE + 4];
+					int length = encodeChannel(hello, mPlayerID, token);
+					sendState(hello, length);
+				}
+				continue;
+			}
+
+			deliver(slot, header, message);
+		}
+
+		if (slot == NULL)
+			return true;
+		if (result == FrameBuffer::FRAME_ERROR)
+		{
+			logError("Lost sync with the server");
+			return false;
+		}
+		if (!SDLNet_SocketReady(mTcp))
+			return true;
+
+		int received = SDLNet_TCP_Recv(mTcp, mFrames.writePtr(), mFrames.writeSpace());
+		if (received <= 0)
+		{
+			mRecorder.record(RECORD_CLOSE, RECORD_TCP, 0);
+			logError("Lost connection to the server");
+			return false;
+		}
+		mFrames.commit(received);
+		SDLNet_CheckSockets(mSockets, 0);
+	}
+}
+
+//Takes every waiting datagram from the server, skipping any that arrived after
+//a newer one: what they say is already out of date. If the game thread is
+//behind they are dropped too; the next position replaces them anyway.
+void Network::readUdp()
+{
+	if (mUdp == NULL || !SDLNet_SocketReady(mUdp))
+		return;
+
+	UDPpacket* packet = mReceivePacket;
+	while (SDLNet_UDP_Recv(mUdp, packet) > 0)
+	{
+		MessageHeader header;
+		Uint32 token, sequence;
+		if (packet->address.host != mServer.host || packet->address.port != mServer.port)
+			continue;
+		if (!readDatagram((char*)packet->data, packet->len, token, sequence, header) || token != mToken)
+			continue;
+		if (!sequenceNewer(sequence, mReceiveSequence))
+			continue;
+		mReceiveSequence = sequence;
+		mRecorder.record(RECORD_IN, RECORD_UDP, 0, (const char*)packet->data + DATAGRAM_PREFIX_SIZE, messageSize(header));
+
+		Incoming* slot = mIncoming->claim();
+		if (slot == NULL)
+			continue;
+		deliver(slot, header, (const char*)packet->data + DATAGRAM_PREFIX_SIZE);
+	}
+}
+
+//Hands one message to the game thread in a slot claimed from mIncoming.
+void Network::deliver(Incoming* slot, const MessageHeader& header, const char* message)
+{
+	slot->header = header;
+	slot->receivedAt = SDL_GetPerformanceCounter();
+	slot->receivedTicks = SDL_GetTicks();
+	memcpy(slot->message, message, HEADER_SIZE + header.length);
+	mIncoming->publish();
+}
+
+//The network thread when replaying: hands each message the recorded client
+//received to the game thread once as much time has passed since start() as
+//had passed since its welcome. Nothing is dropped; if the game falls behind,
+//the replay waits for it, so it always sees the same messages in the same order.
+void Network::runReplay()
+{
+	Uint64 started = SDL_GetPerformanceCounter();
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	ReplayRecord record;
+	bool more = mReplay.next(record);
+	while (more && mRunning.load(std::memory_order_acquire))
+	{
+		while (mOutgoing->front() != NULL)
+			mOutgoing->release();
+
+		Uint64 elapsed = SDL_GetPerformanceCounter() - started;
+		uint64_t nowUs = elapsed / frequency * 1000000 + elapsed % frequency * 1000000 / frequency;
+		while (more && record.time - mReplayStart <= nowUs)
+		{
+			if (record.kind == RECORD_IN && record.header.type != MSG_PING && record.header.type != MSG_PONG && record.header.type != MSG_CHANNEL)
+			{//Pings and the channel handshake were between the recorded client and its server.
+				Incoming* slot = mIncoming->claim();
+				if (slot == NULL)
+					break;
+				deliver(slot, record.header, record.message);
+			}
+			more = mReplay.next(record);
+		}
+		SDL_Delay(1);
+	}
+	logInfo("End of the recording");
+}
+
+//Sends everything the game thread has queued, in order.
+void Network::flushOutgoing()
+{
+	while (Outgoing* out = mOutgoing->front())
+	{
+		if (out->reliable || mUdp == NULL)
+		{
+			mRecorder.record(RECORD_OUT, RECORD_TCP, 0, out->message, out->length);
+			if (SDLNet_TCP_Send(mTcp, out->message, out->length) < out->length)
+			{
+				logError("Lost connection to the server");
+				mLost.store(true, std::memory_order_release);
+				mRunning.store(false, std::memory_order_release);
+			}
+		}
+		else
+		{
+			sendState(out->message, out->length);
+		}
+		mOutgoing->release();
+	}
+}
+
+//One datagram to the server. A lost one is never resent.
+void Network::sendState(const char* message, int length)
+{
+	mRecorder.record(RECORD_OUT, RECORD_UDP, 0, message, length);
+	char* datagram = (char*)mSendPacket->data;
+	int prefix = writeDatagramPrefix(datagram, mToken, ++mSendSequence);
+	memcpy(datagram + prefix, message, length);
+	mSendPacket->len = prefix + length;
+	mSendPacket->address = mServer;
+	SDLNet_UDP_Send(mUdp, -1, mSendPacket);
+}
+
+bool Network::openChannel(Uint32 token)
+{
+	mUdp = SDLNet_UDP_Open(0);
+	mSendPacket = SDLNet_AllocPacket(MAX_DATAGRAM_SIZE);
+	mReceivePacket = SDLNet_AllocPacket(MAX_DATAGRAM_SIZE);
+	mToken = token;
+	if (mUdp == NULL || mSendPacket == NULL || mReceivePacket == NULL)
+	{
+		printf("Could not open UDP channel! SDL_net Error: %s\n", SDLNet_GetError());
+		closeChannel();
+		return false;
+	}
+	SDLNet_UDP_AddSocket(mSockets, mUdp);
+	return true;
+}
+
+void Network::closeChannel()
+{
+	if (mUdp != NULL)
+	{
+		SDLNet_UDP_DelSocket(mSockets, mUdp);
+		SDLNet_UDP_Close(mUdp);
+	}
+	SDLNet_FreePacket(mSendPacket);
+	SDLNet_FreePacket(mReceivePacket);
+	mUdp = NULL;
+	mSendPacket = NULL;
+	mReceivePacket = NULL;
+}
+
+//Microseconds on the performance counter, for the ping. Wraps every 71 minutes,
+//which the subtraction in readTcp doesn't mind.
+Uint32 Network::nowUs() const
+{
+	Uint64 counter = SDL_GetPerformanceCounter();
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	return (Uint32)(counter / frequency * 1000000 + counter % frequency * 1000000 / frequency);
+}
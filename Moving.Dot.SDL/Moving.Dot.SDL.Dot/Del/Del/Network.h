@@ -0,0 +1,118 @@
+#pragma once
+
+#include <SDL.h>
+#include <SDL_net.h>
+#include <atomic>
+
+#include "Protocol.h"
+#include "FrameBuffer.h"
+#include "SpscQueue.h"
+#include "Recording.h"
+
+//The client's connection to the server, run on its own thread.
+//All socket work happens there: reading TCP and UDP, sending, the UDP
+//channel handshake and a ping every second to measure the round trip. Whole
+//messages are handed to the game thread through one SpscQueue and the game
+//thread's messages come back through another, so a slow frame never holds up
+//the sockets and a burst of packets never holds up a frame.
+//The thread can also record everything it sends and receives, or play a
+//recording back to the game instead of talking to a server (see Recording.h).
+class Network
+{
+public:
+	//A message from the server, as the network thread received it.
+	struct Incoming
+	{
+		MessageHeader header;
+		Uint64 receivedAt;		//SDL_GetPerformanceCounter() when it came off the socket
+		Uint32 receivedTicks;	//SDL_GetTicks() at the same moment
+		char message[MAX_MESSAGE_SIZE];	//Header included, as the handlers expect.
+	};
+
+	Network();
+	~Network();
+
+	//Connects and waits for MSG_WELCOME (blocking, on the calling thread).
+	//Returns our player ID, or 0 if there is no server or it didn't welcome us.
+	uint16_t connect(IPaddress& address);
+
+	//Records every message from here on to the file at path. Call before connect().
+	bool record(const char* path);
+
+	//Instead of connect(): plays back a client recording. The messages the
+	//recorded client received reach the game at the times they arrived then,
+	//and anything the game sends goes nowhere. Returns the recorded player ID,
+	//or 0 if the file isn't a client recording.
+	uint16_t replay(const char* path);
+
+	//Starts the network thread. Everything after this goes through the queues.
+	bool start();
+	void stop();
+
+	//Game thread: the oldest message not handled yet, or NULL. Call pop() when done with it.
+	const Incoming* front() { return mIncoming->front(); }
+	void pop() { mIncoming->release(); }
+
+	//Game thread: queues a message for the server. Reliable ones go over TCP,
+	//the rest over UDP once the channel is open. Returns false if the queue is full.
+	bool send(const char* message, int length, bool reliable);
+
+	//Set by the network thread once the connection is gone.
+	bool lost() const { return mLost.load(std::memory_order_acquire); }
+
+	//True if the server said it runs the game itself (WELCOME_AUTHORITATIVE): send
+	//MSG_INPUT instead of positions and leave game over to it.
+	bool authoritative() const { return mAuthoritative; }
+
+	//Newest round trip time in microseconds, 0 until the first pong.
+	Uint32 roundTrip() const { return mRoundTrip.load(std::memory_order_relaxed); }
+
+private:
+	struct Outgoing
+	{
+		int length;
+		bool reliable;
+		char message[MAX_MESSAGE_SIZE];
+	};
+
+	static const int QUEUE_SIZE = 256;
+	static const Uint32 PING_MS = 1000;
+
+	static int threadMain(void* data);
+	void run();
+	void runReplay();
+	bool readTcp();
+	void readUdp();
+	void flushOutgoing();
+	void deliver(Incoming* slot, const MessageHeader& header, const char* message);
+	void sendState(const char* message, int length);
+	bool openChannel(Uint32 token);
+	void closeChannel();
+	Uint32 nowUs() const;
+
+	IPaddress mServer;
+	TCPsocket mTcp;
+	UDPsocket mUdp;		//NULL until the server sends MSG_CHANNEL
+	UDPpacket* mSendPacket;
+	UDPpacket* mReceivePacket;
+	SDLNet_SocketSet mSockets;
+	FrameBuffer mFrames;
+	uint16_t mPlayerID;
+	bool mAuthoritative;
+	Uint32 mToken;
+	Uint32 mSendSequence;
+	Uint32 mReceiveSequence;	//Newest datagram handed on so far.
+	Uint32 mNextPing;
+	Recorder mRecorder;
+	ReplayFile mReplay;		//open while replaying
+	uint64_t mReplayStart;	//when, in the recording, the welcome arrived
+
+	SDL_Thread* mThread;
+	std::atomic<bool> mRunning;
+	std::atomic<bool> mLost;
+	std::atomic<Uint32> mRoundTrip;
+
+	//Allocated once up front; a few hundred KB is too much for the game thread's stack.
+	SpscQueue<Incoming, QUEUE_SIZE>* mIncoming;
+	SpscQueue<Outgoing, QUEUE_SIZE>* mOutgoing;
+};
@@ -6,29 +6,71 @@ and may not be redistributed without written permission.*/
 #include <SDL_image.h>
 #include <SDL_net.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <string>
-#include <iostream>
+#include <algorithm>
+
+#include "Protocol.h"
+#include "FrameBuffer.h"
+#include "DeltaSnapshot.h"
+#include "Prediction.h"
+#include "Simulation.h"
+#include "Collision.h"
+#include "Interpolation.h"
+#include "InterestGrid.h"
+#include "Network.h"
+#include "EntityWorld.h"
+#include "SpriteBatch.h"
+#include "Assets.h"
+#include "Log.h"
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
 const unsigned short PORT = 1234;
-const unsigned short BUFFER_SIZE = 512;
-const unsigned short MAX_SOCKETS = 3;
-const unsigned short MAX_CLIENTS = MAX_SOCKETS - 1;
+const unsigned short BUFFER_SIZE = MAX_MESSAGE_SIZE;
 
-//Texture wrapper class
+//Other players' dots are drawn this far in the past, between the positions either side (see Interpolation.h).
+//Override with --interp-delay <ms>; it wants to be a bit more than the usual gap between updates.
+const Uint32 DEFAULT_INTERPOLATION_DELAY = 100;
+//How long a remote dot keeps going after its updates stop, before it waits where it is.
+const Uint32 EXTRAPOLATION_LIMIT = 50;
+
+//The game runs in fixed steps of 1/FRAMES_PER_SECOND (see Prediction.h) however fast the display refreshes.
+//After a stall (dragging the window, say) at most this many steps are caught up; the rest of the time is dropped.
+const int MAX_STEPS_PER_FRAME = 5;
+
+//Our position goes out when it changes, at most this many times a second (--send-rate <n>)...
+const int DEFAULT_SEND_RATE = 30;
+//...and every so often while standing still, so the server knows we're there and a lost datagram gets replaced.
+const int KEEPALIVE_STEPS = FRAMES_PER_SECOND / 2;
+
+//Frame times and network latency are printed this often, each measured on its own.
+const Uint32 STATS_INTERVAL = 5000;
+
+//The dot images, in the order loadMedia packs them into the atlas.
+enum DotSprite
+{
+	SPRITE_RED_DOT,
+	SPRITE_BLUE_DOT,
+	SPRITE_GREEN_DOT,
+	SPRITE_COUNT
+};
+const char* const DOT_IMAGES[SPRITE_COUNT] = { "reddot.bmp", "bluedot.bmp", "greendot.bmp" };
+
+//--bench-sprites <dots> draws this many frames each way, offscreen.
+const int BENCH_FRAMES = 100;
+
+//Texture wrapper class. Copies share the one texture (see TextureHandle).
 class LTexture
 {
 public:
 	//Initializes variables
 	LTexture();
 
-	//Deallocates memory
-	~LTexture();
-
-	//Loads image at specified path
+	//Loads image at specified path, or takes the one already loaded from gAssets
 	bool loadFromFile(std::string path);
 
 #ifdef _SDL_TTF_H
@@ -36,7 +78,7 @@ public:
 	bool loadFromRenderedText(std::string textureText, SDL_Color textColor);
 #endif
 
-	//Deallocates texture
+	//Lets go of the texture
 	void free();
 
 	//Set color modulation
@@ -56,52 +98,8 @@ public:
 	int getHeight();
 
 private:
-	//The actual hardware texture
-	SDL_Texture* mTexture;
-
-	//Image dimensions
-	int mWidth;
-	int mHeight;
-};
-//The dot that will move around on the screen
-class Dot
-{
-public:
-	//The dimensions of the dot
-	static const int DOT_WIDTH = 20;
-	static const int DOT_HEIGHT = 20;
-
-	//Maximum axis velocity of the dot
-	static const int DOT_VEL = 2;
-
-	//Used to determine which player this dot is. Player 1 (host) is drawn in red; Player 2 (guest) is drawn in blue.
-	int m_playerNum; 
-
-	//Initializes the variables
-	Dot(int playerNum);
-
-	//Takes key presses and adjusts the dot's velocity
-	void handleEvent(SDL_Event& e);
-
-	bool handleCollision(Dot other);
-
-	//Moves the dot
-	void move();
-
-	//Shows the dot on the screen
-	void render();
-
-	int getX();
-	int getY();
-
-	void setPosition(int x, int y);
-
-private:
-	//The X and Y offsets of the dot
-	int mPosX, mPosY;
-
-	//The velocity of the dot
-	int mVelX, mVelY;
+	//The actual hardware texture, and its dimensions
+	TextureHandle mTexture;
 };
 
 //Starts up SDL and creates window
@@ -113,94 +111,61 @@ bool loadMedia();
 //Frees media and shuts down SDL
 void close();
 
+//Takes key presses and adjusts the velocity of the dot they steer
+void handleEvent(SDL_Event& e, int& velX, int& velY);
+
+//True if a chaser's dot has touched the runner's since the last check
+bool runnerCaught(EntityWorld& world);
+
+//Shows every dot on the screen, alpha of the way from where the last step started to where it ended
+void renderDots(const EntityWorld& world, double alpha);
+
+//Times drawing this many dots with the software renderer, a texture per colour and a call per dot against the atlas batch
+int runSpriteBench(int dots);
+
+//Keeps a position that arrived for another player's dot, adding the dot if it's new
+void addRemotePosition(EntityWorld& world, std::vector<InterpolationBuffer>& remoteDots, uint16_t id, Uint32 time, int x, int y);
+
 //The window we'll be rendering to
 SDL_Window* gWindow = NULL;
 
 //The window renderer
 SDL_Renderer* gRenderer = NULL;
 
-//Scene textures
-LTexture redDotTexture;
-LTexture blueDotTexture;
-LTexture greenDotTexture;
+//Every image, loaded once (from the asset pack when there is one)
+AssetCache gAssets;
 
-LTexture::LTexture()
-{
-	//Initialize
-	mTexture = NULL;
-	mWidth = 0;
-	mHeight = 0;
-}
+//Every dot is drawn from one atlas, in one batch a frame
+SpriteAtlas dotAtlas;
+SpriteBatch dotBatch;
 
-LTexture::~LTexture()
+//The broadphase for runnerCaught, kept between checks so it doesn't reallocate
+CollisionGrid dotGrid;
+std::vector<Contact> dotContacts;
+
+LTexture::LTexture()
 {
-	//Deallocate
-	free();
 }
 
 bool LTexture::loadFromFile(std::string path)
 {
-	//Get rid of preexisting texture
-	free();
-
-	//The final texture
-	SDL_Texture* newTexture = NULL;
-
-	//Load image at specified path
-	SDL_Surface* loadedSurface = IMG_Load(path.c_str());
-	if (loadedSurface == NULL)
-	{
-		printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError());
-	}
-	else
-	{
-		//Color key image
-		SDL_SetColorKey(loadedSurface, SDL_TRUE, SDL_MapRGB(loadedSurface->format, 0, 0xFF, 0xFF));
-
-		//Create texture from surface pixels
-		newTexture = SDL_CreateTextureFromSurface(gRenderer, loadedSurface);
-		if (newTexture == NULL)
-		{
-			printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
-		}
-		else
-		{
-			//Get image dimensions
-			mWidth = loadedSurface->w;
-			mHeight = loadedSurface->h;
-		}
-
-		//Get rid of old loaded surface
-		SDL_FreeSurface(loadedSurface);
-	}
-
-	//Return success
-	mTexture = newTexture;
-	return mTexture != NULL;
+	mTexture = gAssets.texture(gRenderer, path.c_str());
+	return !mTexture.empty();
 }
 
 #ifdef _SDL_TTF_H
 bool LTexture::loadFromRenderedText(std::string textureText, SDL_Color textColor)
 {
-	//Get rid of preexisting texture
-	free();
-
 	//Render text surface
 	SDL_Surface* textSurface = TTF_RenderText_Solid(gFont, textureText.c_str(), textColor);
 	if (textSurface != NULL)
 	{
 		//Create texture from surface pixels
-		mTexture = SDL_CreateTextureFromSurface(gRenderer, textSurface);
-		if (mTexture == NULL)
+		mTexture = TextureHandle(SDL_CreateTextureFromSurface(gRenderer, textSurface));
+		if (mTexture.empty())
 		{
 			printf("Unable to create texture from rendered text! SDL Error: %s\n", SDL_GetError());
 		}
-		else
-		{
-			//Get image dimensions
-			mWidth = textSurface->w;
-			mHeight = textSurface->h;
-		}
 
 		//Get rid of old surface
 		SDL_FreeSurface(textSurface);
@@ -212,44 +177,38 @@ bool LTexture::loadFromRenderedText(std::string textureText, SDL_Color textColor
 
 
 	//Return success
-	return mTexture != NULL;
+	return !mTexture.empty();
 }
 #endif
 
 void LTexture::free()
 {
-	//Free texture if it exists
-	if (mTexture != NULL)
-	{
-		SDL_DestroyTexture(mTexture);
-		mTexture = NULL;
-		mWidth = 0;
-		mHeight = 0;
-	}
+	//The texture itself goes once nothing else holds it
+	mTexture.reset();
 }
 
 void LTexture::setColor(Uint8 red, Uint8 green, Uint8 blue)
 {
 	//Modulate texture rgb
-	SDL_SetTextureColorMod(mTexture, red, green, blue);
+	SDL_SetTextureColorMod(mTexture.get(), red, green, blue);
 }
 
 void LTexture::setBlendMode(SDL_BlendMode blending)
 {
 	//Set blending function
-	SDL_SetTextureBlendMode(mTexture, blending);
+	SDL_SetTextureBlendMode(mTexture.get(), blending);
 }
 
 void LTexture::setAlpha(Uint8 alpha)
 {
 	//Modulate texture alpha
-	SDL_SetTextureAlphaMod(mTexture, alpha);
+	SDL_SetTextureAlphaMod(mTexture.get(), alpha);
 }
 
 void LTexture::render(int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip)
 {
 	//Set rendering space and render to screen
-	SDL_Rect renderQuad = { x, y, mWidth, mHeight };
+	SDL_Rect renderQuad = { x, y, mTexture.width(), mTexture.height() };
 
 	//Set clip rendering dimensions
 	if (clip != NULL)
@@ -258,47 +217,29 @@ void LTexture::render(int x, int y, SDL_Rect* clip, double angle, SDL_Point* cen
 		renderQuad.h = clip->h;
 	}
 
-	//Render to screen
-	SDL_RenderCopyEx(gRenderer, mTexture, clip, &renderQuad, angle, center, flip);
+	//Render to screen. Plain copies skip the rotation maths.
+	if (angle == 0.0 && flip == SDL_FLIP_NONE)
+	{
+		SDL_RenderCopy(gRenderer, mTexture.get(), clip, &renderQuad);
+	}
+	else
+	{
+		SDL_RenderCopyEx(gRenderer, mTexture.get(), clip, &renderQuad, angle, center, flip);
+	}
 }
 
 int LTexture::getWidth()
 {
-	return mWidth;
+	return mTexture.width();
 }
 
 int LTexture::getHeight()
 {
-	return mHeight;
+	return mTexture.height();
 }
 
 
-Dot::Dot(int playerNum)
-{
-	m_playerNum = playerNum;
-
-	if (m_playerNum == 1) 
-	{//Initialize starting positions.
-		mPosX = 0;
-		mPosY = 0;
-	}
-	else if (m_playerNum == 2)
-	{//Each player starts in a different position.
-		mPosX = (SCREEN_WIDTH / 3) - DOT_WIDTH;
-		mPosY = (SCREEN_HEIGHT / 3) - DOT_HEIGHT;
-	}
-	else if (m_playerNum == 3)
-	{
-		mPosX = (SCREEN_WIDTH * 2 / 3) - DOT_WIDTH;
-		mPosY = (SCREEN_HEIGHT * 2 / 3) - DOT_HEIGHT;
-	}
-
-	//Initialize the velocity
-	mVelX = 0;
-	mVelY = 0;
-}
-
-void Dot::handleEvent(SDL_Event& e)
+void handleEvent(SDL_Event& e, int& velX, int& velY)
 {
 	//If a key was pressed
 	if (e.type == SDL_KEYDOWN && e.key.repeat == 0)
@@ -306,10 +247,10 @@ void Dot::handleEvent(SDL_Event& e)
 		//Adjust the velocity
 		switch (e.key.keysym.sym)
 		{
-		case SDLK_UP: mVelY -= DOT_VEL; break;
-		case SDLK_DOWN: mVelY += DOT_VEL; break;
-		case SDLK_LEFT: mVelX -= DOT_VEL; break;
-		case SDLK_RIGHT: mVelX += DOT_VEL; break;
+		case SDLK_UP: velY -= DOT_SPEED; break;
+		case SDLK_DOWN: velY += DOT_SPEED; break;
+		case SDLK_LEFT: velX -= DOT_SPEED; break;
+		case SDLK_RIGHT: velX += DOT_SPEED; break;
 		}
 	}
 	//If a key was released
@@ -318,87 +259,197 @@ void Dot::handleEvent(SDL_Event& e)
 		//Adjust the velocity
 		switch (e.key.keysym.sym)
 		{
-		case SDLK_UP: mVelY += DOT_VEL; break;
-		case SDLK_DOWN: mVelY -= DOT_VEL; break;
-		case SDLK_LEFT: mVelX += DOT_VEL; break;
-		case SDLK_RIGHT: mVelX -= DOT_VEL; break;
+		case SDLK_UP: velY += DOT_SPEED; break;
+		case SDLK_DOWN: velY -= DOT_SPEED; break;
+		case SDLK_LEFT: velX += DOT_SPEED; break;
+		case SDLK_RIGHT: velX -= DOT_SPEED; break;
 		}
 	}
 }
 
-bool Dot::handleCollision(Dot other)
+bool runnerCaught(EntityWorld& world)
 {
-	//Use the distance formula to calculate the distance between the two circles.
-	int distance = sqrt(((other.getX() - mPosX) * (other.getX() - mPosX)) + ((other.getY() - mPosY) * (other.getY() - mPosY)));
+	//Same test as the server uses in authoritative mode (dotsCollideSwept): each
+	//dot is swept from where it was at the last check, so one that moved further
+	//than a dot's width since then (a remote dot whose updates come in slowly,
+	//or a step after a stall) can't pass through the runner unnoticed. The grid
+	//picks out the pairs that ended close enough to have touched on the way, and
+	//only those with the runner in are swept.
+	int travel = 0;
+	for (int i = 0; i < world.size(); i++)
+	{
+		travel = std::max(travel, abs(fieldDeltaX(world.checkedX[i], world.x[i])) + abs(fieldDeltaY(world.checkedY[i], world.y[i])));
+	}
+	dotGrid.clear(sweptReach(travel));
+	for (int i = 0; i < world.size(); i++)
+	{
+		dotGrid.add(world.x[i], world.y[i]);	//same index as in the world
+	}
+	dotGrid.findContacts(dotContacts);
 
-	if (distance <= DOT_WIDTH)
-	{//If they're close enough, respond. Otherwise, do nothing.
-		std::cout << "COLLIDING ";
-		return true;
+	bool caught = false;
+	for (int k = 0; k < dotContacts.size() && !caught; k++)
+	{
+		int a = dotContacts[k].a;
+		int b = dotContacts[k].b;
+		if ((world.team[a] == TEAM_RUNNER) == (world.team[b] == TEAM_RUNNER))
+		{
+			continue;
+		}
+		caught = dotsCollideSwept(world.checkedX[a], world.checkedY[a], world.x[a], world.y[a],
+			world.checkedX[b], world.checkedY[b], world.x[b], world.y[b]);
+	}
+	world.checkedX = world.x;
+	world.checkedY = world.y;
+	if (caught)
+	{
+		logDebug("COLLIDING");
 	}
-	return false;
+	return caught;
 }
 
-void Dot::move()
+void renderDots(const EntityWorld& world, double alpha)
 {
-	//Move the dot left or right
-	mPosX += mVelX;
-
-	//If the dot moved off the left side.
-	if ((mPosX < -DOT_WIDTH))
+	dotBatch.begin(dotAtlas, SCREEN_WIDTH, SCREEN_HEIGHT);
+	for (int i = 0; i < world.size(); i++)
 	{
-		//Wrap to right.
-		mPosX = SCREEN_WIDTH;
+		//Between the last two steps, going the short way if the dot wrapped round an edge.
+		int x = wrapFieldX(world.prevX[i] + (int)(fieldDeltaX(world.prevX[i], world.x[i]) * alpha));
+		int y = wrapFieldY(world.prevY[i] + (int)(fieldDeltaY(world.prevY[i], world.y[i]) * alpha));
+
+		//The runner is red. Chasers are blue and green, taking turns by player ID, so 2 is blue and 3 is green.
+		if (world.team[i] == TEAM_RUNNER)
+			dotBatch.add(SPRITE_RED_DOT, x, y);
+		else if (world.id[i] % 2 == 0)
+			dotBatch.add(SPRITE_BLUE_DOT, x, y);
+		else
+			dotBatch.add(SPRITE_GREEN_DOT, x, y);
 	}
-	//If the dot moved off the right side.
-	else if (mPosX > SCREEN_WIDTH)
+	dotBatch.draw(gRenderer);
+}
+
+int runSpriteBench(int dots)
+{
+	SDL_Init(0);
+	SDL_Surface* target = SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+	gRenderer = target != NULL ? SDL_CreateSoftwareRenderer(target) : NULL;
+	if (gRenderer == NULL)
 	{
-		//Wrap to left.
-		mPosX = -DOT_WIDTH;
+		printf("Unable to create software renderer! SDL Error: %s\n", SDL_GetError());
+		return 1;
 	}
 
-	//Move the dot up or down
-	mPosY += mVelY;
+	//The old way: a texture per colour, drawn a dot at a time through LTexture::render.
+	LTexture textures[SPRITE_COUNT];
+	gAssets.openPack(ASSET_PACK_FILE);
+	bool loaded = dotAtlas.load(gRenderer, gAssets, DOT_IMAGES, SPRITE_COUNT);
+	for (int i = 0; i < SPRITE_COUNT; i++)
+	{
+		loaded = textures[i].loadFromFile(DOT_IMAGES[i]) && loaded;
+	}
+	if (!loaded)
+	{
+		return 1;
+	}
 
-	//If the dot moved off the left side.
-	if (mPosY < -DOT_HEIGHT)
+	//Spread over the whole field, edges included, the colours mixed the way a big match would have them.
+	srand(1);
+	std::vector<int> xs(dots), ys(dots), sprites(dots);
+	for (int i = 0; i < dots; i++)
 	{
-		//Wrap to right.
-		mPosY = SCREEN_HEIGHT;
+		xs[i] = FIELD_MIN_X + rand() % FIELD_WIDTH;
+		ys[i] = FIELD_MIN_Y + rand() % FIELD_HEIGHT;
+		sprites[i] = i % SPRITE_COUNT;
 	}
-	//If the dot moved off the right side.
-	else if (mPosY > SCREEN_HEIGHT)
+
+	double frameMs[2];
+	for (int pass = 0; pass < 2; pass++)
 	{
-		//Wrap to left.
-		mPosY = -DOT_HEIGHT;
+		//One frame first so setup costs aren't counted.
+		Uint64 start = 0;
+		for (int frame = -1; frame < BENCH_FRAMES; frame++)
+		{
+			if (frame == 0)
+			{
+				start = SDL_GetPerformanceCounter();
+			}
+			SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
+			SDL_RenderClear(gRenderer);
+			if (pass == 0)
+			{
+				for (int i = 0; i < dots; i++)
+				{
+					textures[sprites[i]].render(xs[i], ys[i]);
+				}
+			}
+			else
+			{
+				dotBatch.begin(dotAtlas, SCREEN_WIDTH, SCREEN_HEIGHT);
+				for (int i = 0; i < dots; i++)
+				{
+					dotBatch.add(sprites[i], xs[i], ys[i]);
+				}
+				dotBatch.draw(gRenderer);
+			}
+			SDL_RenderPresent(gRenderer);
+		}
+		frameMs[pass] = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / BENCH_FRAMES;
 	}
-}
+	//Which SpriteBatch path this is depends on the SDL it was built against (see SpriteBatch.h).
+	SDL_version built, linked;
+	SDL_VERSION(&built);
+	SDL_GetVersion(&linked);
+	printf("%d dots, software renderer, %dx%d, %d frames each:\n", dots, SCREEN_WIDTH, SCREEN_HEIGHT, BENCH_FRAMES);
+	printf("  SDL built against %d.%d.%d, running %d.%d.%d\n", built.major, built.minor, built.patch, linked.major, linked.minor, linked.patch);
+	printf("  texture per colour, a call per dot: %.2f ms a frame\n", frameMs[0]);
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	printf("  atlas, one SDL_RenderGeometry:      %.2f ms a frame (%.1fx)\n", frameMs[1], frameMs[0] / frameMs[1]);
+#else
+	printf("  atlas, a SDL_RenderCopy per dot:    %.2f ms a frame (%.1fx)\n", frameMs[1], frameMs[0] / frameMs[1]);
+#endif
 
-void Dot::render()
-{
-	//Show the dot. Player 1's is red, 2's is blue, 3's is green. Determine which is which, then draw.
-	if (m_playerNum == 1)
-		redDotTexture.render(mPosX, mPosY);
-	else if (m_playerNum == 2)
-		blueDotTexture.render(mPosX, mPosY);
-	else if (m_playerNum == 3)
-		greenDotTexture.render(mPosX, mPosY);
+	for (int i = 0; i < SPRITE_COUNT; i++)
+	{
+		textures[i].free();
+	}
+	dotAtlas.free();
+	gAssets.clear();
+	SDL_DestroyRenderer(gRenderer);
+	gRenderer = NULL;
+	SDL_FreeSurface(target);
+	SDL_Quit();
+	return 0;
 }
 
-int Dot::getX()
+void addRemotePosition(EntityWorld& world, std::vector<InterpolationBuffer>& remoteDots, uint16_t id, Uint32 time, int x, int y)
 {
-	return mPosX;
+	//A dot we haven't seen yet appears where it is now. Starting it at its start
+	//position would sweep it across the field at the next collision check.
+	world.add(id, x, y);
+	if (id >= remoteDots.size())
+	{
+		remoteDots.resize(id + 1);
+	}
+	remoteDots[id].add(time, x, y);
 }
 
-int Dot::getY()
+//Puts the dot where the server says it was after some input, then replays every
+//input it hasn't seen yet through the same step so the dot ends up where it is now.
+//The keys currently held down are left as they were.
+void reconcile(EntityWorld& world, int index, int x, int y, const InputBuffer& inputs)
 {
-	return mPosY;
-}
+	int velX = world.velX[index];
+	int velY = world.velY[index];
 
-void Dot::setPosition(int x, int y)
-{
-	mPosX = x;
-	mPosY = y;
+	world.place(index, x, y);
+	for (int i = 0; i < inputs.size(); i++)
+	{
+		world.velX[index] = inputs[i].velX;
+		world.velY[index] = inputs[i].velY;
+		world.step(index);
+	}
+	world.velX[index] = velX;
+	world.velY[index] = velY;
 }
 
 bool init()
@@ -461,20 +512,16 @@ bool loadMedia()
 	//Loading success flag
 	bool success = true;
 
-	//Load dot textures
-	if (!redDotTexture.loadFromFile("reddot.bmp"))
+	//Images come ready to use out of the asset pack; without one each is decoded from its own file
+	if (!gAssets.openPack(ASSET_PACK_FILE))
 	{
-		printf("Failed to load dot texture!\n");
-		success = false;
-	}
-	if (!blueDotTexture.loadFromFile("bluedot.bmp"))
-	{
-		printf("Failed to load dot texture!\n");
-		success = false;
+		printf("No asset pack %s, loading images from their own files\n", ASSET_PACK_FILE);
 	}
-	if (!greenDotTexture.loadFromFile("greendot.bmp"))
+
+	//Load the dot images, all into one texture
+	if (!dotAtlas.load(gRenderer, gAssets, DOT_IMAGES, SPRITE_COUNT))
 	{
-		printf("Failed to load dot texture!\n");
+		printf("Failed to load dot textures!\n");
 		success = false;
 	}
 
@@ -484,9 +531,8 @@ bool loadMedia()
 void close()
 {
 	//Free loaded images
-	redDotTexture.free();
-	blueDotTexture.free();
-	greenDotTexture.free();
+	dotAtlas.free();
+	gAssets.clear();
 
 	//Destroy window	
 	SDL_DestroyRenderer(gRenderer);
@@ -501,6 +547,71 @@ void close()
 
 int main(int argc, char* args[])
 {
+	Uint32 interpolationDelay = DEFAULT_INTERPOLATION_DELAY;
+	LogLevel logLevel = LOG_INFO; //--log-level debug shows every position received
+	int sendRate = DEFAULT_SEND_RATE;
+	const char* recordPath = NULL; //--record <file> saves every message sent and received (see Recording.h)
+	const char* replayPath = NULL; //--replay <file> plays one of those back instead of connecting
+	const char* host = "149.153.106.167"; //--host and --port: the server, or a NetEmu proxy in front of it
+	Uint16 port = 1234;
+	int benchSprites = 0; //--bench-sprites <dots> times drawing that many dots offscreen (see runSpriteBench) and exits
+	const char* packPath = NULL; //--pack-assets <file> writes the game's images into an asset pack (see AssetPack.h) and exits
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(args[i], "--interp-delay") == 0)
+		{
+			interpolationDelay = (Uint32)atoi(args[++i]);
+		}
+		else if (strcmp(args[i], "--send-rate") == 0)
+		{
+			sendRate = atoi(args[++i]);
+		}
+		else if (strcmp(args[i], "--log-level") == 0)
+		{
+			parseLogLevel(args[++i], logLevel);
+		}
+		else if (strcmp(args[i], "--record") == 0)
+		{
+			recordPath = args[++i];
+		}
+		else if (strcmp(args[i], "--replay") == 0)
+		{
+			replayPath = args[++i];
+		}
+		else if (strcmp(args[i], "--host") == 0)
+		{
+			host = args[++i];
+		}
+		else if (strcmp(args[i], "--port") == 0)
+		{
+			port = (Uint16)atoi(args[++i]);
+		}
+		else if (strcmp(args[i], "--bench-sprites") == 0)
+		{
+			benchSprites = atoi(args[++i]);
+		}
+		else if (strcmp(args[i], "--pack-assets") == 0)
+		{
+			packPath = args[++i];
+		}
+	}
+	if (packPath != NULL)
+	{
+		SDL_Init(0);
+		bool packed = writeAssetPack(packPath, DOT_IMAGES, SPRITE_COUNT);
+		SDL_Quit();
+		return packed ? 0 : 1;
+	}
+	if (benchSprites > 0)
+	{
+		return runSpriteBench(benchSprites);
+	}
+	//Steps between sends; the rate can't go above one per step.
+	int sendSteps = sendRate > 0 && sendRate < FRAMES_PER_SECOND ? FRAMES_PER_SECOND / sendRate : 1;
+
+	//Logging is written out on its own thread (see Log.h), so it doesn't hold up frames.
+	logStart(stdout, logLevel);
+
 	//Start up SDL and create window
 	if (!init())
 	{
@@ -516,11 +627,7 @@ int main(int argc, char* args[])
 		else
 		{	
 			IPaddress ip;
-			TCPsocket sock;
-			SDLNet_SocketSet socks = SDLNet_AllocSocketSet(MAX_SOCKETS);
-			Uint16 port;
 			char buffer[BUFFER_SIZE];
-			int received = 0;
 
 			int playerID;
 			bool gameState = false; //Determines whether or not the game itself should run.
@@ -557,92 +664,221 @@ int main(int argc, char* args[])
 			// TEST: Run server indicated before, then CTRL+F5 this solution, once for each player. One client may automatically close; if this happens, close everything and start over.
 			// Working on multiple computers is not tested, but in theory, changing the IP address below to your server computer's IP should allow this one to connect to it. Hopefully?
 			
-			int please = SDLNet_ResolveHost(&ip, "149.153.106.167", 1234);
-			sock = SDLNet_TCP_Open(&ip); 
-			SDLNet_TCP_AddSocket(socks, sock);
-			SDLNet_TCP_Recv(sock, buffer, BUFFER_SIZE); //If you get an access violation error here, set up the server first.
-			sscanf_s(buffer, "0 %d", &playerID);
+			int please = SDLNet_ResolveHost(&ip, host, port);
+
+			//All socket work happens on the network thread from here on (see Network.h).
+			//Messages come to this loop through its queue and go back out through another.
+			Network* network = new Network();
+			if (replayPath != NULL)
+			{
+				playerID = network->replay(replayPath);
+			}
+			else
+			{
+				if (recordPath != NULL)
+				{
+					network->record(recordPath);
+				}
+				playerID = network->connect(ip);
+			}
+			if (!network->start())
+			{
+				quit = true;
+			}
 
 			//Event handler
 			SDL_Event e;
 
-			//The dots that will be moving around on the screen
-			Dot player1(1);
-			Dot player2(2);
-			Dot player3(3);
+			//The dots that will be moving around on the screen. The client starts with the usual three;
+			//anyone else in a bigger match joins when their first position arrives.
+			EntityWorld world;
+			for (int id = 1; id <= 3; id++)
+			{
+				world.add((uint16_t)id);
+			}
+
+			//The one this player controls, and the inputs behind it the server hasn't confirmed.
+			//Held by ID: indices change when a dot leaves.
+			bool hasLocalDot = playerID != SERVER_ID;
+			if (hasLocalDot)
+			{
+				world.add((uint16_t)playerID);
+			}
+			InputBuffer inputs;
+			//Keys held down, as a velocity. The local dot takes it each step.
+			int heldX = 0;
+			int heldY = 0;
+
+			//What we last told the server, and how many steps ago.
+			int sentX = 0;
+			int sentY = 0;
+			int stepsSinceSend = KEEPALIVE_STEPS;
 
-			//If Player 1 survives for a full minute, they win.
+			//Where the other dots have been lately, by player ID.
+			std::vector<InterpolationBuffer> remoteDots;
+
+			//Recent MSG_DELTA states; each one is decoded against one of these.
+			SnapshotHistory deltaHistory;
+			WorldState deltaState;
+			std::vector<uint16_t> removedDots;
+
+			//If Player 1 survives for thirty seconds (ENDGAME_FRAMES), they win. Counted in simulation steps, so it's the same on any display.
 			int timer = 0;
-			const int ENDGAME_TIME = 1800;
+
+			//An authoritative server moves every dot itself from the keys we send it, and decides when the game is over.
+			bool authoritative = network->authoritative();
+
+			//Real time not yet simulated, in performance counter ticks.
+			const Uint64 STEP_TICKS = SDL_GetPerformanceFrequency() / FRAMES_PER_SECOND;
+			Uint64 lastCounter = SDL_GetPerformanceCounter();
+			Uint64 accumulator = 0;
+
+			//Frame time is how long each pass of the loop takes, start to start. Network latency is the round trip
+			//the network thread measures, plus how long messages sit in its queue before we get to them.
+			//Kept apart so a slow frame isn't blamed on the network or the other way round.
+			const double TICKS_PER_MS = SDL_GetPerformanceFrequency() / 1000.0;
+			Uint32 nextStats = SDL_GetTicks() + STATS_INTERVAL;
+			int frameCount = 0;
+			Uint64 frameTicks = 0;
+			Uint64 longestFrame = 0;
+			int messageCount = 0;
+			Uint64 queueTicks = 0;
+			Uint64 longestQueue = 0;
 
 			//While application is running
 			while (!quit)
 			{
 				//Receive and interpret messages; move the other player's dot according to this.
-				while (SDLNet_CheckSockets(socks, 0) > 0)
+				//Everything the network thread has queued since the last frame is handled now.
+				while (const Network::Incoming* incoming = network->front())
 				{
-					if (SDLNet_SocketReady(sock)) {
-						memset(buffer, 0, sizeof(buffer)); //Clear the buffer first before receiving.
-						SDLNet_TCP_Recv(sock, buffer, BUFFER_SIZE); 
-						int num = buffer[0] - '0';
+					MessageHeader header = incoming->header;
+					const char* message = incoming->message;
+					const char* payload = message + HEADER_SIZE;
 
-						if (num == 1)
+					if (header.type == MSG_MOVE)
+					{
+						MoveMessage move;
+						decodeMove(payload, header.length, move);
+						int otherID = header.sender;
+						if (otherID != SERVER_ID && otherID != playerID)
 						{
+							addRemotePosition(world, remoteDots, (uint16_t)otherID, incoming->receivedTicks, move.x, move.y);
+						}
+
+						logDebug("P{}: ({}, {})  Time: {}", otherID, move.x, move.y, timer);
 
-							std::cout << buffer << std::endl;
+					}
 
-							int otherID;
-							int newX;
-							int newY;
-							sscanf_s(buffer, "1 %d %d %d", &otherID, &newX, &newY);
-							std::cout << "(" << newX << ", " << newY << ")" << std::endl;
-							if (otherID == 1)
+					if (header.type == MSG_SNAPSHOT)
+					{//One server tick's worth of positions. Our own entry is skipped; we already know where we are.
+						uint32_t tick;
+						int count;
+						if (decodeSnapshot(payload, header.length, tick, count))
+						{
+							for (int i = 0; i < count; i++)
 							{
-								player1.setPosition(newX, newY);
+								SnapshotEntry entry = snapshotEntry(payload, i);
+								if (entry.id != SERVER_ID && entry.id != playerID)
+								{
+									addRemotePosition(world, remoteDots, entry.id, incoming->receivedTicks, entry.x, entry.y);
+								}
 							}
-							else if (otherID == 2)
+						}
+					}
+
+					if (header.type == MSG_DELTA)
+					{//Positions as changes since a tick we acknowledged. Dots that aren't listed haven't moved.
+						uint32_t tick, baseTick;
+						const WorldState* baseline = NULL;
+						bool usable = readDeltaTicks(payload, header.length, tick, baseTick);
+						if (usable && baseTick != NO_BASELINE)
+						{
+							baseline = deltaHistory.find(baseTick);
+							usable = baseline != NULL; //Too old; don't ack, and the server will send everything again.
+						}
+						if (usable && decodeDelta(payload, header.length, baseline, deltaState, removedDots))
+						{
+							for (int i = 0; i < deltaState.entries.size(); i++)
 							{
-								player2.setPosition(newX, newY);
+								const SnapshotEntry& entry = deltaState.entries[i];
+								if (entry.id != SERVER_ID && entry.id != playerID)
+								{
+									addRemotePosition(world, remoteDots, entry.id, incoming->receivedTicks, entry.x, entry.y);
+								}
 							}
-							else if (otherID == 3)
+							WorldState& stored = deltaHistory.store(tick);
+							stored.entries.swap(deltaState.entries);
+
+							int length = encodeAck(buffer, (uint16_t)playerID, tick);
+							network->send(buffer, length, false);
+						}
+					}
+
+					if (header.type == MSG_DISCONNECT)
+					{//Someone left the match; stop drawing their dot.
+						uint16_t leftID;
+						if (decodeDisconnect(payload, header.length, leftID) && leftID != playerID)
+						{
+							world.remove(leftID);
+							if (leftID < remoteDots.size())
 							{
-								player3.setPosition(newX, newY);
+								remoteDots[leftID].clear();
 							}
+						}
+					}
 
-							std::cout << "P1: (" << player1.getX() << ", " << player1.getY() << ")" << std::endl <<
-										 "P2: (" << player2.getX() << ", " << player2.getY() << ")" << std::endl <<
-										 "P3: (" << player3.getX() << ", " << player3.getY() << ")" << std::endl <<
-										 "Time: " << timer << std::endl;
+					if (header.type == MSG_GAMEOVER)
+					{
+						uint8_t winner = WINNER_NONE;
+						decodeGameOver(payload, header.length, winner);
+						logInfo("Game over: {}", winner);
 
+						if (playerID == 1 && winner == WINNER_RUNNER)
+						{//You as Player 1 have won.
+							logInfo("YOU ALONE HAVE WON");
+						}
+						else if ((playerID == 2 || playerID == 3) && winner == WINNER_CHASERS)
+						{//You as Player 2 or 3 have won.
+							logInfo("YOUR TEAM HAS WON");
 						}
+						else
+						{//You, regardless of player, have lost.
+							logInfo("YOU HAVE LOST");
+						}
+						gameState = false;
+					}
 
-						if (num == 3)
-						{
-							std::cout << buffer << std::endl;
-							int winner;
-							sscanf_s(buffer, "3 %d", &winner);
+					if (header.type == MSG_START)
+					{//Command to start game has been received.
+						gameState = true;
+						logInfo("START GAME");
+					}
 
-							if (playerID == 1 && winner == 1)
-							{//You as Player 1 have won.
-								std::cout << "YOU ALONE HAVE WON" << std::endl;
-							}
-							else if ((playerID == 2 || playerID == 3) && winner == 2)
-							{//You as Player 2 or 3 have won.
-								std::cout << "YOUR TEAM HAS WON" << std::endl;
-							}
-							else
-							{//You, regardless of player, have lost.
-								std::cout << "YOU HAVE LOST" << std::endl;
-							}
-							gameState = false;
+					if (header.type == MSG_CORRECTION && hasLocalDot)
+					{//The server disagrees about where our dot is. Take its word as of that input and replay everything newer on top.
+						MoveMessage correction;
+						if (decodeCorrection(payload, header.length, correction))
+						{
+							inputs.acknowledge(correction.input);
+							reconcile(world, world.find((uint16_t)playerID), correction.x, correction.y, inputs);
 						}
+					}
 
-						if (num == 4)
-						{//Command to start game has been received.
-							gameState = true;
-							std::cout << "START GAME" << std::endl;
-						}
+					Uint64 waited = SDL_GetPerformanceCounter() - incoming->receivedAt;
+					queueTicks += waited;
+					if (waited > longestQueue)
+					{
+						longestQueue = waited;
 					}
+					messageCount++;
+
+					network->pop();
+				}
+
+				if (network->lost())
+				{//The network thread has already said why.
+					quit = true;
 				}
 
 				//Handle events on queue
@@ -656,79 +892,147 @@ int main(int argc, char* args[])
 
 					if (gameState)
 					{//Handle input for the dot only if the game is in progress.
-						if (playerID == 1)
+						handleEvent(e, heldX, heldY);
+					}
+				}
+
+				//Draw the other dots where they were interpolationDelay ago.
+				Uint32 renderTime = SDL_GetTicks() - interpolationDelay;
+				for (int i = 0; i < world.size(); i++)
+				{
+					int x, y;
+					int id = world.id[i];
+					if (id != playerID && id < remoteDots.size() && remoteDots[id].sample(renderTime, EXTRAPOLATION_LIMIT, x, y))
+					{
+						world.place(i, x, y);
+					}
+				}
+
+				//Run as many fixed steps as real time has passed. Input, moves, sends and the game timer all go at this rate.
+				Uint64 counter = SDL_GetPerformanceCounter();
+				Uint64 frame = counter - lastCounter;
+				accumulator += frame;
+				lastCounter = counter;
+				if (accumulator > MAX_STEPS_PER_FRAME * STEP_TICKS)
+				{
+					accumulator = MAX_STEPS_PER_FRAME * STEP_TICKS;
+				}
+
+				for (; accumulator >= STEP_TICKS; accumulator -= STEP_TICKS)
+				{
+					if (gameState)
+					{//Move the dot and send its new location to the other player only if the game is in progress.
+						//Our own dot moves straight away; this step's input is kept in case the server corrects us.
+						uint32_t input = 0;
+						int local = hasLocalDot ? world.find((uint16_t)playerID) : EntityWorld::NO_ENTITY;
+						if (local != EntityWorld::NO_ENTITY)
 						{
-							player1.handleEvent(e);
+							world.velX[local] = heldX;
+							world.velY[local] = heldY;
+							if (authoritative)
+							{//The server only hears which keys are held, so move by exactly what those give it.
+								inputVelocity(inputButtons(heldX, heldY), world.velX[local], world.velY[local]);
+							}
+							input = inputs.record(world.velX[local], world.velY[local]);
 						}
-						else if (playerID == 2)
-						{
-							player2.handleEvent(e);
+
+						world.step();
+
+						int length = 0;
+
+						if (local != EntityWorld::NO_ENTITY && authoritative)
+						{//Send every input the server hasn't confirmed, at the send rate. There's one every step whether
+							//the dot moves or not, so that doubles as the keep-alive.
+							stepsSinceSend++;
+							if (stepsSinceSend >= sendSteps && inputs.size() > 0)
+							{
+								uint8_t buttons[MAX_INPUTS_PER_MESSAGE];
+								int count = inputs.size() < MAX_INPUTS_PER_MESSAGE ? inputs.size() : MAX_INPUTS_PER_MESSAGE;
+								int first = inputs.size() - count;
+								for (int i = 0; i < count; i++)
+								{
+									buttons[i] = inputButtons(inputs[first + i].velX, inputs[first + i].velY);
+								}
+								length = encodeInput(buffer, playerID, inputs[inputs.size() - 1].sequence, buttons, count);
+								network->send(buffer, length, false);
+								stepsSinceSend = 0;
+							}
 						}
-						else if (playerID == 3)
-						{
-							player3.handleEvent(e);
+						else if (local != EntityWorld::NO_ENTITY)
+						{//Only send once the dot has moved and the rate allows, or the keep-alive is due.
+							stepsSinceSend++;
+							bool moved = world.x[local] != sentX || world.y[local] != sentY;
+							if ((moved && stepsSinceSend >= sendSteps) || stepsSinceSend >= KEEPALIVE_STEPS)
+							{
+								length = encodeMove(buffer, playerID, world.x[local], world.y[local], input);
+								network->send(buffer, length, false);
+								sentX = world.x[local];
+								sentY = world.y[local];
+								stepsSinceSend = 0;
+							}
 						}
-					}
-				}
 
-				if (gameState)
-				{//Move the dot and send its new location to the other player only if the game is in progress.
-					player1.move();
-					player2.move();
-					player3.move();
-
-					std::string msg;
+						if (!authoritative && runnerCaught(world))
+						{//Player 1 has been caught by either Player 2 or Player 3. It doesn't matter which; Player 1 loses, and the other two win as a team.
+							length = encodeGameOver(buffer, playerID, WINNER_CHASERS);
+							network->send(buffer, length, true);
+						}
 
-					if (playerID == 1)
-					{
-						msg = "1 1 " + std::to_string(player1.getX()) + " " + std::to_string(player1.getY()) + '\0';
-					}
-					else if (playerID == 2)
-					{
-						msg = "1 2 " + std::to_string(player2.getX()) + " " + std::to_string(player2.getY()) + '\0';
-					}
-					else if (playerID == 3)
-					{
-						msg = "1 3 " + std::to_string(player3.getX()) + " " + std::to_string(player3.getY()) + '\0';
-					}
-					memcpy(buffer, msg.c_str(), msg.size());
-					SDLNet_TCP_Send(sock, buffer, strlen(buffer) + 1);
-
-					if (player1.handleCollision(player2) || player1.handleCollision(player3))
-					{//Player 1 has been caught by either Player 2 or Player 3. It doesn't matter which; Player 1 loses, and the other two win as a team.
-						msg = "3 2" + '\0';
-						memcpy(buffer, msg.c_str(), msg.size());
-						SDLNet_TCP_Send(sock, buffer, strlen(buffer) + 1);
-					}
+						//Increment game timer and check for game end.
+						timer++;
 
-					//Increment game timer and check for game end.
-					timer++;
+						if (!authoritative && timer >= ENDGAME_FRAMES)
+						{//Game time has elapsed, and Player 1 has eluded the others. Player 1 wins, and the other two lose as a team.
+							length = encodeGameOver(buffer, playerID, WINNER_RUNNER);
+							network->send(buffer, length, true);
+						}
 
-					if (timer >= ENDGAME_TIME)
-					{//Game time has elapsed, and Player 1 has eluded the others. Player 1 wins, and the other two lose as a team.
-						msg = "3 1" + '\0';
-						memcpy(buffer, msg.c_str(), msg.size());
-						SDLNet_TCP_Send(sock, buffer, strlen(buffer) + 1);
 					}
-
 				}
 
 				//Clear screen
 				SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
 				SDL_RenderClear(gRenderer);
 
-				//Render objects
-				player1.render();
-				player2.render();
-				player3.render();
+				//Render objects, part of the way into the step that hasn't run yet
+				double alpha = (double)accumulator / STEP_TICKS;
+				renderDots(world, alpha);
 
 				//Update screen
 				SDL_RenderPresent(gRenderer);
+
+				//Frame time is from one pass of the loop to the next, so it includes waiting for vsync.
+				frameTicks += frame;
+				if (frame > longestFrame)
+				{
+					longestFrame = frame;
+				}
+				frameCount++;
+
+				if ((Sint32)(SDL_GetTicks() - nextStats) >= 0)
+				{
+					logInfo("Frame: {} ms average, {} ms longest over {} frames",
+						frameCount > 0 ? frameTicks / TICKS_PER_MS / frameCount : 0.0, longestFrame / TICKS_PER_MS, frameCount);
+					logInfo("Network: {} ms round trip, queued {} ms average, {} ms longest over {} messages",
+						network->roundTrip() / 1000.0, messageCount > 0 ? queueTicks / TICKS_PER_MS / messageCount : 0.0,
+						longestQueue / TICKS_PER_MS, messageCount);
+					frameCount = 0;
+					frameTicks = 0;
+					longestFrame = 0;
+					messageCount = 0;
+					queueTicks = 0;
+					longestQueue = 0;
+					nextStats = SDL_GetTicks() + STATS_INTERVAL;
+				}
 			}
+
+			network->stop();
+			delete network;
 		}
 	}
 
 	//Free resources and close SDL
+	logStop();
 	SDLNet_Quit();
 	close();
 
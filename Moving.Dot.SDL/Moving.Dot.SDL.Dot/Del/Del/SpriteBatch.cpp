@@ -0,0 +1,172 @@
+#include "SpriteBatch.h"
+
+#include <stdio.h>
+
+//Transparent pixels between sprites in the atlas, so linear filtering never
+//picks up a neighbour's edge.
+static const int GUTTER = 1;
+
+SpriteAtlas::SpriteAtlas()
+{
+	mWidth = 0;
+	mHeight = 0;
+}
+
+bool SpriteAtlas::load(SDL_Renderer* renderer, AssetCache& assets, const char* const paths[], int count)
+{
+	free();
+
+	//Load every image first, to know how big the atlas has to be.
+	std::vector<SDL_Surface*> images(count, (SDL_Surface*)NULL);
+	bool success = true;
+	int width = GUTTER;
+	int height = 0;
+	for (int i = 0; i < count; i++)
+	{
+		images[i] = assets.surface(paths[i]);
+		if (images[i] == NULL)
+		{
+			success = false;
+			continue;
+		}
+		SDL_Rect frame = { width, GUTTER, images[i]->w, images[i]->h };
+		mFrames.push_back(frame);
+		width += images[i]->w + GUTTER;
+		if (images[i]->h > height)
+		{
+			height = images[i]->h;
+		}
+	}
+	height += 2 * GUTTER;
+
+	//One row of images on a transparent background. The images are copied
+	//without blending, so their transparent pixels stay transparent in the atlas.
+	SDL_Surface* atlas = NULL;
+	if (success)
+	{
+		atlas = SDL_CreateRGBSurface(0, width, height, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+		if (atlas == NULL)
+		{
+			printf("Unable to create sprite atlas! SDL Error: %s\n", SDL_GetError());
+			success = false;
+		}
+	}
+	if (success)
+	{
+		SDL_FillRect(atlas, NULL, 0);
+		for (int i = 0; i < count; i++)
+		{
+			SDL_SetSurfaceBlendMode(images[i], SDL_BLENDMODE_NONE);
+			SDL_BlitSurface(images[i], NULL, atlas, &mFrames[i]);
+		}
+		mTexture = TextureHandle(SDL_CreateTextureFromSurface(renderer, atlas));
+		if (mTexture.empty())
+		{
+			printf("Unable to create texture from sprite atlas! SDL Error: %s\n", SDL_GetError());
+			success = false;
+		}
+		else
+		{
+			SDL_SetTextureBlendMode(mTexture.get(), SDL_BLENDMODE_BLEND);
+			mWidth = width;
+			mHeight = height;
+		}
+	}
+
+	SDL_FreeSurface(atlas);
+	for (int i = 0; i < count; i++)
+	{
+		SDL_FreeSurface(images[i]);
+	}
+	if (!success)
+	{
+		free();
+	}
+	return success;
+}
+
+void SpriteAtlas::free()
+{
+	mTexture.reset();
+	mWidth = 0;
+	mHeight = 0;
+	mFrames.clear();
+}
+
+SpriteBatch::SpriteBatch()
+{
+	mAtlas = NULL;
+	mWidth = 0;
+	mHeight = 0;
+	mCount = 0;
+}
+
+void SpriteBatch::begin(const SpriteAtlas& atlas, int width, int height)
+{
+	mAtlas = &atlas;
+	mWidth = width;
+	mHeight = height;
+	mCount = 0;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	mVertices.clear();
+#else
+	mSources.clear();
+	mDestinations.clear();
+#endif
+}
+
+void SpriteBatch::add(int sprite, int x, int y)
+{
+	const SDL_Rect& frame = mAtlas->frame(sprite);
+	if (x >= mWidth || y >= mHeight || x + frame.w <= 0 || y + frame.h <= 0)
+	{
+		return;
+	}
+	mCount++;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	float left = (float)x;
+	float top = (float)y;
+	float right = (float)(x + frame.w);
+	float bottom = (float)(y + frame.h);
+	float u0 = (float)frame.x / mAtlas->width();
+	float v0 = (float)frame.y / mAtlas->height();
+	float u1 = (float)(frame.x + frame.w) / mAtlas->width();
+	float v1 = (float)(frame.y + frame.h) / mAtlas->height();
+	SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+	SDL_Vertex corners[4] = {
+		{ { left, top }, white, { u0, v0 } },
+		{ { right, top }, white, { u1, v0 } },
+		{ { left, bottom }, white, { u0, v1 } },
+		{ { right, bottom }, white, { u1, v1 } }
+	};
+	mVertices.insert(mVertices.end(), corners, corners + 4);
+#else
+	SDL_Rect destination = { x, y, frame.w, frame.h };
+	mSources.push_back(frame);
+	mDestinations.push_back(destination);
+#endif
+}
+
+void SpriteBatch::draw(SDL_Renderer* renderer)
+{
+	if (mCount == 0)
+	{
+		return;
+	}
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	while ((int)mIndices.size() < mCount * 6)
+	{
+		int first = (int)mIndices.size() / 6 * 4;
+		int quad[6] = { first, first + 1, first + 2, first + 2, first + 1, first + 3 };
+		mIndices.insert(mIndices.end(), quad, quad + 6);
+	}
+	SDL_RenderGeometry(renderer, mAtlas->texture(), &mVertices[0], (int)mVertices.size(), &mIndices[0], mCount * 6);
+#else
+	for (int i = 0; i < mCount; i++)
+	{
+		SDL_RenderCopy(renderer, mAtlas->texture(), &mSources[i], &mDestinations[i]);
+	}
+#endif
+}
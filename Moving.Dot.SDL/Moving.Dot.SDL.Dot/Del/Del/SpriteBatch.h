@@ -0,0 +1,77 @@
+#pragma once
+
+#include <SDL.h>
+#include <vector>
+
+#include "Assets.h"
+
+//Drawing every dot in one call.
+//The dot images are packed side by side into one atlas texture when they're
+//loaded. Each frame the sprites to draw are gathered into a single vertex
+//list, two triangles apiece, and handed to SDL_RenderGeometry at once,
+//instead of one SDL_RenderCopyEx per dot switching between three textures.
+//SDL before 2.0.18 has no SDL_RenderGeometry; built against one of those,
+//each sprite is still its own SDL_RenderCopy, all from the one texture.
+//The SDL shipped with the project (SDL2.dll and SDL2.lib beside this file)
+//is 2.0.6, so that is the path it gets: a call per sprite, with no texture
+//switches between them but no merging either, since SDL only started
+//batching render calls in 2.0.10. The single call needs a newer SDL.
+
+//Packs images into one texture. Sprite numbers follow the order they were loaded in.
+class SpriteAtlas
+{
+public:
+	SpriteAtlas();
+
+	//Gets each image from assets and packs them into a new texture.
+	//Returns false if any image or the texture fails.
+	bool load(SDL_Renderer* renderer, AssetCache& assets, const char* const paths[], int count);
+
+	void free();
+
+	SDL_Texture* texture() const { return mTexture.get(); }
+	int width() const { return mWidth; }
+	int height() const { return mHeight; }
+
+	//Where sprite number sprite is in the texture.
+	const SDL_Rect& frame(int sprite) const { return mFrames[sprite]; }
+
+private:
+	TextureHandle mTexture;
+	int mWidth;
+	int mHeight;
+	std::vector<SDL_Rect> mFrames;
+};
+
+//Collects one frame's sprites from an atlas, then draws them all together.
+class SpriteBatch
+{
+public:
+	SpriteBatch();
+
+	//Starts a new frame drawn from atlas onto an area width by height.
+	//Sprites that fall entirely outside it are skipped.
+	void begin(const SpriteAtlas& atlas, int width, int height);
+
+	//Queues the sprite with its top-left corner at (x, y), at its own size.
+	void add(int sprite, int x, int y);
+
+	//Draws everything queued since begin.
+	void draw(SDL_Renderer* renderer);
+
+	//Sprites queued since begin.
+	int size() const { return mCount; }
+
+private:
+	const SpriteAtlas* mAtlas;
+	int mWidth;
+	int mHeight;
+	int mCount;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	std::vector<SDL_Vertex> mVertices;	//four per sprite: top-left, top-right, bottom-left, bottom-right
+	std::vector<int> mIndices;			//two triangles per sprite; the same pattern every frame, so only ever grows
+#else
+	std::vector<SDL_Rect> mSources;
+	std::vector<SDL_Rect> mDestinations;
+#endif
+};
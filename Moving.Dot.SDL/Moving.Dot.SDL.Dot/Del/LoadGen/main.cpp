@@ -0,0 +1,972 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <thread>
+
+#include "Protocol.h"
+#include "FrameBuffer.h"
+#include "Socket.h"
+#include "Poller.h"
+#include "DeltaSnapshot.h"
+#include "Prediction.h"
+#include "Simulation.h"
+
+//After Socket.h: windows.h must follow winsock2.h.
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+//Headless load generator for the game server.
+//Opens a lot of connections from one process and has each of them play like
+//the game client: it steps its dot 60 times a second with the same Simulation
+//code, holding random keys or following a script, sends positions (or, when
+//the server is authoritative, its inputs) at the client's send rate and pings
+//the server once a second. Reports message rates, round trip latency
+//percentiles and, given the server's process ID, the server's CPU as it goes.
+//Used as the soak test for large player counts and to capacity-plan the server:
+//
+//  LoadGen --clients 5000 --duration 60 --server-pid 1234
+//  LoadGen --clients 300 --script "R:60,RD:30,D:60,-:30"
+//
+//Latency is measured with MSG_PING / MSG_PONG, which travel through the same
+//receive, parse and send path as every other message, so a server that is
+//falling behind shows up as a growing tail.
+//
+//Position age is how long a moving bot's position took to reach the other bots
+//in its match, over whichever channel carries positions. Run it with and without
+//--udp on a lossy link to see what head-of-line blocking does to the tail.
+//Against an authoritative server it is instead how long a bot waited for the
+//MSG_CORRECTION that confirmed each input, and mispredictions counts the
+//corrections that moved the dot, which should stay at zero.
+//
+//Authoritative matches end (someone is caught, or the runner survives), so
+//there each bot joins a new match after game over, as a player would.
+//
+//--backlog-check <pings> runs a check instead of the load: one connection
+//sends that many pings before reading anything, so the server has to queue
+//pongs it can't send yet, then reads them back and sends one more ping once
+//they're all in. It fails if the pongs stop coming, which is what happens when
+//the server loses track of a connection with a backlog. Exits non-zero on
+//failure. The pongs (10 bytes each) have to overflow the socket buffers, but
+//by no more than the server's MAX_OUTBOUND or it drops us as a slow client;
+//shrinking the server's send buffer makes that easy to hit:
+//
+//  server --send-buffer 4096
+//  LoadGen --backlog-check 20000
+
+const int MAX_EVENTS = 256;
+const uint32_t REPORT_MS = 5000;
+const int RECEIVE_BUFFER = 4 * MAX_MESSAGE_SIZE;
+const int POSITION_HISTORY = 32;	//power of two
+const uint64_t KEEPALIVE_US = 500000;	//how often a still client repeats its position, as the game client does
+const uint64_t STEP_US = 1000000 / FRAMES_PER_SECOND;
+const int MIN_HOLD_FRAMES = 15;		//random input: how long a bot keeps the same keys held
+const int MAX_HOLD_FRAMES = 120;
+const uint64_t BACKLOG_STALL_US = 3000000;	//--backlog-check: this long without a pong in or a ping out is a failure
+
+//One step of --script: these keys, held for this many frames.
+struct ScriptStep{
+	uint8_t buttons;
+	int frames;
+};
+
+struct Options{
+	const char* host;
+	uint16_t port;
+	int clients;
+	double moveRate;	//MSG_MOVE per second, per client
+	double pingRate;	//MSG_PING per second, per client
+	int duration;		//seconds; 0 = until Ctrl+C
+	double moving;		//fraction of clients that move; the rest stand still and only send keep-alives, like the client
+	bool udp;			//open the UDP channel when the server offers one
+	const char* script;	//keys every moving bot follows, each from a different point; NULL = random keys
+	uint32_t seed;		//for random keys
+	int serverPid;		//0 = don't report server CPU
+	int backlogPings;	//0 = run the load; otherwise run the backlog check with this many pings
+	Options():host("127.0.0.1"), port(1234), clients(5000), moveRate(10), pingRate(1), duration(60), moving(1), udp(true), script(NULL), seed(1), serverPid(0), backlogPings(0) {}
+};
+
+struct Bot{
+	SocketHandle socket;
+	uint16_t id;		//as told by MSG_WELCOME
+	FrameBuffer frames;
+	int x, y;
+	int lastSentX, lastSentY;
+	InputBuffer inputs;	//as the client keeps them: every frame's input the server hasn't confirmed
+	uint32_t input;		//newest input number
+	uint64_t inputUs[InputBuffer::CAPACITY];	//when each input was pressed, by number, for input age
+	uint8_t buttons;	//random input: the keys held now, and for how many more frames
+	int holdFrames;
+	int scriptFrame;	//scripted input: where in the script the bot is
+	uint32_t random;
+	uint64_t nextStep;	//microseconds
+	uint64_t nextMove;
+	uint64_t lastSend;
+	uint64_t nextPing;
+	bool connected;
+	bool welcomed;		//the server has sent MSG_WELCOME on this connection, so it has really taken us
+	bool moving;
+	bool authoritative;	//the server said so in MSG_WELCOME
+	bool playing;		//between MSG_START and MSG_GAMEOVER
+	bool rejoin;		//the match is over; join another
+	SnapshotHistory* history;	//created by the first MSG_DELTA
+	SocketHandle udpSocket;		//INVALID_SOCKET_HANDLE until the server sends MSG_CHANNEL
+	uint32_t udpToken;
+	uint32_t udpSendSequence;
+	uint32_t udpRecvSequence;
+	int16_t sentX[POSITION_HISTORY];	//recent positions sent, for position age
+	int16_t sentY[POSITION_HISTORY];
+	uint64_t sentUs[POSITION_HISTORY];
+	int sentCount;
+	Bot():socket(INVALID_SOCKET_HANDLE), id(0), frames(RECEIVE_BUFFER), x(0), y(0), lastSentX(0), lastSentY(0), input(0), buttons(0), holdFrames(0), scriptFrame(0), random(1),
+		nextStep(0), nextMove(0), lastSend(0), nextPing(0), connected(false), welcomed(false), moving(true), authoritative(false), playing(false), rejoin(false), history(NULL),
+		udpSocket(INVALID_SOCKET_HANDLE), udpToken(0), udpSendSequence(0), udpRecvSequence(0), sentCount(0) {}
+};
+
+//Counters for one report interval.
+struct Report{
+	std::vector<uint32_t> rtts;	//microseconds
+	std::vector<uint32_t> positionAges;	//microseconds
+	long long movesSent;
+	long long pingsSent;
+	long long messagesIn;
+	long long bytesIn;
+	long long deltasIn;
+	long long deltaFailures;	//MSG_DELTA whose baseline we no longer had
+	long long sendsDropped;	//socket buffer full; the server isn't keeping up
+	long long datagramsIn;
+	long long datagramsStale;	//arrived after a newer one and were thrown away
+	long long corrections;
+	long long mispredictions;	//corrections that put the dot somewhere the bot hadn't
+	long long inputsSent;		//MSG_INPUT
+	long long gamesOver;
+	Report():movesSent(0), pingsSent(0), messagesIn(0), bytesIn(0), deltasIn(0), deltaFailures(0), sendsDropped(0), datagramsIn(0), datagramsStale(0), corrections(0),
+		mispredictions(0), inputsSent(0), gamesOver(0) {}
+};
+
+Options options;
+Poller poller;
+std::vector<Bot> bots;
+Report report;
+std::vector<uint32_t> allRtts;
+std::vector<uint32_t> allPositionAges;
+UdpAddress serverAddress;
+WorldState deltaState;
+std::vector<uint16_t> removedDots;
+std::vector<ScriptStep> script;
+int scriptFrames = 0;
+bool authoritative = false;	//any bot was told so; changes what the second latency line measures
+int disconnects = 0;
+volatile std::sig_atomic_t running = 1;
+
+uint64_t nowUs()
+{
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void stop(int)
+{
+	running = 0;
+}
+
+//Poller keys: each bot has a TCP and possibly a UDP socket, told apart by the low bit.
+void* keyFor(int index, bool udp)
+{
+	return (void*)(uintptr_t)(index * 2 + (udp ? 1 : 0));
+}
+
+void closeSockets(Bot& bot)
+{
+	poller.remove(bot.socket);
+	closeSocket(bot.socket);
+	if (bot.udpSocket != INVALID_SOCKET_HANDLE)
+	{
+		poller.remove(bot.udpSocket);
+		closeSocket(bot.udpSocket);
+		bot.udpSocket = INVALID_SOCKET_HANDLE;
+	}
+	bot.connected = false;
+	bot.welcomed = false;
+}
+
+void closeBot(Bot& bot)
+{
+	if (!bot.connected)
+		return;
+	closeSockets(bot);
+	disconnects++;
+}
+
+//Connects the bot and resets everything it knew about its last match.
+bool joinBot(Bot& bot, int index)
+{
+	bot.socket = connectTcp(options.host, options.port);
+	if (bot.socket == INVALID_SOCKET_HANDLE)
+		return false;
+	bot.connected = true;
+	bot.playing = false;
+	bot.rejoin = false;
+	bot.frames.clear();
+	bot.inputs = InputBuffer();
+	bot.udpToken = 0;
+	bot.udpSendSequence = 0;
+	bot.udpRecvSequence = 0;
+	bot.sentCount = 0;
+	delete bot.history;
+	bot.history = NULL;
+	poller.add(bot.socket, keyFor(index, false));
+	return true;
+}
+
+//Bots only send a few bytes at a time, so anything the socket won't take in
+//one go means the server has stopped reading. Count it rather than queue it.
+void sendFrom(Bot& bot, const char* message, int length)
+{
+	int sent = socketSend(bot.socket, message, length);
+	if (sent == SOCKET_FAILED)
+		closeBot(bot);
+	else if (sent != length)
+		report.sendsDropped++;
+}
+
+//Positions and acks go over UDP once the channel is open, like the game client.
+void sendState(Bot& bot, const char* message, int length)
+{
+	if (bot.udpSocket == INVALID_SOCKET_HANDLE)
+	{
+		sendFrom(bot, message, length);
+		return;
+	}
+	char datagram[MAX_DATAGRAM_SIZE];
+	int prefix = writeDatagramPrefix(datagram, bot.udpToken, ++bot.udpSendSequence);
+	memcpy(datagram + prefix, message, length);
+	if (udpSendTo(bot.udpSocket, datagram, prefix + length, serverAddress) != prefix + length)
+		report.sendsDropped++;
+}
+
+//Opens the bot's UDP channel with the token from MSG_CHANNEL and says hello on it.
+void openChannel(Bot& bot, int index, uint32_t token)
+{
+	if (!options.udp || bot.udpSocket != INVALID_SOCKET_HANDLE)
+		return;
+	bot.udpSocket = openUdp(0);
+	if (bot.udpSocket == INVALID_SOCKET_HANDLE)
+		return;
+	bot.udpToken = token;
+	poller.add(bot.udpSocket, keyFor(index, true));
+
+	char hello[HEADER_SIZE + 4];
+	int length = encodeChannel(hello, bot.id, token);
+	sendState(bot, hello, length);
+}
+
+//Notes where the bot's dot is now, for the other bots' position age.
+void rememberPosition(Bot& bot)
+{
+	int n = bot.sentCount++ & (POSITION_HISTORY - 1);
+	bot.sentX[n] = (int16_t)bot.x;
+	bot.sentY[n] = (int16_t)bot.y;
+	bot.sentUs[n] = nowUs();
+}
+
+//Position age: how long ago the bot in slot sender of this bot's match sent (x, y).
+//Bots join matches in the order they connected, so the sender is a neighbour.
+void recordPosition(const Bot& bot, int index, uint16_t sender, int16_t x, int16_t y)
+{
+	int other = index - (bot.id - 1) + (sender - 1);
+	if (bot.id == 0 || other < 0 || other >= (int)bots.size() || bots[other].id != sender || !bots[other].moving)
+		return;
+
+	const Bot& from = bots[other];
+	for (int k = 1; k <= POSITION_HISTORY && k <= from.sentCount; k++)
+	{
+		int n = (from.sentCount - k) & (POSITION_HISTORY - 1);
+		if (from.sentX[n] == x && from.sentY[n] == y)
+		{
+			report.positionAges.push_back((uint32_t)(nowUs() - from.sentUs[n]));
+			return;
+		}
+	}
+}
+
+//Decodes a MSG_DELTA the way the game client does and acknowledges it.
+//Only the dots it changed count towards position age: the rest are the baseline's, already counted.
+void handleDelta(Bot& bot, int index, const char* payload, int length)
+{
+	if (bot.history == NULL)
+		bot.history = new SnapshotHistory();
+
+	uint32_t tick, baseTick;
+	if (!readDeltaTicks(payload, length, tick, baseTick))
+		return;
+	const WorldState* baseline = bot.history->find(baseTick);
+	if ((baseTick != NO_BASELINE && baseline == NULL) || !decodeDelta(payload, length, baseline, deltaState, removedDots))
+	{
+		report.deltaFailures++;
+		return;
+	}
+	report.deltasIn++;
+	for (int i = 0; i < deltaState.entries.size(); i++)
+	{
+		const SnapshotEntry& entry = deltaState.entries[i];
+		const SnapshotEntry* before = baseline != NULL ? baseline->find(entry.id) : NULL;
+		if (before == NULL || before->x != entry.x || before->y != entry.y)
+			recordPosition(bot, index, entry.id, entry.x, entry.y);
+	}
+	bot.history->store(tick).entries.swap(deltaState.entries);
+
+	char ack[HEADER_SIZE + 4];
+	int ackLength = encodeAck(ack, bot.id, tick);
+	sendState(bot, ack, ackLength);
+}
+
+void handleMessage(Bot& bot, int index, const MessageHeader& header, const char* message)
+{
+	const char* payload = message + HEADER_SIZE;
+	report.messagesIn++;
+
+	if (header.type == MSG_WELCOME)
+	{
+		uint8_t flags;
+		if (decodeWelcome(payload, header.length, bot.id, flags))
+		{
+			bot.welcomed = true;
+			bot.authoritative = (flags & WELCOME_AUTHORITATIVE) != 0;
+		}
+		if (bot.authoritative)
+			authoritative = true;
+	}
+	else if (header.type == MSG_START)
+	{
+		startPosition(bot.id, bot.x, bot.y);
+		bot.lastSentX = bot.x;
+		bot.lastSentY = bot.y;
+		bot.playing = true;
+	}
+	else if (header.type == MSG_PONG)
+	{
+		uint32_t sent;
+		if (decodePing(payload, header.length, sent))
+			report.rtts.push_back((uint32_t)nowUs() - sent);
+	}
+	else if (header.type == MSG_MOVE)
+	{
+		MoveMessage move;
+		if (decodeMove(payload, header.length, move))
+			recordPosition(bot, index, header.sender, move.x, move.y);
+	}
+	else if (header.type == MSG_SNAPSHOT)
+	{
+		uint32_t tick;
+		int count;
+		if (decodeSnapshot(payload, header.length, tick, count))
+		{
+			for (int i = 0; i < count; i++)
+			{
+				SnapshotEntry entry = snapshotEntry(payload, i);
+				recordPosition(bot, index, entry.id, entry.x, entry.y);
+			}
+		}
+	}
+	else if (header.type == MSG_DELTA)
+	{
+		handleDelta(bot, index, payload, header.length);
+	}
+	else if (header.type == MSG_CORRECTION)
+	{
+		//Reconciled the way the client does it: from where the server put the
+		//dot as of that input, replay every newer one.
+		MoveMessage correction;
+		if (decodeCorrection(payload, header.length, correction))
+		{
+			report.corrections++;
+			if (bot.authoritative && sequenceNewer(bot.input + 1, correction.input) && bot.input - correction.input < InputBuffer::CAPACITY)
+				report.positionAges.push_back((uint32_t)(nowUs() - bot.inputUs[correction.input % InputBuffer::CAPACITY]));
+
+			bot.inputs.acknowledge(correction.input);
+			int x = correction.x;
+			int y = correction.y;
+			for (int i = 0; i < bot.inputs.size(); i++)
+				stepDot(x, y, bot.inputs[i].velX, bot.inputs[i].velY);
+			if (x != bot.x || y != bot.y)
+				report.mispredictions++;
+			bot.x = x;
+			bot.y = y;
+		}
+	}
+	else if (header.type == MSG_CHANNEL)
+	{
+		uint32_t token;
+		if (decodeChannel(payload, header.length, token))
+			openChannel(bot, index, token);
+	}
+	else if (header.type == MSG_GAMEOVER)
+	{
+		uint8_t winner;
+		if (!decodeGameOver(payload, header.length, winner))
+			return;
+		if (winner == WINNER_NONE)
+			closeBot(bot); //The server is full.
+		else if (bot.authoritative && bot.playing)
+		{
+			bot.playing = false;
+			bot.rejoin = true;
+			report.gamesOver++;
+		}
+	}
+}
+
+void readFrom(Bot& bot, int index)
+{
+	while (bot.connected)
+	{
+		int received = socketRecv(bot.socket, bot.frames.writePtr(), bot.frames.writeSpace());
+		if (received == SOCKET_AGAIN)
+			return;
+		if (received <= 0)
+		{
+			closeBot(bot);
+			return;
+		}
+		bot.frames.commit(received);
+		report.bytesIn += received;
+
+		MessageHeader header;
+		char* message;
+		FrameBuffer::Result result;
+		while ((result = bot.frames.next(header, message)) == FrameBuffer::FRAME_READY)
+			handleMessage(bot, index, header, message);
+		if (result == FrameBuffer::FRAME_ERROR)
+			closeBot(bot);
+	}
+}
+
+//Takes every datagram waiting for the bot, dropping any that arrive behind a newer one.
+void readUdp(Bot& bot, int index)
+{
+	char datagram[MAX_DATAGRAM_SIZE];
+	UdpAddress from;
+	int received;
+	while (bot.connected && (received = udpRecvFrom(bot.udpSocket, datagram, sizeof(datagram), from)) >= 0)
+	{
+		uint32_t token, sequence;
+		MessageHeader header;
+		if (from != serverAddress || !readDatagram(datagram, received, token, sequence, header) || token != bot.udpToken)
+			continue;
+		report.datagramsIn++;
+		report.bytesIn += received;
+		if (!sequenceNewer(sequence, bot.udpRecvSequence))
+		{
+			report.datagramsStale++;
+			continue;
+		}
+		bot.udpRecvSequence = sequence;
+		handleMessage(bot, index, header, datagram + DATAGRAM_PREFIX_SIZE);
+	}
+}
+
+uint32_t nextRandom(Bot& bot)
+{
+	//xorshift32; plenty for picking keys.
+	bot.random ^= bot.random << 13;
+	bot.random ^= bot.random >> 17;
+	bot.random ^= bot.random << 5;
+	return bot.random;
+}
+
+//The keys the bot holds this frame: the script, which every bot follows from
+//a different point so they don't all turn at once, or random keys held for a
+//random time. Bots that aren't moving hold nothing.
+uint8_t nextButtons(Bot& bot)
+{
+	if (!bot.moving)
+		return 0;
+	if (!script.empty())
+	{
+		int frame = bot.scriptFrame;
+		bot.scriptFrame = (bot.scriptFrame + 1) % scriptFrames;
+		for (int i = 0; i < script.size(); i++)
+		{
+			if (frame < script[i].frames)
+				return script[i].buttons;
+			frame -= script[i].frames;
+		}
+		return 0;
+	}
+	if (--bot.holdFrames <= 0)
+	{
+		bot.buttons = (uint8_t)(nextRandom(bot) & (INPUT_UP | INPUT_DOWN | INPUT_LEFT | INPUT_RIGHT));
+		bot.holdFrames = MIN_HOLD_FRAMES + (int)(nextRandom(bot) % (MAX_HOLD_FRAMES - MIN_HOLD_FRAMES + 1));
+	}
+	return bot.buttons;
+}
+
+//One frame of the client's game loop for the bot's own dot: record the input,
+//and move the dot by it with the same code the client and server use.
+void stepBot(Bot& bot)
+{
+	int velX, velY;
+	inputVelocity(nextButtons(bot), velX, velY);
+	bot.input = bot.inputs.record(velX, velY);
+	bot.inputUs[bot.input % InputBuffer::CAPACITY] = nowUs();
+	stepDot(bot.x, bot.y, velX, velY);
+}
+
+//What the client sends at its send rate. Against an authoritative server,
+//every input it hasn't confirmed; that goes out whether the dot moved or not,
+//so it doubles as the keep-alive. Otherwise the position, once the dot has
+//moved, or the keep-alive if it hasn't for a while.
+void sendBot(Bot& bot, char* buffer, uint64_t now)
+{
+	int length;
+	if (bot.authoritative)
+	{
+		if (bot.inputs.size() == 0)
+			return;
+		uint8_t buttons[MAX_INPUTS_PER_MESSAGE];
+		int count = bot.inputs.size() < MAX_INPUTS_PER_MESSAGE ? bot.inputs.size() : MAX_INPUTS_PER_MESSAGE;
+		int first = bot.inputs.size() - count;
+		for (int i = 0; i < count; i++)
+			buttons[i] = inputButtons(bot.inputs[first + i].velX, bot.inputs[first + i].velY);
+		length = encodeInput(buffer, bot.id, bot.inputs[bot.inputs.size() - 1].sequence, buttons, count);
+		report.inputsSent++;
+	}
+	else
+	{
+		bool moved = bot.x != bot.lastSentX || bot.y != bot.lastSentY;
+		if (!moved && now - bot.lastSend < KEEPALIVE_US)
+			return;
+		bot.lastSentX = bot.x;
+		bot.lastSentY = bot.y;
+		if (bot.moving)
+			rememberPosition(bot);
+		length = encodeMove(buffer, bot.id, (int16_t)bot.x, (int16_t)bot.y, bot.input);
+		report.movesSent++;
+	}
+	bot.lastSend = now;
+	sendState(bot, buffer, length);
+}
+
+//Reads --script: comma separated steps of keys (any of U, D, L, R, or - for
+//none) and how many frames to hold them, e.g. "R:60,RD:30,-:15".
+bool parseScript(const char* text)
+{
+	script.clear();
+	scriptFrames = 0;
+	while (*text != '\0')
+	{
+		ScriptStep step;
+		step.buttons = 0;
+		for (; *text != ':' && *text != '\0'; text++)
+		{
+			if (*text == 'U') step.buttons |= INPUT_UP;
+			else if (*text == 'D') step.buttons |= INPUT_DOWN;
+			else if (*text == 'L') step.buttons |= INPUT_LEFT;
+			else if (*text == 'R') step.buttons |= INPUT_RIGHT;
+			else if (*text != '-') return false;
+		}
+		if (*text != ':')
+			return false;
+		char* after;
+		step.frames = (int)strtol(text + 1, &after, 10);
+		if (after == text + 1 || step.frames <= 0)
+			return false;
+		script.push_back(step);
+		scriptFrames += step.frames;
+		text = after;
+		if (*text == ',')
+			text++;
+	}
+	return !script.empty();
+}
+
+//CPU time process pid (0 for this one) has used so far, user and kernel, in
+//seconds. -1 if the OS won't say.
+double cpuSeconds(int pid)
+{
+#ifdef _WIN32
+	HANDLE process = pid == 0 ? GetCurrentProcess() : OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)pid);
+	if (process == NULL)
+		return -1;
+	FILETIME created, exited, kernel, user;
+	BOOL ok = GetProcessTimes(process, &created, &exited, &kernel, &user);
+	if (pid != 0)
+		CloseHandle(process);
+	if (!ok)
+		return -1;
+	ULARGE_INTEGER kernelTime, userTime;
+	kernelTime.LowPart = kernel.dwLowDateTime;
+	kernelTime.HighPart = kernel.dwHighDateTime;
+	userTime.LowPart = user.dwLowDateTime;
+	userTime.HighPart = user.dwHighDateTime;
+	return (kernelTime.QuadPart + userTime.QuadPart) / 10000000.0;	//100ns units
+#else
+	char path[64];
+	if (pid == 0)
+		snprintf(path, sizeof(path), "/proc/self/stat");
+	else
+		snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+	char line[1024];
+	size_t length = fread(line, 1, sizeof(line) - 1, file);
+	fclose(file);
+	line[length] = '\0';
+
+	//utime and stime are the 14th and 15th fields. The 2nd is the command name
+	//in brackets, which can have spaces in it, so count from its closing bracket.
+	const char* fields = strrchr(line, ')');
+	unsigned long user, system;
+	if (fields == NULL || sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &user, &system) != 2)
+		return -1;
+	return (double)(user + system) / sysconf(_SC_CLK_TCK);
+#endif
+}
+
+//CPU used between two cpuSeconds readings, as a percentage of one core.
+void printCpu(const char* name, double before, double after, uint64_t intervalUs)
+{
+	if (before < 0 || after < 0)
+		return;
+	std::cout << "  " << name << " CPU: " << (int)((after - before) * 100000000.0 / intervalUs + 0.5) << "%";
+}
+
+uint32_t percentile(const std::vector<uint32_t>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+void printLatency(const char* name, std::vector<uint32_t>& samples)
+{
+	std::sort(samples.begin(), samples.end());
+	std::cout << name << " us p50: " << percentile(samples, 0.5)
+		<< "  p90: " << percentile(samples, 0.9)
+		<< "  p99: " << percentile(samples, 0.99)
+		<< "  max: " << (samples.empty() ? 0 : samples.back())
+		<< "  (" << samples.size() << ")";
+}
+
+void printReport(uint64_t elapsedUs, uint64_t intervalUs, double serverCpu[2], double ownCpu[2])
+{
+	double seconds = intervalUs / 1000000.0;
+	//A connect only means the OS took it; a bot counts once the server has welcomed it.
+	int connected = 0;
+	int waiting = 0;
+	for (int i = 0; i < bots.size(); i++)
+	{
+		if (bots[i].welcomed)
+			connected++;
+		else if (bots[i].connected)
+			waiting++;
+	}
+
+	std::cout << "[" << elapsedUs / 1000000 << "s] clients: " << connected;
+	if (waiting > 0)
+		std::cout << " (not welcomed yet: " << waiting << ")";
+	if (report.inputsSent > 0)
+		std::cout << "  inputs/s out: " << (long long)(report.inputsSent / seconds);
+	else
+		std::cout << "  moves/s out: " << (long long)(report.movesSent / seconds);
+	std::cout << "  msgs/s in: " << (long long)(report.messagesIn / seconds)
+		<< "  KB/s in: " << (long long)(report.bytesIn / seconds / 1024)
+		<< "  B/s in per client: " << (long long)(connected > 0 ? report.bytesIn / seconds / connected : 0)
+		<< "  dropped sends: " << report.sendsDropped;
+	if (report.deltasIn > 0 || report.deltaFailures > 0)
+		std::cout << "  deltas: " << report.deltasIn << " (undecodable: " << report.deltaFailures << ")";
+	if (report.corrections > 0)
+		std::cout << "  corrections: " << report.corrections << " (mispredicted: " << report.mispredictions << ")";
+	if (report.gamesOver > 0)
+		std::cout << "  games over: " << report.gamesOver;
+	if (report.datagramsIn > 0)
+		std::cout << "  datagrams: " << report.datagramsIn << " (stale: " << report.datagramsStale << ")";
+
+	double serverNow = options.serverPid != 0 ? cpuSeconds(options.serverPid) : -1;
+	double ownNow = cpuSeconds(0);
+	std::cout << '\n';
+	printCpu("server", serverCpu[1], serverNow, intervalUs);
+	printCpu("loadgen", ownCpu[1], ownNow, intervalUs);
+	serverCpu[1] = serverNow;
+	ownCpu[1] = ownNow;
+	std::cout << "\n  ";
+	allRtts.insert(allRtts.end(), report.rtts.begin(), report.rtts.end());
+	allPositionAges.insert(allPositionAges.end(), report.positionAges.begin(), report.positionAges.end());
+	printLatency("rtt", report.rtts);
+	std::cout << "\n  ";
+	printLatency(authoritative ? "input age" : "position age", report.positionAges);
+	std::cout << '\n';
+	report = Report();
+}
+
+//Reads whatever has arrived on socket, counting the pongs. False if the connection is gone.
+bool readPongs(SocketHandle socket, FrameBuffer& frames, int& pongs)
+{
+	for (;;)
+	{
+		int received = socketRecv(socket, frames.writePtr(), frames.writeSpace());
+		if (received == SOCKET_AGAIN)
+			return true;
+		if (received <= 0)
+			return false;
+		frames.commit(received);
+
+		MessageHeader header;
+		char* message;
+		FrameBuffer::Result result;
+		while ((result = frames.next(header, message)) == FrameBuffer::FRAME_READY)
+			if (header.type == MSG_PONG)
+				pongs++;
+		if (result == FrameBuffer::FRAME_ERROR)
+			return false;
+	}
+}
+
+//--backlog-check: see the top of the file. Returns the exit code.
+int runBacklogCheck()
+{
+	SocketHandle socket = connectTcp(options.host, options.port);
+	if (socket == INVALID_SOCKET_HANDLE)
+	{
+		std::cout << "Backlog check: could not connect\n";
+		return 1;
+	}
+	FrameBuffer frames(RECEIVE_BUFFER);
+	char ping[HEADER_SIZE + 4];
+	int length = encodePing(ping, 0, 0);
+	std::vector<char> pings;
+	for (int i = 0; i < options.backlogPings; i++)
+		pings.insert(pings.end(), ping, ping + length);
+
+	//Every ping out, in as few writes as the socket allows, without reading a
+	//thing, so the pongs back up. Then read them all;
+	//the last ping waits for every other pong, so it is only sent once the
+	//backlog has cleared. Nothing moving either way for BACKLOG_STALL_US is a
+	//failure.
+	int written = 0;
+	int pongs = 0;
+	bool lastSent = false;
+	uint64_t lastProgress = nowUs();
+	while (pongs <= options.backlogPings)
+	{
+		bool progress = false;
+		while (written < (int)pings.size())
+		{
+			int result = socketSend(socket, &pings[written], (int)pings.size() - written);
+			if (result <= 0)
+				break;
+			written += result;
+			progress = true;
+		}
+		if (written == (int)pings.size() && pongs == options.backlogPings && !lastSent && socketSend(socket, ping, length) == length)
+		{
+			lastSent = true;
+			progress = true;
+		}
+
+		int before = pongs;
+		if (written == (int)pings.size() && !readPongs(socket, frames, pongs))
+		{
+			std::cout << "Backlog check FAILED: the server hung up after " << pongs << " of " << options.backlogPings + 1 << " pongs\n";
+			closeSocket(socket);
+			return 1;
+		}
+		if (progress || pongs != before)
+			lastProgress = nowUs();
+		else if (nowUs() - lastProgress > BACKLOG_STALL_US)
+		{
+			std::cout << "Backlog check FAILED: stuck at " << pongs << " of " << options.backlogPings + 1 << " pongs, "
+				<< written / length + (lastSent ? 1 : 0) << " pings sent\n";
+			closeSocket(socket);
+			return 1;
+		}
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	std::cout << "Backlog check passed: " << pongs << " pongs, the last after the backlog cleared\n";
+	closeSocket(socket);
+	return 0;
+}
+
+//Usage: LoadGen [--host H] [--port N] [--clients N] [--rate moves/s] [--ping-rate pings/s] [--duration s]
+//               [--moving fraction] [--udp 0|1] [--script keys:frames,...] [--seed N] [--server-pid N]
+//               [--backlog-check pings]
+//--rate is the client's send rate: positions (or inputs) per second, each covering several 60Hz frames.
+void parseOptions(int argc, char ** argv)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const char* value = argv[i + 1];
+		if (strcmp(argv[i], "--host") == 0) options.host = value;
+		else if (strcmp(argv[i], "--port") == 0) options.port = (uint16_t)atoi(value);
+		else if (strcmp(argv[i], "--clients") == 0) options.clients = atoi(value);
+		else if (strcmp(argv[i], "--rate") == 0) options.moveRate = atof(value);
+		else if (strcmp(argv[i], "--ping-rate") == 0) options.pingRate = atof(value);
+		else if (strcmp(argv[i], "--duration") == 0) options.duration = atoi(value);
+		else if (strcmp(argv[i], "--moving") == 0) options.moving = atof(value);
+		else if (strcmp(argv[i], "--udp") == 0) options.udp = atoi(value) != 0;
+		else if (strcmp(argv[i], "--script") == 0) options.script = value;
+		else if (strcmp(argv[i], "--seed") == 0) options.seed = (uint32_t)strtoul(value, NULL, 10);
+		else if (strcmp(argv[i], "--server-pid") == 0) options.serverPid = atoi(value);
+		else if (strcmp(argv[i], "--backlog-check") == 0) options.backlogPings = atoi(value);
+		else std::cout << "Unknown option: " << argv[i] << '\n';
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	parseOptions(argc, argv);
+	if (options.script != NULL && !parseScript(options.script))
+	{
+		std::cout << "Could not read the script; expected keys:frames,... e.g. R:60,RD:30,-:15\n";
+		return 1;
+	}
+	if (options.serverPid != 0 && cpuSeconds(options.serverPid) < 0)
+		std::cout << "Can't read the CPU time of process " << options.serverPid << "; server CPU won't be reported\n";
+	std::signal(SIGINT, stop);
+	if (!socketStartup() || !poller.open())
+	{
+		std::cout << "Could not start networking\n";
+		return 1;
+	}
+	if (options.backlogPings > 0)
+		return runBacklogCheck();
+	int fileLimit = raiseFileLimit();
+	if (fileLimit > 0 && fileLimit < options.clients + 16)
+		std::cout << "Open file limit is " << fileLimit << "; not every client will connect\n";
+
+	if (!resolveUdp(options.host, options.port, serverAddress))
+		options.udp = false;
+
+	uint64_t moveInterval = options.moveRate > 0 ? (uint64_t)(1000000 / options.moveRate) : 0;
+	uint64_t pingInterval = options.pingRate > 0 ? (uint64_t)(1000000 / options.pingRate) : 0;
+
+	//Connect everyone up front. Each bot's timers are offset so the load is
+	//spread evenly instead of arriving in one burst per interval.
+	bots.resize(options.clients);
+	uint64_t connectStart = nowUs();
+	for (int i = 0; i < bots.size() && running; i++)
+	{
+		Bot& bot = bots[i];
+		if (!joinBot(bot, i))
+		{
+			std::cout << "Connect failed after " << i << " clients\n";
+			break;
+		}
+		bot.moving = (int)((i + 1) * options.moving) > (int)(i * options.moving); //spread the movers evenly
+		bot.random = (options.seed + i) * 2654435761u | 1;	//never 0, which xorshift can't leave
+		bot.scriptFrame = scriptFrames > 0 ? (int)((long long)i * 7919 % scriptFrames) : 0;
+		bot.nextStep = STEP_US * i / bots.size();
+		bot.nextMove = moveInterval * i / bots.size();
+		bot.nextPing = pingInterval * i / bots.size();
+	}
+	std::cout << "Connected in " << (nowUs() - connectStart) / 1000 << " ms\n";
+
+	char buffer[MAX_MESSAGE_SIZE];
+	PollEvent events[MAX_EVENTS];
+	uint64_t start = nowUs();
+	uint64_t lastReport = start;
+	uint64_t end = start + (uint64_t)options.duration * 1000000;
+	for (int i = 0; i < bots.size(); i++)
+	{
+		bots[i].nextStep += start;
+		bots[i].nextMove += start;
+		bots[i].nextPing += start;
+	}
+	//[0] at the start, [1] at the last report.
+	double serverCpu[2] = { options.serverPid != 0 ? cpuSeconds(options.serverPid) : -1, 0 };
+	double ownCpu[2] = { cpuSeconds(0), 0 };
+	serverCpu[1] = serverCpu[0];
+	ownCpu[1] = ownCpu[0];
+
+	while (running && (options.duration == 0 || nowUs() < end))
+	{
+		int count = poller.wait(events, MAX_EVENTS, 1);
+		for (int e = 0; e < count; e++)
+		{
+			uintptr_t key = (uintptr_t)events[e].key;
+			int index = (int)(key / 2);
+			Bot& bot = bots[index];
+			if (key & 1)
+			{
+				if (events[e].readable)
+					readUdp(bot, index);
+				continue;
+			}
+			if (events[e].readable)
+				readFrom(bot, index);
+			if (events[e].hangup)
+				closeBot(bot);
+		}
+
+		uint64_t now = nowUs();
+		for (int i = 0; i < bots.size(); i++)
+		{
+			Bot& bot = bots[i];
+			if (bot.rejoin)
+			{
+				closeSockets(bot);
+				if (!joinBot(bot, i))
+					disconnects++;
+			}
+			if (!bot.connected)
+				continue;
+			while (now >= bot.nextStep)
+			{
+				if (bot.playing)
+					stepBot(bot);
+				bot.nextStep += STEP_US;
+			}
+			if (moveInterval > 0 && now >= bot.nextMove)
+			{
+				if (bot.playing)
+					sendBot(bot, buffer, now);
+				bot.nextMove += moveInterval;
+			}
+			if (pingInterval > 0 && now >= bot.nextPing && bot.connected)
+			{
+				int length = encodePing(buffer, bot.id, (uint32_t)now);
+				sendFrom(bot, buffer, length);
+				report.pingsSent++;
+				bot.nextPing += pingInterval;
+			}
+		}
+
+		if (now - lastReport >= REPORT_MS * 1000)
+		{
+			printReport(now - start, now - lastReport, serverCpu, ownCpu);
+			lastReport = now;
+		}
+	}
+
+	allRtts.insert(allRtts.end(), report.rtts.begin(), report.rtts.end());
+	allPositionAges.insert(allPositionAges.end(), report.positionAges.begin(), report.positionAges.end());
+	uint64_t runUs = nowUs() - start;
+	std::cout << "Overall: ";
+	printLatency("rtt", allRtts);
+	std::cout << "\n         ";
+	printLatency(authoritative ? "input age" : "position age", allPositionAges);
+	std::cout << "\n       ";
+	printCpu("server", serverCpu[0], options.serverPid != 0 ? cpuSeconds(options.serverPid) : -1, runUs);
+	printCpu("loadgen", ownCpu[0], cpuSeconds(0), runUs);
+	std::cout << "\nServer disconnects: " << disconnects << '\n';
+
+	for (int i = 0; i < bots.size(); i++)
+	{
+		if (bots[i].connected)
+			closeBot(bots[i]);
+		delete bots[i].history;
+	}
+	socketCleanup();
+	return 0;
+}
@@ -0,0 +1,623 @@
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <random>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+
+#include "Socket.h"
+#include "Poller.h"
+
+//Network conditions emulator.
+//A proxy for one machine: clients connect to it instead of the server, and it
+//passes everything on over a link as bad as you ask for, in both directions,
+//for TCP and UDP alike. Used to see what latency, jitter, loss, reordering and
+//a slow line do to the game without leaving loopback:
+//
+//  NetEmu --listen 1235 --target 127.0.0.1:1234 --latency 50 --jitter 10 --loss 2
+//  Del --host 127.0.0.1 --port 1235
+//  LoadGen --port 1235 --clients 300
+//
+//The game's UDP channel uses the same port number as its TCP connection, and
+//so does the proxy. Each client gets its own UDP socket towards the server, so
+//the server still sees one address per client.
+//
+//Lab1's UDP pair works too; playerB sends to the port on its command line:
+//
+//  NetEmu --listen 28100 --target 127.0.0.1:28000 --no-tcp --latency 100 --reorder 10
+//  Lab1 28100
+//
+//Every delay applies to each direction separately, so --latency 50 is a 100ms
+//round trip. Loss means different things to the two protocols. A lost
+//datagram is gone. TCP can't lose bytes, it resends them, so a "lost" chunk
+//of a TCP stream arrives a retransmission timeout late and everything sent
+//after it waits behind it: the head-of-line blocking a real lossy link causes.
+
+const int MAX_EVENTS = 256;
+const int CHUNK_SIZE = 16 * 1024;			//most read from a TCP socket in one go
+const int MAX_DATAGRAM = 64 * 1024;
+const uint64_t REPORT_US = 5000000;
+const uint64_t MAX_BACKLOG_US = 500000;		//queued behind the bandwidth cap; UDP past this is dropped, TCP stops being read
+const uint64_t TCP_MIN_RTO_US = 200000;		//Linux's minimum retransmission timeout
+const uint64_t MIN_REORDER_US = 20000;		//how far a reordered datagram is held back, at least
+const uint64_t UDP_IDLE_US = 60000000;		//forget a UDP client after this long without a datagram
+
+struct Options{
+	uint16_t listenPort;
+	const char* targetHost;
+	uint16_t targetPort;
+	double latencyMs;	//one way
+	double jitterMs;	//each delay is latency plus or minus up to this much
+	double lossPercent;
+	double reorderPercent;	//UDP: datagrams held back so later ones overtake them
+	double bandwidthKbit;	//per direction per client; 0 = unlimited
+	bool tcp;
+	bool udp;
+	uint32_t seed;
+	Options():listenPort(1235), targetHost("127.0.0.1"), targetPort(1234), latencyMs(0), jitterMs(0), lossPercent(0), reorderPercent(0), bandwidthKbit(0),
+		tcp(true), udp(true), seed(1) {}
+};
+
+//One direction of one client's connection: the emulated wire.
+struct Link{
+	uint64_t wireFree;		//when the bandwidth cap lets the next byte out
+	uint64_t lastDelivery;	//TCP: nothing may overtake this
+	Link():wireFree(0), lastDelivery(0) {}
+};
+
+//A TCP client and our connection on to the server for it.
+struct TcpFlow{
+	uint32_t id;
+	SocketHandle client;
+	SocketHandle server;
+	Link up;				//client to server
+	Link down;
+	std::vector<char> toClient;	//delivered but not yet taken by the socket
+	std::vector<char> toServer;
+	bool clientPaused;		//not read while up is backed up
+	bool serverPaused;
+	bool clientDone;		//hung up; nothing more to read
+	bool serverDone;
+};
+
+//A UDP client, known by its address, and the socket we talk to the server through for it.
+struct UdpFlow{
+	uint32_t id;
+	UdpAddress client;
+	SocketHandle upstream;
+	Link up;
+	Link down;
+	uint64_t lastHeard;
+};
+
+//Bytes on their way through a link, due out at due.
+struct Delivery{
+	uint64_t due;
+	uint64_t order;		//ties go to whatever was sent first, so TCP stays in order
+	uint32_t flow;
+	bool udp;
+	bool toServer;
+	bool close;			//TCP: the sender hung up once this far into the stream
+	std::vector<char> data;
+};
+
+struct LaterFirst{
+	bool operator()(const Delivery& a, const Delivery& b) const { return a.due != b.due ? a.due > b.due : a.order > b.order; }
+};
+
+//Counters for one report interval, per direction.
+struct Report{
+	long long packets[2];	//[0] client to server, [1] back
+	long long bytes[2];
+	long long lost[2];		//UDP dropped, TCP chunks resent
+	long long reordered[2];
+	long long overflowed[2];	//UDP dropped because the bandwidth queue was full
+	Report() { memset(this, 0, sizeof(*this)); }
+};
+
+//Poller keys: what kind of socket, and which flow it belongs to.
+enum SocketKind{
+	KEY_TCP_LISTENER,
+	KEY_UDP_LISTENER,
+	KEY_TCP_CLIENT,
+	KEY_TCP_SERVER,
+	KEY_UDP_UPSTREAM
+};
+
+Options options;
+Poller poller;
+std::mt19937 randomness;
+std::priority_queue<Delivery, std::vector<Delivery>, LaterFirst> inFlight;
+std::unordered_map<uint32_t, TcpFlow*> tcpFlows;
+std::unordered_map<uint32_t, UdpFlow*> udpFlows;
+std::vector<TcpFlow*> pausedFlows;
+SocketHandle udpListener = INVALID_SOCKET_HANDLE;
+UdpAddress target;
+uint32_t nextFlowID = 1;
+uint64_t nextOrder = 0;
+Report report;
+volatile std::sig_atomic_t running = 1;
+
+uint64_t nowUs()
+{
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void stop(int)
+{
+	running = 0;
+}
+
+void* keyFor(SocketKind kind, uint32_t flow)
+{
+	return (void*)(((uintptr_t)flow << 3) | kind);
+}
+
+bool chance(double percent)
+{
+	return percent > 0 && std::uniform_real_distribution<double>(0, 100)(randomness) < percent;
+}
+
+//One trip along the link: latency, give or take the jitter.
+uint64_t travelUs()
+{
+	double ms = options.latencyMs;
+	if (options.jitterMs > 0)
+		ms += std::uniform_real_distribution<double>(-options.jitterMs, options.jitterMs)(randomness);
+	return ms > 0 ? (uint64_t)(ms * 1000) : 0;
+}
+
+//When the last of size bytes handed to the link at now has gone out onto the
+//wire, queueing behind whatever the bandwidth cap is still holding.
+uint64_t serialise(Link& link, int size, uint64_t now)
+{
+	if (options.bandwidthKbit <= 0)
+		return now;
+	uint64_t start = link.wireFree > now ? link.wireFree : now;
+	link.wireFree = start + (uint64_t)(size * 8 * 1000.0 / options.bandwidthKbit);
+	return link.wireFree;
+}
+
+void schedule(uint64_t due, uint32_t flow, bool udp, bool toServer, bool close, const char* data, int size)
+{
+	Delivery delivery;
+	delivery.due = due;
+	delivery.order = nextOrder++;
+	delivery.flow = flow;
+	delivery.udp = udp;
+	delivery.toServer = toServer;
+	delivery.close = close;
+	delivery.data.assign(data, data + size);
+	inFlight.push(delivery);
+}
+
+//A TCP chunk onto the link. It arrives in order, after everything before it;
+//if it is "lost" it arrives a retransmission timeout late, and so does
+//everything queued behind it.
+void sendTcp(TcpFlow* flow, bool toServer, const char* data, int size, bool close, uint64_t now)
+{
+	Link& link = toServer ? flow->up : flow->down;
+	uint64_t due = serialise(link, size, now) + travelUs();
+	if (!close && chance(options.lossPercent))
+	{
+		uint64_t timeout = (uint64_t)(options.latencyMs * 2000 + options.jitterMs * 4000);
+		due += (timeout > TCP_MIN_RTO_US ? timeout : TCP_MIN_RTO_US) + travelUs();
+		report.lost[toServer ? 0 : 1]++;
+	}
+	if (due < link.lastDelivery)
+		due = link.lastDelivery;
+	link.lastDelivery = due;
+	schedule(due, flow->id, false, toServer, close, data, size);
+	if (!close)
+	{
+		report.packets[toServer ? 0 : 1]++;
+		report.bytes[toServer ? 0 : 1] += size;
+	}
+}
+
+//A datagram onto the link: maybe lost, maybe held back to arrive out of
+//order, dropped if the bandwidth queue is already full.
+void sendUdp(UdpFlow* flow, bool toServer, const char* data, int size, uint64_t now)
+{
+	Link& link = toServer ? flow->up : flow->down;
+	int direction = toServer ? 0 : 1;
+	if (chance(options.lossPercent))
+	{
+		report.lost[direction]++;
+		return;
+	}
+	if (options.bandwidthKbit > 0 && link.wireFree > now + MAX_BACKLOG_US)
+	{
+		report.overflowed[direction]++;
+		return;
+	}
+	uint64_t due = serialise(link, size, now) + travelUs();
+	if (chance(options.reorderPercent))
+	{
+		uint64_t hold = (uint64_t)(options.jitterMs * 2000);
+		due += hold > MIN_REORDER_US ? hold : MIN_REORDER_US;
+		report.reordered[direction]++;
+	}
+	schedule(due, flow->id, true, toServer, false, data, size);
+	report.packets[direction]++;
+	report.bytes[direction] += size;
+}
+
+void closeTcpFlow(TcpFlow* flow)
+{
+	poller.remove(flow->client);
+	poller.remove(flow->server);
+	closeSocket(flow->client);
+	closeSocket(flow->server);
+	tcpFlows.erase(flow->id);
+	for (size_t i = 0; i < pausedFlows.size(); i++)
+		if (pausedFlows[i] == flow)
+			pausedFlows[i] = NULL;
+	delete flow;
+}
+
+//Reads everything the socket has, onto the link towards the other end. Stops
+//early if the link is backed up behind the bandwidth cap, like a full router
+//queue would stop the sender's window growing; pausedFlows picks it up again.
+void readTcp(TcpFlow* flow, bool fromClient)
+{
+	static char chunk[CHUNK_SIZE];
+	SocketHandle socket = fromClient ? flow->client : flow->server;
+	Link& link = fromClient ? flow->up : flow->down;
+	bool& paused = fromClient ? flow->clientPaused : flow->serverPaused;
+	bool& done = fromClient ? flow->clientDone : flow->serverDone;
+	while (!done)
+	{
+		uint64_t now = nowUs();
+		if (options.bandwidthKbit > 0 && link.wireFree > now + MAX_BACKLOG_US)
+		{
+			if (!paused)
+				pausedFlows.push_back(flow);
+			paused = true;
+			return;
+		}
+		paused = false;
+		int received = socketRecv(socket, chunk, sizeof(chunk));
+		if (received == SOCKET_AGAIN)
+			return;
+		if (received <= 0)
+		{//Hung up. The other end finds out once everything sent before it has arrived.
+			sendTcp(flow, fromClient, NULL, 0, true, now);
+			done = true;
+			return;
+		}
+		sendTcp(flow, fromClient, chunk, received, false, now);
+	}
+}
+
+//Writes as much of pending as the socket takes. Returns false if the connection broke.
+bool flushTcp(SocketHandle socket, void* key, std::vector<char>& pending)
+{
+	int written = 0;
+	while (written < (int)pending.size())
+	{
+		int sent = socketSend(socket, &pending[written], (int)pending.size() - written);
+		if (sent == SOCKET_AGAIN)
+			break;
+		if (sent == SOCKET_FAILED)
+			return false;
+		written += sent;
+	}
+	pending.erase(pending.begin(), pending.begin() + written);
+	poller.setWritable(socket, key, !pending.empty());
+	return true;
+}
+
+void acceptClients(SocketHandle listener)
+{
+	SocketHandle client;
+	while ((client = acceptTcp(listener)) != INVALID_SOCKET_HANDLE)
+	{
+		SocketHandle server = connectTcp(options.targetHost, options.targetPort);
+		if (server == INVALID_SOCKET_HANDLE)
+		{
+			std::cout << "Could not reach " << options.targetHost << ':' << options.targetPort << '\n';
+			closeSocket(client);
+			continue;
+		}
+		TcpFlow* flow = new TcpFlow();
+		flow->id = nextFlowID++;
+		flow->client = client;
+		flow->server = server;
+		flow->clientPaused = false;
+		flow->serverPaused = false;
+		flow->clientDone = false;
+		flow->serverDone = false;
+		tcpFlows[flow->id] = flow;
+		poller.add(client, keyFor(KEY_TCP_CLIENT, flow->id));
+		poller.add(server, keyFor(KEY_TCP_SERVER, flow->id));
+	}
+}
+
+UdpFlow* udpFlowFor(const UdpAddress& client, uint64_t now)
+{
+	for (std::unordered_map<uint32_t, UdpFlow*>::iterator i = udpFlows.begin(); i != udpFlows.end(); ++i)
+		if (i->second->client == client)
+			return i->second;
+
+	SocketHandle upstream = openUdp(0);
+	if (upstream == INVALID_SOCKET_HANDLE)
+		return NULL;
+	UdpFlow* flow = new UdpFlow();
+	flow->id = nextFlowID++;
+	flow->client = client;
+	flow->upstream = upstream;
+	flow->lastHeard = now;
+	udpFlows[flow->id] = flow;
+	poller.add(upstream, keyFor(KEY_UDP_UPSTREAM, flow->id));
+	return flow;
+}
+
+void readUdpListener()
+{
+	static char datagram[MAX_DATAGRAM];
+	UdpAddress from;
+	int received;
+	while ((received = udpRecvFrom(udpListener, datagram, sizeof(datagram), from)) >= 0)
+	{
+		uint64_t now = nowUs();
+		UdpFlow* flow = udpFlowFor(from, now);
+		if (flow == NULL)
+			continue;
+		flow->lastHeard = now;
+		sendUdp(flow, true, datagram, received, now);
+	}
+}
+
+void readUdpUpstream(UdpFlow* flow)
+{
+	static char datagram[MAX_DATAGRAM];
+	UdpAddress from;
+	int received;
+	while ((received = udpRecvFrom(flow->upstream, datagram, sizeof(datagram), from)) >= 0)
+		if (from == target)
+			sendUdp(flow, false, datagram, received, nowUs());
+}
+
+//Hands over everything that has made it to the far end of its link by now.
+void deliverDue(uint64_t now)
+{
+	while (!inFlight.empty() && inFlight.top().due <= now)
+	{
+		const Delivery& delivery = inFlight.top();
+		if (delivery.udp)
+		{
+			std::unordered_map<uint32_t, UdpFlow*>::iterator found = udpFlows.find(delivery.flow);
+			if (found != udpFlows.end())
+			{
+				UdpFlow* flow = found->second;
+				if (delivery.toServer)
+					udpSendTo(flow->upstream, &delivery.data[0], (int)delivery.data.size(), target);
+				else
+					udpSendTo(udpListener, &delivery.data[0], (int)delivery.data.size(), flow->client);
+			}
+		}
+		else
+		{
+			std::unordered_map<uint32_t, TcpFlow*>::iterator found = tcpFlows.find(delivery.flow);
+			if (found != tcpFlows.end())
+			{
+				TcpFlow* flow = found->second;
+				if (delivery.close)
+					closeTcpFlow(flow);
+				else
+				{
+					SocketHandle socket = delivery.toServer ? flow->server : flow->client;
+					void* key = keyFor(delivery.toServer ? KEY_TCP_SERVER : KEY_TCP_CLIENT, flow->id);
+					std::vector<char>& pending = delivery.toServer ? flow->toServer : flow->toClient;
+					pending.insert(pending.end(), delivery.data.begin(), delivery.data.end());
+					if (!flushTcp(socket, key, pending))
+						closeTcpFlow(flow);
+				}
+			}
+		}
+		inFlight.pop();
+	}
+}
+
+//Reads again from the flows that were paused for bandwidth, now that some of it has drained.
+void resumePaused()
+{
+	std::vector<TcpFlow*> paused;
+	paused.swap(pausedFlows);
+	for (size_t i = 0; i < paused.size(); i++)
+	{
+		TcpFlow* flow = paused[i];
+		if (flow == NULL)
+			continue;
+		if (flow->clientPaused)
+			readTcp(flow, true);
+		if (flow->serverPaused)
+			readTcp(flow, false);
+	}
+}
+
+void expireUdpFlows(uint64_t now)
+{
+	for (std::unordered_map<uint32_t, UdpFlow*>::iterator i = udpFlows.begin(); i != udpFlows.end();)
+	{
+		UdpFlow* flow = i->second;
+		if (now - flow->lastHeard > UDP_IDLE_US)
+		{
+			poller.remove(flow->upstream);
+			closeSocket(flow->upstream);
+			delete flow;
+			i = udpFlows.erase(i);
+		}
+		else
+			++i;
+	}
+}
+
+void printReport(uint64_t intervalUs)
+{
+	double seconds = intervalUs / 1000000.0;
+	const char* names[2] = { "to server", "to client" };
+	std::cout << "TCP clients: " << tcpFlows.size() << "  UDP clients: " << udpFlows.size() << "  in flight: " << inFlight.size() << '\n';
+	for (int d = 0; d < 2; d++)
+	{
+		std::cout << "  " << names[d] << ": " << (long long)(report.packets[d] / seconds) << " packets/s  "
+			<< (long long)(report.bytes[d] * 8 / seconds / 1000) << " kbit/s  lost: " << report.lost[d]
+			<< "  reordered: " << report.reordered[d] << "  queue full: " << report.overflowed[d] << '\n';
+	}
+	report = Report();
+}
+
+//Usage: NetEmu [--listen PORT] [--target HOST:PORT] [--latency ms] [--jitter ms] [--loss %]
+//              [--reorder %] [--bandwidth kbit/s] [--no-tcp] [--no-udp] [--seed N]
+void parseOptions(int argc, char ** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char* value = i + 1 < argc ? argv[i + 1] : "0";
+		if (strcmp(argv[i], "--listen") == 0) { options.listenPort = (uint16_t)atoi(value); i++; }
+		else if (strcmp(argv[i], "--target") == 0)
+		{
+			static std::string host;
+			host = value;
+			size_t colon = host.rfind(':');
+			if (colon != std::string::npos)
+			{
+				options.targetPort = (uint16_t)atoi(host.c_str() + colon + 1);
+				host.resize(colon);
+			}
+			options.targetHost = host.c_str();
+			i++;
+		}
+		else if (strcmp(argv[i], "--latency") == 0) { options.latencyMs = atof(value); i++; }
+		else if (strcmp(argv[i], "--jitter") == 0) { options.jitterMs = atof(value); i++; }
+		else if (strcmp(argv[i], "--loss") == 0) { options.lossPercent = atof(value); i++; }
+		else if (strcmp(argv[i], "--reorder") == 0) { options.reorderPercent = atof(value); i++; }
+		else if (strcmp(argv[i], "--bandwidth") == 0) { options.bandwidthKbit = atof(value); i++; }
+		else if (strcmp(argv[i], "--seed") == 0) { options.seed = (uint32_t)strtoul(value, NULL, 10); i++; }
+		else if (strcmp(argv[i], "--no-tcp") == 0) options.tcp = false;
+		else if (strcmp(argv[i], "--no-udp") == 0) options.udp = false;
+		else std::cout << "Unknown option: " << argv[i] << '\n';
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	parseOptions(argc, argv);
+	std::signal(SIGINT, stop);
+	randomness.seed(options.seed);
+	if (!socketStartup() || !poller.open())
+	{
+		std::cout << "Could not start networking\n";
+		return 1;
+	}
+	raiseFileLimit();
+	if (!resolveUdp(options.targetHost, options.targetPort, target))
+	{
+		std::cout << "Could not resolve " << options.targetHost << '\n';
+		return 1;
+	}
+
+	SocketHandle tcpListener = INVALID_SOCKET_HANDLE;
+	if (options.tcp)
+	{
+		tcpListener = listenTcp(options.listenPort);
+		if (tcpListener == INVALID_SOCKET_HANDLE)
+		{
+			std::cout << "Could not listen on TCP port " << options.listenPort << '\n';
+			return 1;
+		}
+		poller.add(tcpListener, keyFor(KEY_TCP_LISTENER, 0));
+	}
+	if (options.udp)
+	{
+		udpListener = openUdp(options.listenPort);
+		if (udpListener == INVALID_SOCKET_HANDLE)
+		{
+			std::cout << "Could not open UDP port " << options.listenPort << '\n';
+			return 1;
+		}
+		poller.add(udpListener, keyFor(KEY_UDP_LISTENER, 0));
+	}
+	std::cout << "Forwarding port " << options.listenPort << " to " << options.targetHost << ':' << options.targetPort
+		<< ": latency " << options.latencyMs << "ms +/- " << options.jitterMs << "ms, loss " << options.lossPercent
+		<< "%, reorder " << options.reorderPercent << "%, bandwidth " << (options.bandwidthKbit > 0 ? options.bandwidthKbit : 0) << " kbit/s each way\n";
+
+	PollEvent events[MAX_EVENTS];
+	uint64_t lastReport = nowUs();
+	while (running)
+	{
+		//Sleep until the next delivery is due, or something arrives.
+		uint64_t now = nowUs();
+		int timeout = 100;
+		if (!inFlight.empty())
+		{
+			uint64_t wait = inFlight.top().due > now ? inFlight.top().due - now : 0;
+			timeout = wait < 100000 ? (int)((wait + 999) / 1000) : 100;
+		}
+		if (!pausedFlows.empty() && timeout > 1)
+			timeout = 1;
+		int count = poller.wait(events, MAX_EVENTS, timeout);
+
+		for (int e = 0; e < count; e++)
+		{
+			uintptr_t key = (uintptr_t)events[e].key;
+			SocketKind kind = (SocketKind)(key & 7);
+			uint32_t id = (uint32_t)(key >> 3);
+			if (kind == KEY_TCP_LISTENER)
+				acceptClients(tcpListener);
+			else if (kind == KEY_UDP_LISTENER)
+				readUdpListener();
+			else if (kind == KEY_UDP_UPSTREAM)
+			{
+				std::unordered_map<uint32_t, UdpFlow*>::iterator found = udpFlows.find(id);
+				if (found != udpFlows.end())
+					readUdpUpstream(found->second);
+			}
+			else
+			{
+				std::unordered_map<uint32_t, TcpFlow*>::iterator found = tcpFlows.find(id);
+				if (found == tcpFlows.end())
+					continue;
+				TcpFlow* flow = found->second;
+				bool fromClient = kind == KEY_TCP_CLIENT;
+				if (events[e].readable || events[e].hangup)
+					readTcp(flow, fromClient);
+				if (events[e].writable)
+				{
+					SocketHandle socket = fromClient ? flow->client : flow->server;
+					if (!flushTcp(socket, events[e].key, fromClient ? flow->toClient : flow->toServer))
+						closeTcpFlow(flow);
+				}
+			}
+		}
+
+		now = nowUs();
+		deliverDue(now);
+		resumePaused();
+		if (now - lastReport >= REPORT_US)
+		{
+			printReport(now - lastReport);
+			expireUdpFlows(now);
+			lastReport = now;
+		}
+	}
+
+	while (!tcpFlows.empty())
+		closeTcpFlow(tcpFlows.begin()->second);
+	for (std::unordered_map<uint32_t, UdpFlow*>::iterator i = udpFlows.begin(); i != udpFlows.end(); ++i)
+	{
+		closeSocket(i->second->upstream);
+		delete i->second;
+	}
+	if (tcpListener != INVALID_SOCKET_HANDLE)
+		closeSocket(tcpListener);
+	if (udpListener != INVALID_SOCKET_HANDLE)
+		closeSocket(udpListener);
+	socketCleanup();
+	return 0;
+}
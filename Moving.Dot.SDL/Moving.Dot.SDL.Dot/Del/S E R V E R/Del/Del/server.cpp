@@ -1,161 +1,1485 @@
-#include <SDL.h>
-#include <SDL_net.h>
-#include <iostream>
+#include <cstdio>
 #include <vector>
+#include <chrono>
+#include <csignal>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <unordered_map>
 
+#include "Protocol.h"
+#include "FrameBuffer.h"
+#include "Socket.h"
+#include "Poller.h"
+#include "TimerWheel.h"
+#include "SlotMap.h"
+#include "InterestGrid.h"
+#include "DeltaSnapshot.h"
+#include "Prediction.h"
+#include "Simulation.h"
+#include "Collision.h"
+#include "Log.h"
+#include "Recording.h"
 
-//#define SDL_reinterpret_cast(type, expression)  reinterpret_cast<type>(expression)
+const uint16_t DEFAULT_PORT = 1234;
+const int DEFAULT_MAX_PLAYERS = 20000;
+const int DEFAULT_MATCH_SIZE = 3; // the client is built around three dots
+const uint32_t TIMEOUT_MS = 120000; // drop a player after this long without hearing from them
+const uint32_t HEARTBEAT_MS = 15000; // ping a player we haven't sent anything to for this long
+const uint32_t TIMER_RESOLUTION_MS = 5;
+const uint32_t STATS_MS = 5000;
+const uint32_t DEFAULT_FAR_MS = 500; // how often players hear about dots outside their relevance radius
+const int MAX_OUTBOUND = 256 * 1024; // bytes queued for a client that isn't reading before we give up on it
+const int MAX_EVENTS = 256;
+const int RESERVED_FILES = 16; // open files kept back from players: listener, UDP, epoll, logs, a recording, and one to accept and turn away with
+const int RECEIVE_BUFFER = 2 * MAX_MESSAGE_SIZE; // per player; players only send small messages, and there may be thousands of them
+const uint32_t JITTER_FRAMES = 15; // moves may bunch up this many frames on the way in
+const uint32_t CORRECTION_RESEND_MS = 500; // repeat a correction the client doesn't seem to have taken
+const int DEFAULT_AUTHORITATIVE_TICK = 30; // snapshot rate in authoritative mode if no tick rate is given
+const int INPUT_WINDOW = 32; // inputs held per player ahead of the simulation; power of two
+const int MAX_CATCHUP_FRAMES = 5; // after a stall, simulate at most this many frames at once and drop the rest
+const SlotHandle UDP_KEY = 1; // poller key for the UDP socket; generation 0 is never handed out, so no player has it
+
+struct Match;
+
+// One frame's keys from a player, waiting for the simulation to reach it.
+struct PendingInput{
+	uint32_t sequence; // 0 = empty
+	uint8_t buttons;
+};
 
 struct data{
-	TCPsocket socket;
-	Uint32 timeout;
-	int id; // player/client ID
-	data(TCPsocket sock, Uint32 t, int i):socket(sock), timeout(t), id(i) {}
+	SocketHandle socket;
+	uint32_t timeout;
+	SlotHandle id; // handle in the connection table; stale once the player has gone
+	int slot; // player number inside the match (1 = runner); this is the ID the client sees
+	Match* match;
+	FrameBuffer frames; // bytes received but not yet handled
+	std::vector<char> outbound; // bytes the socket would not take yet
+	bool wantWrite; // poller is watching for writability
+	bool closing; // dropped during this wakeup; freed once every event has been handled
+	int16_t x, y; // last position reported by this player
+	int16_t frameX, frameY; // authoritative mode: where the dot was when the current frame began
+	bool placed; // x, y hold a real position
+	uint32_t lastInput; // input sequence of the move that put them at x, y (0 if they don't number them)
+	uint32_t lastMoveTime; // when we took that move
+	bool correcting; // sent a MSG_CORRECTION and waiting for their moves to follow it
+	uint32_t correctionSent;
+	bool dirty; // position changed since the last tick's snapshot
+	bool farDirty; // position changed since the last far update
+	uint32_t lastSent; // when we last queued anything for them
+	SnapshotHistory* history; // what we sent them each recent tick; only in delta mode
+	uint32_t ackedTick; // newest MSG_DELTA they have confirmed, or NO_BASELINE
+	uint32_t udpToken; // sent to them in MSG_CHANNEL; every datagram they send carries it
+	bool udpBound; // we have heard from them over UDP, so positions go that way
+	UdpAddress udpAddress; // where their last good datagram came from
+	uint32_t udpSendSequence; // last sequence number we sent them
+	uint32_t udpRecvSequence; // newest sequence number we have taken from them
+	PendingInput pending[INPUT_WINDOW]; // authoritative mode: inputs received, by sequence % INPUT_WINDOW
+	uint32_t newestInput; // newest input sequence they have sent (0 = none yet); lastInput is the newest applied
+	uint8_t buttons; // keys held in the last input applied
+	int inputBudget; // inputs they may still have applied; one more per frame, so nobody runs faster than the clock
+	uint32_t reportedInput; // lastInput as of the last MSG_CORRECTION we sent them
+	Timer idleTimer;
+	Timer heartbeatTimer;
+	data(SocketHandle sock, uint32_t t):socket(sock), timeout(t), id(INVALID_SLOT_HANDLE), slot(0), match(NULL), frames(RECEIVE_BUFFER), wantWrite(false), closing(false), x(0), y(0), frameX(0), frameY(0), placed(false), lastInput(0), lastMoveTime(t), correcting(false), correctionSent(0), dirty(false), farDirty(false), lastSent(t), history(NULL), ackedTick(NO_BASELINE), udpToken(0), udpBound(false), udpSendSequence(0), udpRecvSequence(0), newestInput(0), buttons(0), inputBudget(0), reportedInput(0) { memset(pending, 0, sizeof(pending)); }
+	~data() { delete history; }
 };
 
-int main (int argc, char ** argv)
+// One game. Players only ever hear about the other players in their own match.
+struct Match{
+	int id;
+	std::vector<data*> players; // indexed by slot - 1; NULL while a slot is empty
+	int playerCount;
+	bool started;
+	int index; // position in matches
+	InterestGrid grid; // where each slot's dot is, once they've moved (ID = slot - 1)
+	int frames; // authoritative mode: frames simulated since the start
+	Match(int i, int size):id(i), players(size, (data*)NULL), playerCount(0), started(false), index(-1), frames(0) {}
+};
+
+struct Options{
+	uint16_t port;
+	int tickRate; // 0 = relay every move as it arrives
+	int maxPlayers;
+	int matchSize;
+	int aoiRadius; // 0 = everyone in a match hears about everyone
+	uint32_t farMs;
+	bool delta; // tick mode only: send MSG_DELTAs against what each client has acknowledged
+	bool udp; // offer clients a UDP channel for positions
+	bool authoritative; // we move the dots from players' inputs and decide who wins; MSG_MOVE and MSG_GAMEOVER from them are ignored
+	LogLevel logLevel;
+	const char* logFile; // NULL = stdout
+	const char* recordFile; // write every message in and out here
+	const char* replayFile; // play this recording back instead of listening
+	int sendBuffer; // bytes; 0 = the OS default
+	Options():port(DEFAULT_PORT), tickRate(0), maxPlayers(DEFAULT_MAX_PLAYERS), matchSize(DEFAULT_MATCH_SIZE), aoiRadius(0), farMs(DEFAULT_FAR_MS), delta(false), udp(true), authoritative(false), logLevel(LOG_INFO), logFile(NULL), recordFile(NULL), replayFile(NULL), sendBuffer(0) {}
+};
+
+// Send counters, so the relay and tick modes can be compared on the same load.
+struct SendStats{
+	long long movesIn; // MSG_MOVE messages received
+	long long inputsIn; // MSG_INPUT messages received
+	long long sends; // send() calls made
+	long long bytes; // bytes queued for clients
+	long long relaySends; // sends a per-message relay would have made for the same moves
+	long long relayBytes; // bytes a per-message relay would have sent for the same moves
+	long long plainBytes; // position bytes the current mode would have sent with no interest filter or deltas
+	long long positionBytes; // position bytes actually queued (moves and snapshots)
+	long long wakeups; // times the poller returned
+	long long events; // readiness events handled
+	long long datagramsIn; // UDP datagrams taken from players
+	long long datagramsStale; // UDP datagrams thrown away for arriving after a newer one
+	SendStats():movesIn(0), inputsIn(0), sends(0), bytes(0), relaySends(0), relayBytes(0), plainBytes(0), positionBytes(0), wakeups(0), events(0), datagramsIn(0), datagramsStale(0) {}
+};
+
+Options options;
+SendStats stats;
+Poller poller;
+TimerWheel timers(TIMER_RESOLUTION_MS);
+Timer tickTimer;
+Timer statsTimer;
+Timer farTimer;
+Timer frameTimer;
+uint32_t simulationStart = 0; // authoritative mode: when frame 0 was due
+uint32_t simulatedFrames = 0;
+uint32_t loopTime = 0; // nowMs() as of the latest wakeup; good enough for timestamps
+uint32_t tickLength = 0;
+uint32_t nextTick = 0;
+uint32_t snapshotTick = 0;
+std::vector<SnapshotEntry> snapshotEntries;
+std::vector<int> nearby; // scratch for interest queries
+WorldState viewState; // scratch for building one client's MSG_DELTA
+CollisionGrid collisions; // authoritative mode: scratch broadphase for one match's catch check
+std::vector<Contact> contacts;
+std::vector<int> collisionPlayers; // match->players index of each dot in collisions
+SlotMap<data*> connections; // every connected player, in no particular order
+std::vector<data*> closed; // players dropped this wakeup, waiting to be freed
+std::vector<Match*> matches;
+SocketHandle udpSocket = INVALID_SOCKET_HANDLE;
+std::unordered_map<uint32_t, SlotHandle> channelTokens; // UDP token -> player
+std::mt19937 tokenSource;
+Match* forming = NULL; // the match new players join until it is full
+int nextMatchID = 1;
+Recorder recorder; // --record
+volatile std::sig_atomic_t running = 1;
+
+uint32_t nowMs()
 {
-	SDL_Init(SDL_INIT_EVERYTHING);
-	SDLNet_Init();
-	int curid = 1;
-	int playernum = 0;
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
 
-	SDL_Event event;
+// The match a player is in, for logs: with their slot it names them the way every message does. 0 if none.
+int matchIDOf(const data* player)
+{
+	return player->match != NULL ? player->match->id : 0;
+}
 
-	IPaddress ip;
-	// The server itself
-	SDLNet_ResolveHost(&ip, NULL, 1234);
+// The poller hands back a void* for each socket; players are registered under
+// their handle rather than their address, so a late event can be checked.
+void* keyFor(SlotHandle handle)
+{
+	return (void*)(uintptr_t)handle;
+}
+
+SlotHandle handleFor(void* key)
+{
+	return (SlotHandle)(uintptr_t)key;
+}
+
+void stop(int)
+{
+	running = 0;
+}
+
+// Marks a player for removal. The actual cleanup waits until the current batch of
+// events is done, so no event later in the batch can point at a freed player.
+void dropPlayer(data* player)
+{
+	if (player->closing)
+		return;
+	player->closing = true;
+	closed.push_back(player);
+}
+
+// Sends straight away if the socket will take it; anything left over is queued and
+// written when the poller says the socket is writable again.
+void sendTo(data* player, const char* message, int length)
+{
+	if (player->closing)
+		return;
+	stats.bytes += length;
+	player->lastSent = loopTime;
+	if (recorder.isOpen())
+		recorder.record(RECORD_OUT, RECORD_TCP, player->id, message, length);
+	if (player->socket == INVALID_SOCKET_HANDLE)
+	{// replayed player: everything up to the socket has been done, which is what a replay measures
+		stats.sends++;
+		return;
+	}
+
+	if (player->outbound.empty())
+	{
+		int sent = socketSend(player->socket, message, length);
+		stats.sends++;
+		if (sent == SOCKET_FAILED)
+		{
+			dropPlayer(player);
+			return;
+		}
+		if (sent == length)
+			return;
+		if (sent > 0)
+		{
+			message += sent;
+			length -= sent;
+		}
+	}
+
+	if ((int)player->outbound.size() + length > MAX_OUTBOUND)
+	{// They have stopped reading. Holding on to more just wastes memory.
+		logWarning("Dropping slow client: player {} of match {}", player->slot, matchIDOf(player));
+		dropPlayer(player);
+		return;
+	}
+	player->outbound.insert(player->outbound.end(), message, message + length);
+	if (!player->wantWrite)
+	{
+		poller.setWritable(player->socket, keyFor(player->id), true);
+		player->wantWrite = true;
+	}
+}
+
+void flushOutbound(data* player)
+{
+	int written = 0;
+	while (written < (int)player->outbound.size())
+	{
+		int sent = socketSend(player->socket, &player->outbound[written], (int)player->outbound.size() - written);
+		stats.sends++;
+		if (sent == SOCKET_AGAIN)
+			break;
+		if (sent == SOCKET_FAILED)
+		{
+			dropPlayer(player);
+			return;
+		}
+		written += sent;
+	}
+	player->outbound.erase(player->outbound.begin(), player->outbound.begin() + written);
+
+	if (player->outbound.empty() && player->wantWrite)
+	{
+		poller.setWritable(player->socket, keyFor(player->id), false);
+		player->wantWrite = false;
+	}
+}
+
+// For positions: over the player's UDP channel once they have opened it, TCP until
+// then. Nothing is queued or resent; if the socket buffer is full the datagram is
+// lost just as it could have been on the wire, and the next position replaces it.
+// Doesn't count towards lastSent, so heartbeats still check the TCP connection.
+void sendState(data* player, const char* message, int length)
+{
+	if (!player->udpBound)
+	{
+		sendTo(player, message, length);
+		return;
+	}
+	if (player->closing)
+		return;
+	if (recorder.isOpen())
+		recorder.record(RECORD_OUT, RECORD_UDP, player->id, message, length);
+	char datagram[MAX_DATAGRAM_SIZE];
+	int prefix = writeDatagramPrefix(datagram, player->udpToken, ++player->udpSendSequence);
+	memcpy(datagram + prefix, message, length);
+	if (player->socket != INVALID_SOCKET_HANDLE)
+		udpSendTo(udpSocket, datagram, prefix + length, player->udpAddress);
+	stats.bytes += length;
+	stats.sends++;
+}
+
+// Sends to everyone in the match except skip (which may be NULL).
+void sendToMatch(Match* match, data* skip, const char* message, int length)
+{
+	for (int k = 0; k < match->players.size(); k++)
+	{
+		data* other = match->players[k];
+		if (other != NULL && other != skip)
+			sendTo(other, message, length);
+	}
+}
+
+// sendToMatch for positions.
+void sendStateToMatch(Match* match, data* skip, const char* message, int length)
+{
+	for (int k = 0; k < match->players.size(); k++)
+	{
+		data* other = match->players[k];
+		if (other != NULL && other != skip)
+			sendState(other, message, length);
+	}
+}
+
+// Sends to every other player whose dot is within the relevance radius of player's.
+void sendToNearby(Match* match, data* player, const char* message, int length)
+{
+	nearby.clear();
+	match->grid.query(player->x, player->y, options.aoiRadius, nearby);
+	for (int k = 0; k < nearby.size(); k++)
+	{
+		data* other = match->players[nearby[k]];
+		if (other != player)
+		{
+			sendState(other, message, length);
+			stats.positionBytes += length;
+		}
+	}
+}
+
+// Authoritative mode: every dot to where the client draws it at the start.
+void placeDots(Match* match)
+{
+	match->frames = 0;
+	for (int i = 0; i < match->players.size(); i++)
+	{
+		data* player = match->players[i];
+		if (player == NULL)
+			continue;
+		int x, y;
+		startPosition(player->slot, x, y);
+		player->x = (int16_t)x;
+		player->y = (int16_t)y;
+		player->placed = true;
+		player->dirty = true;
+		player->farDirty = true;
+		if (options.aoiRadius > 0)
+			match->grid.place(i, x, y);
+	}
+}
+
+// Puts a new player in the match that is filling up, starting it once it is full.
+void joinMatch(data* player, char* buffer)
+{
+	if (forming == NULL)
+	{
+		forming = new Match(nextMatchID++, options.matchSize);
+		forming->index = (int)matches.size();
+		matches.push_back(forming);
+	}
+
+	Match* match = forming;
+	int slot = 0;
+	while (match->players[slot] != NULL)
+		slot++;
+	match->players[slot] = player;
+	match->playerCount++;
+	player->match = match;
+	player->slot = slot + 1;
+
+	int length = encodeWelcome(buffer, (uint16_t)player->slot, options.authoritative ? WELCOME_AUTHORITATIVE : 0);
+	sendTo(player, buffer, length);
+
+	if (match->playerCount == options.matchSize)
+	{//Everyone is here. Start the game and open a new match for whoever comes next.
+		match->started = true;
+		forming = NULL;
+		if (options.authoritative)
+			placeDots(match);
+		length = encodeStart(buffer);
+		sendToMatch(match, NULL, buffer, length);
+	}
+}
+
+// Takes a player out of their match, telling the rest. Empty matches are freed.
+void leaveMatch(data* player, char* buffer)
+{
+	Match* match = player->match;
+	if (match == NULL)
+		return;
+
+	match->players[player->slot - 1] = NULL;
+	match->grid.remove(player->slot - 1);
+	match->playerCount--;
+	player->match = NULL;
+
+	int length = encodeDisconnect(buffer, (uint16_t)player->slot);
+	sendToMatch(match, NULL, buffer, length);
+
+	if (match->playerCount == 0)
+	{
+		if (forming == match)
+			forming = NULL;
+		matches[match->index] = matches.back();
+		matches[match->index]->index = match->index;
+		matches.pop_back();
+		delete match;
+	}
+}
+
+// Size of the MSG_SNAPSHOT messages needed to carry count entries.
+int snapshotBytes(int count)
+{
+	int messages = (count + MAX_SNAPSHOT_ENTRIES - 1) / MAX_SNAPSHOT_ENTRIES;
+	return messages * (HEADER_SIZE + SNAPSHOT_HEADER_SIZE) + count * SNAPSHOT_ENTRY_SIZE;
+}
 
-	std::vector<data> socketvector;
+// Encodes entries as MSG_SNAPSHOTs (split if they won't fit in one message) and
+// sends them to one player, or to the whole match if player is NULL.
+void sendEntries(Match* match, data* player, uint32_t tick, char* buffer, const std::vector<SnapshotEntry>& entries)
+{
+	for (int first = 0; first < entries.size(); first += MAX_SNAPSHOT_ENTRIES)
+	{
+		int count = (int)entries.size() - first;
+		int length = encodeSnapshot(buffer, tick, &entries[first], count);
+		if (player != NULL)
+		{
+			sendState(player, buffer, length);
+			stats.positionBytes += length;
+		}
+		else
+		{
+			sendStateToMatch(match, NULL, buffer, length);
+			stats.positionBytes += (long long)length * match->playerCount;
+		}
+	}
+}
 
-	char tmp[1400];
-	bool running = true;
-	bool gameState = false;
-	
-	SDLNet_SocketSet sockets = SDLNet_AllocSocketSet(30);
-	TCPsocket server = SDLNet_TCP_Open(&ip);
+// Sends viewer a MSG_DELTA for everything they can see, against the newest tick
+// they have acknowledged. If that tick has dropped out of their history (or they
+// have never acknowledged one) it is a full snapshot; if the change list won't fit
+// in one message they get plain MSG_SNAPSHOTs this tick instead.
+void sendDelta(Match* match, data* viewer, uint32_t tick, char* buffer)
+{
+	if (viewer->history == NULL)
+		viewer->history = new SnapshotHistory();
 
-	//SDL_Window *screen = SDL_CreateWindow("Server", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 640, 480, 0);
-	//SDL_Renderer *m_pRender = SDL_CreateRenderer(screen, -1, SDL_RENDERER_ACCELERATED);
-	while(running) 
+	WorldState& current = viewState;
+	current.tick = tick;
+	current.entries.clear();
+	if (options.aoiRadius == 0)
 	{
-		while(SDL_PollEvent(&event)) 
+		for (int k = 0; k < match->players.size(); k++)
 		{
-			if(event.type == SDL_QUIT || event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE)
-				running = false;
+			data* player = match->players[k];
+			if (player != NULL && player != viewer)
+			{
+				SnapshotEntry entry = { (uint16_t)player->slot, player->x, player->y };
+				current.entries.push_back(entry);
+			}
 		}
-		TCPsocket tmpsocket = SDLNet_TCP_Accept(server);
-		if (tmpsocket) 
+	}
+	else if (match->grid.contains(viewer->slot - 1))
+	{
+		nearby.clear();
+		match->grid.query(viewer->x, viewer->y, options.aoiRadius, nearby);
+		std::sort(nearby.begin(), nearby.end());
+		for (int k = 0; k < nearby.size(); k++)
 		{
-			if (playernum < 30)
+			data* player = match->players[nearby[k]];
+			if (player != viewer)
 			{
-				SDLNet_TCP_AddSocket(sockets, tmpsocket);
-				socketvector.push_back(data(tmpsocket, SDL_GetTicks(), curid));
-				playernum++;
-				sprintf(tmp, "0 %d \n", curid);
-				std::cout << "New connection: " << curid << '\n';
-				curid++;
-			} else {
-				sprintf(tmp, "3 \n");
+				SnapshotEntry entry = { (uint16_t)player->slot, player->x, player->y };
+				current.entries.push_back(entry);
 			}
-			SDLNet_TCP_Send(tmpsocket, tmp, strlen(tmp)+1);
-
-			if (playernum == 3 && gameState == false)
-			{//Only works once the third player has joined. If the game hasn't started yet, start it.
-				gameState = true;
-				//Send message to initiate game.
-				char msg[] = "4 \0";
-				memcpy(tmp, msg, strlen(msg)+1);
-				SDLNet_TCP_Send(socketvector[0].socket, tmp, strlen(tmp) + 1);
-				SDLNet_TCP_Send(socketvector[1].socket, tmp, strlen(tmp) + 1);
-				SDLNet_TCP_Send(socketvector[2].socket, tmp, strlen(tmp) + 1);
+		}
+	}
+
+	const WorldState* baseline = viewer->history->find(viewer->ackedTick);
+	int length = encodeDelta(buffer, current, baseline);
+	if (length > 0)
+	{
+		sendState(viewer, buffer, length);
+		stats.positionBytes += length;
+		WorldState& sent = viewer->history->store(tick);
+		sent.entries.swap(current.entries); // the old entries become next time's scratch space
+	}
+	else if (length < 0)
+		sendEntries(match, viewer, tick, buffer, current.entries);
+}
+
+// Sends every dirty position in the match as MSG_SNAPSHOTs.
+// Without an interest radius every client gets the same bytes and skips its own
+// entry, so the snapshot is only encoded once per match. With one, each client
+// gets its own snapshot holding just the dirty dots near it; the grid keeps that
+// to the few cells around the client instead of the whole match.
+void sendSnapshot(Match* match, uint32_t tick, char* buffer)
+{
+	std::vector<SnapshotEntry>& entries = snapshotEntries;
+	int dirty = 0;
+	for (int i = 0; i < match->players.size(); i++)
+		if (match->players[i] != NULL && match->players[i]->dirty)
+			dirty++;
+	if (dirty == 0)
+		return;
+	stats.plainBytes += (long long)snapshotBytes(dirty) * match->playerCount;
+
+	if (options.delta)
+	{
+		for (int i = 0; i < match->players.size(); i++)
+			if (match->players[i] != NULL)
+				sendDelta(match, match->players[i], tick, buffer);
+	}
+	else if (options.aoiRadius == 0)
+	{
+		entries.clear();
+		for (int i = 0; i < match->players.size(); i++)
+		{
+			data* player = match->players[i];
+			if (player == NULL || !player->dirty)
+				continue;
+			SnapshotEntry entry = { (uint16_t)player->slot, player->x, player->y };
+			entries.push_back(entry);
+		}
+		sendEntries(match, NULL, tick, buffer, entries);
+	}
+	else
+	{
+		for (int i = 0; i < match->players.size(); i++)
+		{
+			data* viewer = match->players[i];
+			if (viewer == NULL || !match->grid.contains(i))
+				continue; // hasn't moved yet, so nothing is near them; far updates cover it
+			entries.clear();
+			nearby.clear();
+			match->grid.query(viewer->x, viewer->y, options.aoiRadius, nearby);
+			for (int k = 0; k < nearby.size(); k++)
+			{
+				data* player = match->players[nearby[k]];
+				if (player == viewer || !player->dirty)
+					continue;
+				SnapshotEntry entry = { (uint16_t)player->slot, player->x, player->y };
+				entries.push_back(entry);
 			}
+			sendEntries(match, viewer, tick, buffer, entries);
 		}
-		//check for incoming data
-		while (SDLNet_CheckSockets(sockets, 0) > 0) 
+	}
+
+	for (int i = 0; i < match->players.size(); i++)
+		if (match->players[i] != NULL)
+			match->players[i]->dirty = false;
+}
+
+// The low-rate half of interest management: every dot that moved since the last
+// far update is sent to the whole match, near or not. One shared snapshot per
+// match, so it costs a fraction of what sending everything every tick would.
+void sendFarUpdate(Match* match, uint32_t tick, char* buffer)
+{
+	std::vector<SnapshotEntry>& entries = snapshotEntries;
+	entries.clear();
+	for (int i = 0; i < match->players.size(); i++)
+	{
+		data* player = match->players[i];
+		if (player == NULL || !player->farDirty)
+			continue;
+		SnapshotEntry entry = { (uint16_t)player->slot, player->x, player->y };
+		entries.push_back(entry);
+		player->farDirty = false;
+	}
+	sendEntries(match, NULL, tick, buffer, entries);
+}
+
+void printStats()
+{
+	logInfo("Players: {}  matches: {}  moves in: {}  inputs in: {}  sends: {} (relay: {})  bytes: {} (relay: {})  wakeups: {}  events: {}  datagrams in: {} (stale: {})",
+		connections.size(), matches.size(), stats.movesIn, stats.inputsIn, stats.sends, stats.relaySends, stats.bytes, stats.relayBytes,
+		stats.wakeups, stats.events, stats.datagramsIn, stats.datagramsStale);
+}
+
+// Tells the player where their dot is as of lastInput. Goes over TCP: it has to arrive.
+void sendCorrection(data* player)
+{
+	char correction[HEADER_SIZE + 8];
+	int length = encodeCorrection(correction, player->lastInput, player->x, player->y);
+	sendTo(player, correction, length);
+	player->correcting = true;
+	player->correctionSent = loopTime;
+}
+
+// Checks a move against how far a dot can go in the frames the client says have
+// passed since the last move we took, and no more than the wall clock allows.
+// A move that goes too far is pulled back and the player gets a MSG_CORRECTION;
+// their prediction then replays from the corrected spot. Moves they sent before
+// it arrived are still too far off, so until one lines up again the rest are
+// ignored. Returns false if this move should be ignored.
+bool acceptMove(data* player, MoveMessage& move)
+{
+	bool numbered = move.input != 0 && player->lastInput != 0;
+	if (numbered && !sequenceNewer(move.input, player->lastInput))
+		return false; // older than the one we have
+
+	if (player->placed)
+	{
+		uint32_t frames = numbered ? move.input - player->lastInput : MAX_FRAMES_PER_MOVE;
+		uint32_t elapsed = (loopTime - player->lastMoveTime) * FRAMES_PER_SECOND / 1000 + JITTER_FRAMES;
+		frames = std::min(frames, std::min(elapsed, MAX_FRAMES_PER_MOVE));
+
+		int x = move.x;
+		int y = move.y;
+		if (!limitMove(player->x, player->y, x, y, DOT_SPEED * (int)frames))
 		{
-			for (int i = 0; i < socketvector.size(); i++)
+			if (player->correcting)
 			{
-				if(SDLNet_SocketReady(socketvector[i].socket))
+				if (loopTime - player->correctionSent >= CORRECTION_RESEND_MS)
 				{
-					socketvector[i].timeout = SDL_GetTicks();
-					memset(tmp, 0, sizeof(tmp));
-					SDLNet_TCP_Recv(socketvector[i].socket, tmp, 1400);
-
-					int num = tmp[0] - '0';
-					int j = 1;
-					while (tmp[j] >= '0' && tmp[j] <= '9')
-					{	
-						num *= 10;
-						num += tmp[j] - '0';
-						j++;
-					}
-
-					if (num == 1)
-					{
-						std::cout << "Message Type 1: " << socketvector[i].id << '\n';
-						//One player has moved. Send new position to the other.
-						for(int k = 0; k < socketvector.size(); k++)
-						{
-							if (k == i)
-								continue;
-							SDLNet_TCP_Send(socketvector[k].socket, tmp, strlen(tmp)+1);
-						}
-					} else if (num == 2) {
-						std::cout << "Message Type 2: " << socketvector[i].id << '\n';
-						//One player has disconnected. 
-						for(int k = 0; k < socketvector.size(); k++)
-						{
-							if (k == i)
-								continue;
-							SDLNet_TCP_Send(socketvector[k].socket, tmp, strlen(tmp)+1);
-						}
-						SDLNet_TCP_DelSocket(sockets, socketvector[i].socket);
-						SDLNet_TCP_Close(socketvector[i].socket);
-						socketvector.erase(socketvector.begin()+i);
-						playernum--;			
-					} else if (num == 3) {
-						std::cout << "Message Type 3: " << socketvector[i].id << '\n';
-						//One player has detected that a collision has occurred.
-						int tmpvar;
-						sscanf(tmp, "3 %d", &tmpvar);
-
-						SDLNet_TCP_Send(socketvector[0].socket, tmp, strlen(tmp) + 1);
-						SDLNet_TCP_Send(socketvector[1].socket, tmp, strlen(tmp) + 1);
-						SDLNet_TCP_Send(socketvector[2].socket, tmp, strlen(tmp) + 1);
-						
-						/*SDLNet_TCP_DelSocket(sockets, socketvector[i].socket);
-						SDLNet_TCP_Close(socketvector[i].socket);
-						socketvector.erase(socketvector.begin() + i);
-						playernum = 0;
-						curid = 1;*/
-					}
+					player->lastInput = move.input;
+					sendCorrection(player);
 				}
+				return false;
+			}
+			move.x = (int16_t)x;
+			move.y = (int16_t)y;
+			player->x = move.x;
+			player->y = move.y;
+			player->lastInput = move.input;
+			player->lastMoveTime = loopTime;
+			sendCorrection(player);
+			return true;
+		}
+	}
+
+	player->placed = true;
+	player->correcting = false;
+	player->x = move.x;
+	player->y = move.y;
+	player->lastInput = move.input;
+	player->lastMoveTime = loopTime;
+	return true;
+}
+
+// Authoritative mode: files the inputs in a MSG_INPUT by sequence number until the
+// simulation gets to them. Each message repeats every input we haven't confirmed,
+// so most of these are already here; anything already applied, or too far ahead
+// of the simulation to hold, is skipped.
+void takeInputs(data* player, const char* payload, int length)
+{
+	uint32_t newest;
+	int count;
+	if (!decodeInput(payload, length, newest, count) || count == 0)
+		return;
+	if (player->newestInput == 0)
+		player->lastInput = newest - count; // their first: pick up from wherever their numbering is
+
+	for (int i = 0; i < count; i++)
+	{
+		uint32_t sequence = newest - count + 1 + i;
+		if (!sequenceNewer(sequence, player->lastInput) || sequence - player->lastInput > (uint32_t)INPUT_WINDOW)
+			continue;
+		PendingInput& input = player->pending[sequence % INPUT_WINDOW];
+		input.sequence = sequence;
+		input.buttons = inputEntry(payload, i);
+	}
+	if (player->newestInput == 0 || sequenceNewer(newest, player->newestInput))
+		player->newestInput = newest;
+}
+
+// Handles one complete message from player. Returns false if they should be dropped.
+bool handleMessage(data* player, const MessageHeader& header, char* message)
+{
+	//Never trust the sender field a client filled in; stamp it with the ID their match knows them by.
+	setSender(message, (uint16_t)player->slot);
+	int length = messageSize(header);
+	int num = header.type;
+	Match* match = player->match;
+
+	if (num == MSG_MOVE)
+	{
+		//One player has moved.
+		stats.movesIn++;
+		if (options.authoritative)
+			return true; // we decide where their dot is
+		MoveMessage move;
+		if (!decodeMove(message + HEADER_SIZE, header.length, move) || !acceptMove(player, move))
+			return true;
+
+		logDebug("Message Type 1: player {} of match {} ({}, {})", player->slot, matchIDOf(player), move.x, move.y);
+
+		//The others get the position we accepted, without the input number; only the sender has a use for it.
+		length = encodeMove(message, (uint16_t)player->slot, move.x, move.y, 0);
+		int others = match->playerCount - 1;
+		stats.relaySends += others;
+		stats.relayBytes += (long long)others * length;
+		if (options.aoiRadius > 0)
+		{
+			match->grid.place(player->slot - 1, move.x, move.y);
+			player->farDirty = true;
+		}
+
+		if (options.tickRate > 0)
+		{//Remember where they are; the match hears about it in the next snapshot.
+			player->dirty = true;
+		}
+		else
+		{//Send new position to the others straight away.
+			stats.plainBytes += (long long)others * length;
+			if (options.aoiRadius > 0)
+				sendToNearby(match, player, message, length);
+			else
+			{
+				sendStateToMatch(match, player, message, length);
+				stats.positionBytes += (long long)others * length;
+			}
+		}
+	} else if (num == MSG_DISCONNECT) {
+		logInfo("Message Type 2: player {} of match {}", player->slot, matchIDOf(player));
+		return false;
+	} else if (num == MSG_INPUT) {
+		stats.inputsIn++;
+		if (options.authoritative)
+			takeInputs(player, message + HEADER_SIZE, header.length);
+	} else if (num == MSG_GAMEOVER) {
+		if (options.authoritative)
+			return true; // we decide who has won
+		logInfo("Message Type 3: player {} of match {}", player->slot, match->id);
+		//One player has detected that a collision has occurred.
+		sendToMatch(match, NULL, message, length);
+	} else if (num == MSG_ACK) {
+		uint32_t tick;
+		if (decodeAck(message + HEADER_SIZE, header.length, tick) &&
+			(player->ackedTick == NO_BASELINE || (int32_t)(tick - player->ackedTick) > 0))
+			player->ackedTick = tick;
+	} else if (num == MSG_PING) {
+		//Echo it straight back; the client measures the round trip.
+		writeU8(message + 1, MSG_PONG);
+		sendTo(player, message, length);
+	}
+	return true;
+}
+
+// Edge-triggered: keep reading until the socket has nothing left, handling every
+// complete message as it arrives so the buffer always has room for more.
+void readFrom(data* player)
+{
+	player->timeout = loopTime;
+	while (!player->closing)
+	{
+		FrameBuffer& frames = player->frames;
+		int received = socketRecv(player->socket, frames.writePtr(), frames.writeSpace());
+		if (received == SOCKET_AGAIN)
+			return;
+		if (received <= 0)
+		{
+			if (recorder.isOpen())
+				recorder.record(RECORD_CLOSE, RECORD_TCP, player->id);
+			dropPlayer(player);
+			return;
+		}
+		frames.commit(received);
+
+		MessageHeader header;
+		char* message;
+		FrameBuffer::Result result;
+		while ((result = frames.next(header, message)) == FrameBuffer::FRAME_READY)
+		{
+			if (recorder.isOpen())
+				recorder.record(RECORD_IN, RECORD_TCP, player->id, message, messageSize(header));
+			if (!handleMessage(player, header, message))
+			{
+				dropPlayer(player);
+				return;
+			}
+		}
+		if (result == FrameBuffer::FRAME_ERROR)
+		{//They sent something we can't make sense of.
+			if (recorder.isOpen())
+				recorder.record(RECORD_CLOSE, RECORD_TCP, player->id);
+			dropPlayer(player);
+			return;
+		}
+	}
+}
+
+// Gives a new player their UDP token. They answer with a MSG_CHANNEL datagram
+// carrying it, which tells us their UDP address; until then positions use TCP.
+void offerChannel(data* player, char* buffer)
+{
+	if (udpSocket == INVALID_SOCKET_HANDLE && (options.replayFile == NULL || !options.udp))
+		return; // a replay has no UDP port, but the players it replays were offered one
+	uint32_t token;
+	do
+		token = tokenSource();
+	while (token == 0 || channelTokens.count(token) != 0);
+	player->udpToken = token;
+	channelTokens[token] = player->id;
+
+	int length = encodeChannel(buffer, SERVER_ID, token);
+	sendTo(player, buffer, length);
+}
+
+// One datagram from player that was newer than anything before it.
+void takeDatagram(data* player, const MessageHeader& header, char* message)
+{
+	player->udpBound = true;
+	player->timeout = loopTime;
+
+	if (header.type == MSG_MOVE || header.type == MSG_ACK || header.type == MSG_INPUT)
+		if (!handleMessage(player, header, message))
+			dropPlayer(player);
+}
+
+// Takes every datagram waiting on the UDP socket. The token says which player it
+// came from and the sequence number throws out anything older than what we have
+// already taken from them. Their address is whatever the last good one came from,
+// so a NAT rebinding mid-game doesn't lose them.
+void readUdp()
+{
+	char datagram[MAX_DATAGRAM_SIZE];
+	UdpAddress from;
+	int received;
+	while ((received = udpRecvFrom(udpSocket, datagram, sizeof(datagram), from)) >= 0)
+	{
+		uint32_t token, sequence;
+		MessageHeader header;
+		if (!readDatagram(datagram, received, token, sequence, header))
+			continue;
+		std::unordered_map<uint32_t, SlotHandle>::iterator channel = channelTokens.find(token);
+		if (channel == channelTokens.end())
+			continue;
+		data** found = connections.find(channel->second);
+		if (found == NULL || (*found)->closing)
+			continue;
+
+		data* player = *found;
+		stats.datagramsIn++;
+		if (!sequenceNewer(sequence, player->udpRecvSequence))
+		{
+			stats.datagramsStale++;
+			continue;
+		}
+		player->udpRecvSequence = sequence;
+		player->udpAddress = from;
+		if (recorder.isOpen())
+			recorder.record(RECORD_IN, RECORD_UDP, player->id, datagram + DATAGRAM_PREFIX_SIZE, messageSize(header));
+		takeDatagram(player, header, datagram + DATAGRAM_PREFIX_SIZE);
+	}
+}
+
+// Frees everyone dropped during this wakeup and tells the rest of their match.
+// Telling them can fail and drop more players, so keep going until nobody is left.
+void reapClosed(char* buffer)
+{
+	while (!closed.empty())
+	{
+		data* player = closed.back();
+		closed.pop_back();
+
+		connections.remove(player->id);
+		if (player->udpToken != 0)
+			channelTokens.erase(player->udpToken);
+
+		if (player->socket != INVALID_SOCKET_HANDLE)
+		{
+			poller.remove(player->socket);
+			closeSocket(player->socket);
+		}
+		timers.cancel(player->idleTimer);
+		timers.cancel(player->heartbeatTimer);
+		logInfo("Disconnected: player {} of match {}", player->slot, matchIDOf(player));
+		leaveMatch(player, buffer);
+
+		delete player;
+	}
+}
+
+// Due TIMEOUT_MS after the player was last heard from. Receiving doesn't touch the
+// timer, it only records the time; when the timer fires it either drops the player
+// or re-arms itself from that time. A busy player costs one wheel slot per timeout.
+void onIdleTimer(Timer& timer, uint32_t now)
+{
+	data* player = (data*)timer.context;
+	uint32_t deadline = player->timeout + TIMEOUT_MS;
+	if ((int32_t)(now - deadline) >= 0)
+	{
+		logInfo("Timed out: player {} of match {}", player->slot, matchIDOf(player));
+		dropPlayer(player);
+	}
+	else
+		timers.schedule(timer, deadline);
+}
+
+// Keeps quiet connections alive and finds dead ones: a player we haven't sent
+// anything to in HEARTBEAT_MS gets a MSG_PING. If the send fails they are dropped.
+void onHeartbeatTimer(Timer& timer, uint32_t now)
+{
+	data* player = (data*)timer.context;
+	if (player->closing)
+		return;
+	uint32_t due = player->lastSent + HEARTBEAT_MS;
+	if ((int32_t)(now - due) >= 0)
+	{
+		char ping[HEADER_SIZE + 4];
+		int length = encodePing(ping, SERVER_ID, now);
+		sendTo(player, ping, length);
+		due = now + HEARTBEAT_MS;
+	}
+	timers.schedule(timer, due);
+}
+
+// Authoritative mode: tells each player where their dot is as of the newest input
+// we have applied, if that has changed since we last said. Their prediction
+// replays anything newer on top. Over UDP when it's open; the next one replaces
+// a lost one.
+void sendInputReports(Match* match)
+{
+	char report[HEADER_SIZE + 8];
+	for (int i = 0; i < match->players.size(); i++)
+	{
+		data* player = match->players[i];
+		if (player == NULL || player->lastInput == player->reportedInput)
+			continue;
+		int length = encodeCorrection(report, player->lastInput, player->x, player->y);
+		sendState(player, report, length);
+		player->reportedInput = player->lastInput;
+	}
+}
+
+// end of tick: one snapshot per client instead of one message per move.
+// Stops when the last player leaves and is restarted by the next one to join,
+// so an empty server doesn't wake up every tick.
+void onTick(Timer& timer, uint32_t now)
+{
+	char* buffer = (char*)timer.context;
+	for (int m = 0; m < matches.size(); m++)
+	{
+		if (options.authoritative)
+			sendInputReports(matches[m]);
+		sendSnapshot(matches[m], snapshotTick, buffer);
+	}
+	snapshotTick++;
+
+	if (connections.empty())
+		return;
+	nextTick += tickLength;
+	if ((int32_t)(nextTick - now) <= 0)
+		nextTick = now + tickLength; // fell behind; don't try to catch up with a burst
+	timers.schedule(timer, nextTick);
+}
+
+// Authoritative mode: the match is over. Everyone hears who won and the dots stop.
+void endMatch(Match* match, uint8_t winner, char* buffer)
+{
+	match->started = false;
+	int length = encodeGameOver(buffer, SERVER_ID, winner);
+	sendToMatch(match, NULL, buffer, length);
+	logInfo("Game over: match {} winner {} after {} frames", match->id, winner, match->frames);
+}
+
+// Authoritative mode: one frame of the game. Each player's next input is applied
+// if it has arrived. If it hasn't, their dot waits for it; it is still applied,
+// just late, so the dot ends up where their prediction put it. Only an input
+// that is gone for good (newer ones have been arriving for half the window)
+// is skipped, keeping whatever keys they held before, and their next
+// MSG_CORRECTION sorts out the difference. A player who was held up can catch
+// up several inputs in one frame, but no more than the clock allows.
+// Then the same collision test and timer the client used to run, except that
+// the test sweeps each dot over the whole frame (dotsCollideSwept), so a
+// runner can't slip through a chaser between frames. A dot that caught up
+// several inputs is swept in a straight line from its start to its end.
+void simulateMatch(Match* match, char* buffer)
+{
+	for (int i = 0; i < match->players.size(); i++)
+	{
+		data* player = match->players[i];
+		if (player == NULL)
+			continue;
+		player->frameX = player->x;
+		player->frameY = player->y;
+		if (player->closing)
+			continue;
+		player->inputBudget = std::min(player->inputBudget + 1, (int)JITTER_FRAMES);
+
+		int x = player->x;
+		int y = player->y;
+		bool moved = false;
+		while (player->inputBudget > 0 && player->newestInput != 0)
+		{
+			uint32_t next = player->lastInput + 1;
+			PendingInput& input = player->pending[next % INPUT_WINDOW];
+			if (input.sequence == next)
+				player->buttons = input.buttons;
+			else if (!sequenceNewer(player->newestInput, player->lastInput + INPUT_WINDOW / 2))
+				break; // not here yet
+
+			int velX, velY;
+			inputVelocity(player->buttons, velX, velY);
+			stepDot(x, y, velX, velY);
+			player->lastInput = next;
+			player->inputBudget--;
+			moved = true;
+		}
+		if (moved && (x != player->x || y != player->y))
+		{
+			player->x = (int16_t)x;
+			player->y = (int16_t)y;
+			player->dirty = true;
+			player->farDirty = true;
+			if (options.aoiRadius > 0)
+				match->grid.place(i, x, y);
+		}
+	}
+
+	// Broadphase: only dots that ended the frame within reach of each other can
+	// have touched during it, so only those pairs are swept.
+	if (match->players[0] != NULL)
+	{
+		int travel = 0;
+		collisionPlayers.clear();
+		for (int i = 0; i < match->players.size(); i++)
+		{
+			data* player = match->players[i];
+			if (player == NULL)
+				continue;
+			travel = std::max(travel, std::abs(fieldDeltaX(player->frameX, player->x)) + std::abs(fieldDeltaY(player->frameY, player->y)));
+			collisionPlayers.push_back(i);
+		}
+		collisions.clear(sweptReach(travel));
+		for (int k = 0; k < collisionPlayers.size(); k++)
+			collisions.add(match->players[collisionPlayers[k]]->x, match->players[collisionPlayers[k]]->y);
+		collisions.findContacts(contacts);
+
+		for (int k = 0; k < contacts.size(); k++)
+		{
+			if (collisionPlayers[contacts[k].a] != 0)
+				continue; // the runner was added first, so it is always a
+			data* runner = match->players[0];
+			data* chaser = match->players[collisionPlayers[contacts[k].b]];
+			if (dotsCollideSwept(runner->frameX, runner->frameY, runner->x, runner->y, chaser->frameX, chaser->frameY, chaser->x, chaser->y))
+			{//Player 1 has been caught. It doesn't matter by whom; the chasers win as a team.
+				endMatch(match, WINNER_CHASERS, buffer);
+				return;
+			}
+		}
+	}
+	if (++match->frames >= ENDGAME_FRAMES)
+		endMatch(match, WINNER_RUNNER, buffer);
+}
+
+uint32_t frameDue(uint32_t frame)
+{
+	return simulationStart + (uint32_t)((uint64_t)frame * 1000 / FRAMES_PER_SECOND);
+}
+
+// Authoritative mode: runs every frame that is due, at FRAMES_PER_SECOND on
+// average; the timer wheel's resolution means they sometimes come in pairs.
+// Stops with the last player like the tick timer does.
+void onFrameTimer(Timer& timer, uint32_t now)
+{
+	char* buffer = (char*)timer.context;
+	int frames = 0;
+	while ((int32_t)(now - frameDue(simulatedFrames + 1)) >= 0)
+	{
+		if (++frames > MAX_CATCHUP_FRAMES)
+		{// fell behind; carry on from now rather than run a burst of frames
+			simulationStart = now;
+			simulatedFrames = 0;
+			break;
+		}
+		for (int m = 0; m < matches.size(); m++)
+			if (matches[m]->started)
+				simulateMatch(matches[m], buffer);
+		simulatedFrames++;
+	}
+
+	if (connections.empty())
+		return;
+	timers.schedule(timer, frameDue(simulatedFrames + 1));
+}
+
+void onFarTimer(Timer& timer, uint32_t now)
+{
+	char* buffer = (char*)timer.context;
+	for (int m = 0; m < matches.size(); m++)
+		sendFarUpdate(matches[m], snapshotTick, buffer);
+	if (!connections.empty())
+		timers.schedule(timer, now + options.farMs);
+}
+
+// Outbound position bandwidth per player over the last interval, next to what
+// the same mode would have sent without the interest filter or deltas.
+void printBandwidth(uint32_t now)
+{
+	static long long lastPosition = 0;
+	static long long lastPlain = 0;
+	static uint32_t lastTime = 0;
+
+	double seconds = (now - lastTime) / 1000.0;
+	if (!connections.empty() && seconds > 0)
+	{
+		double perClient = (stats.positionBytes - lastPosition) / seconds / connections.size();
+		double plain = (stats.plainBytes - lastPlain) / seconds / connections.size();
+		logInfo("Position bytes/s per player: {} (plain: {})", (long long)perClient, (long long)plain);
+	}
+	lastPosition = stats.positionBytes;
+	lastPlain = stats.plainBytes;
+	lastTime = now;
+}
+
+void onStatsTimer(Timer& timer, uint32_t now)
+{
+	if (stats.movesIn > 0 || stats.inputsIn > 0)
+	{
+		printStats();
+		printBandwidth(now);
+	}
+	timers.schedule(timer, now + STATS_MS);
+}
+
+// A new connection: set up their timers, start the match clock if they are the
+// first, and put them in a match. socket is INVALID_SOCKET_HANDLE for a replayed player.
+data* addPlayer(SocketHandle socket, char* buffer)
+{
+	data* player = new data(socket, loopTime);
+	player->id = connections.insert(player);
+	if (socket != INVALID_SOCKET_HANDLE)
+	{
+		if (options.sendBuffer > 0)
+			setSendBuffer(socket, options.sendBuffer);
+		poller.add(socket, keyFor(player->id));
+	}
+
+	player->idleTimer.callback = onIdleTimer;
+	player->idleTimer.context = player;
+	timers.schedule(player->idleTimer, loopTime + TIMEOUT_MS);
+	player->heartbeatTimer.callback = onHeartbeatTimer;
+	player->heartbeatTimer.context = player;
+	timers.schedule(player->heartbeatTimer, loopTime + HEARTBEAT_MS);
+	if (tickLength > 0 && !tickTimer.scheduled())
+	{
+		nextTick = loopTime + tickLength;
+		timers.schedule(tickTimer, nextTick);
+	}
+	if (options.aoiRadius > 0 && !farTimer.scheduled())
+		timers.schedule(farTimer, loopTime + options.farMs);
+	if (options.authoritative && !frameTimer.scheduled())
+	{
+		simulationStart = loopTime;
+		simulatedFrames = 0;
+		timers.schedule(frameTimer, frameDue(1));
+	}
+
+	joinMatch(player, buffer);
+	offerChannel(player, buffer);
+	return player;
+}
+
+// Everything the server does on a schedule goes through the timer wheel.
+void setUpTimers(char* buffer)
+{
+	tickTimer.callback = onTick;
+	tickTimer.context = buffer;
+	farTimer.callback = onFarTimer;
+	farTimer.context = buffer;
+	frameTimer.callback = onFrameTimer;
+	frameTimer.context = buffer;
+	statsTimer.callback = onStatsTimer;
+	timers.schedule(statsTimer, loopTime + STATS_MS);
+}
+
+// --replay: feeds a recording made with --record through the same code the
+// network loop uses, as fast as it will go. The clock is the recording's, not
+// the wall's: each batch of events is handled at the time the recorded loop
+// woke for it, and timers run where it ran them, so every run of a file does
+// exactly the same work. That makes a real load repeatable offline, to profile
+// or to time one build against another.
+// Replayed players have no socket; the sends they would have got are counted
+// and compared with the recorded ones, which match as long as the server is
+// run in the mode the recording was made in.
+int replay()
+{
+	ReplayFile file;
+	if (!file.open(options.replayFile))
+	{
+		logError("Could not read recording {}", options.replayFile);
+		return 1;
+	}
+	if (file.source() != RECORD_SERVER)
+	{
+		logError("{} was recorded by a client; replay it with the client", options.replayFile);
+		return 1;
+	}
+
+	char tmp[MAX_MESSAGE_SIZE];
+	char message[MAX_MESSAGE_SIZE]; // handlers write into the message; the mapping is read-only
+	setUpTimers(tmp);
+
+	std::unordered_map<uint32_t, SlotHandle> replayed; // recorded handle -> ours
+	long long messagesIn = 0, recordedSends = 0, recordedBytes = 0;
+	uint64_t playedUs = 0;
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+	ReplayRecord record;
+	while (running && file.next(record))
+	{
+		playedUs = record.time;
+		if (record.kind == RECORD_WAKE)
+		{
+			loopTime = record.connection;
+			stats.wakeups++;
+			continue;
+		}
+		if (record.kind == RECORD_TIMERS)
+		{// the end of a batch, as in main()
+			reapClosed(tmp);
+			loopTime = record.connection;
+			timers.advance(loopTime);
+			reapClosed(tmp);
+			continue;
+		}
+		if (record.kind == RECORD_OPEN)
+		{
+			replayed[record.connection] = addPlayer(INVALID_SOCKET_HANDLE, tmp)->id;
+			continue;
+		}
+		if (record.kind == RECORD_OUT)
+		{
+			recordedSends++;
+			recordedBytes += record.length;
+			continue;
+		}
+
+		std::unordered_map<uint32_t, SlotHandle>::iterator handle = replayed.find(record.connection);
+		data** found = handle == replayed.end() ? NULL : connections.find(handle->second);
+		if (found == NULL || (*found)->closing)
+			continue; // we dropped them ourselves, as the recorded server did
+		data* player = *found;
+		if (record.kind == RECORD_CLOSE)
+			dropPlayer(player);
+		else
+		{
+			messagesIn++;
+			memcpy(message, record.message, record.length);
+			if (record.channel == RECORD_UDP)
+			{
+				stats.datagramsIn++;
+				takeDatagram(player, record.header, message);
+			}
+			else
+			{
+				player->timeout = loopTime;
+				if (!handleMessage(player, record.header, message))
+					dropPlayer(player);
 			}
 		}
-		// disconnect, timeout
-		for (int j = 0; j < socketvector.size(); j++)
-			if (SDL_GetTicks() - socketvector[j].timeout > 120000)
+	}
+	reapClosed(tmp);
+
+	long long elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+	logStop(); // from here lines are written straight out, so a burst of records at the end can't crowd out the summary
+	printStats();
+	logInfo("Replayed {} messages ({} s of play) in {} ms: {} messages/s",
+		messagesIn, (long long)(playedUs / 1000000), elapsedUs / 1000, elapsedUs > 0 ? messagesIn * 1000000 / elapsedUs : 0);
+	logInfo("Sent {} messages, {} bytes (recorded: {} messages, {} bytes)", stats.sends, stats.bytes, recordedSends, recordedBytes);
+	return 0;
+}
+
+// Usage: server [tick rate] [--tick N] [--max-players N] [--match-size N] [--port N]
+//               [--aoi-radius N] [--far-ms N] [--delta] [--no-udp] [--authoritative]
+//               [--log-level debug|info|warning|error|off] [--log-file PATH]
+//               [--record PATH] [--replay PATH] [--send-buffer BYTES]
+// With no tick rate (or 0) every move is relayed as soon as it arrives.
+// With a tick rate, moves are gathered and sent to each match once per tick as a single snapshot.
+// With an interest radius, players only get those updates for dots within that many
+// pixels of their own, and hear about everything else every far-ms.
+// With --delta (tick mode), each client's snapshot only carries what changed since
+// the last one it acknowledged.
+// Positions go over UDP to every client that opens the channel; --no-udp keeps
+// everything on TCP.
+// With --authoritative the server runs the game: clients send the keys they hold
+// (MSG_INPUT), it moves every dot with the same code the client uses, checks for
+// the catch itself and broadcasts positions as tick snapshots (at
+// DEFAULT_AUTHORITATIVE_TICK if no rate is given). Each client also hears where
+// its own dot is as of its latest input, to correct its prediction.
+// Logging is written by a background thread (see Log.h), so it can stay on under
+// load; --log-level debug adds a line for every move.
+// --record writes every message received and sent to a file (see Recording.h).
+// --replay plays one back through the server instead of listening; see replay().
+// Run it with the same mode options the recording was made with.
+// --send-buffer shrinks each client socket's send buffer, so a client that reads
+// slowly backs messages up into our own queue sooner (LoadGen --backlog-check).
+void parseOptions(int argc, char ** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char* value = i + 1 < argc ? argv[i + 1] : "0";
+		if (strcmp(argv[i], "--tick") == 0) { options.tickRate = atoi(value); i++; }
+		else if (strcmp(argv[i], "--max-players") == 0) { options.maxPlayers = atoi(value); i++; }
+		else if (strcmp(argv[i], "--match-size") == 0) { options.matchSize = atoi(value); i++; }
+		else if (strcmp(argv[i], "--port") == 0) { options.port = (uint16_t)atoi(value); i++; }
+		else if (strcmp(argv[i], "--aoi-radius") == 0) { options.aoiRadius = atoi(value); i++; }
+		else if (strcmp(argv[i], "--far-ms") == 0) { options.farMs = (uint32_t)atoi(value); i++; }
+		else if (strcmp(argv[i], "--delta") == 0) options.delta = true;
+		else if (strcmp(argv[i], "--no-udp") == 0) options.udp = false;
+		else if (strcmp(argv[i], "--authoritative") == 0) options.authoritative = true;
+		else if (strcmp(argv[i], "--log-level") == 0) { parseLogLevel(value, options.logLevel); i++; }
+		else if (strcmp(argv[i], "--log-file") == 0) { options.logFile = value; i++; }
+		else if (strcmp(argv[i], "--record") == 0) { options.recordFile = value; i++; }
+		else if (strcmp(argv[i], "--replay") == 0) { options.replayFile = value; i++; }
+		else if (strcmp(argv[i], "--send-buffer") == 0) { options.sendBuffer = atoi(value); i++; }
+		else options.tickRate = atoi(argv[i]);
+	}
+	if (options.matchSize < 1)
+		options.matchSize = 1;
+	if (options.authoritative && options.tickRate <= 0)
+		options.tickRate = DEFAULT_AUTHORITATIVE_TICK;
+	if (options.maxPlayers > SlotMap<data*>::MAX_SLOTS)
+		options.maxPlayers = SlotMap<data*>::MAX_SLOTS;
+}
+
+int main (int argc, char ** argv)
+{
+	parseOptions(argc, argv);
+	tickLength = options.tickRate > 0 ? 1000 / options.tickRate : 0;
+
+	FILE* logOutput = stdout;
+	if (options.logFile != NULL && (logOutput = fopen(options.logFile, "a")) == NULL)
+	{
+		logOutput = stdout;
+		logWarning("Could not open {}; logging to stdout", options.logFile);
+	}
+	logStart(logOutput, options.logLevel);
+
+	std::signal(SIGINT, stop);
+	if (options.recordFile != NULL && !recorder.open(options.recordFile, RECORD_SERVER))
+		logWarning("Could not create {}; not recording", options.recordFile);
+	if (options.replayFile != NULL)
+	{
+		int result = replay();
+		recorder.close();
+		for (int i = 0; i < connections.size(); i++)
+			delete connections[i];
+		for (int m = 0; m < matches.size(); m++)
+			delete matches[m];
+		logStop();
+		if (logOutput != stdout)
+			fclose(logOutput);
+		return result;
+	}
+
+	if (!socketStartup() || !poller.open())
+	{
+		logError("Could not start networking");
+		logStop();
+		return 1;
+	}
+	// Past the open file limit accept fails, and with an edge-triggered listener everyone still
+	// queued behind it would wait forever. Turning players away below the limit means every
+	// connection is either taken or told to go.
+	int fileLimit = raiseFileLimit();
+	if (fileLimit > 0 && fileLimit < options.maxPlayers + RESERVED_FILES)
+	{
+		options.maxPlayers = fileLimit > RESERVED_FILES + 1 ? fileLimit - RESERVED_FILES : 1;
+		logWarning("Open file limit is {}; taking at most {} players", fileLimit, options.maxPlayers);
+	}
+
+	// The server itself
+	SocketHandle server = listenTcp(options.port);
+	if (server == INVALID_SOCKET_HANDLE)
+	{
+		logError("Could not listen on port {}", options.port);
+		logStop();
+		return 1;
+	}
+	poller.add(server, keyFor(INVALID_SLOT_HANDLE)); // no player has that handle
+
+	// Positions, on the same port number
+	if (options.udp)
+	{
+		udpSocket = openUdp(options.port);
+		if (udpSocket == INVALID_SOCKET_HANDLE)
+			logWarning("Could not open UDP port {}; positions will use TCP", options.port);
+		else
+			poller.add(udpSocket, keyFor(UDP_KEY));
+	}
+	tokenSource.seed(std::random_device()());
+
+	char tmp[MAX_MESSAGE_SIZE];
+	int length = 0;
+	PollEvent events[MAX_EVENTS];
+
+	// The poller sleeps until the nearest timer unless a socket needs attention first.
+	loopTime = nowMs();
+	setUpTimers(tmp);
+
+	while(running)
+	{
+		int timeout = timers.timeUntilNext(nowMs(), STATS_MS);
+		int count = poller.wait(events, MAX_EVENTS, timeout);
+		loopTime = nowMs();
+		if (recorder.isOpen())
+			recorder.record(RECORD_WAKE, RECORD_TCP, loopTime);
+		stats.wakeups++;
+		stats.events += count;
+
+		for (int e = 0; e < count; e++)
+		{
+			SlotHandle handle = handleFor(events[e].key);
+			if (handle == UDP_KEY)
 			{
-				sprintf(tmp, "2 %d \n", socketvector[j].id);
-				for (int k = 0; k < socketvector.size(); k++)
+				readUdp();
+				continue;
+			}
+			if (handle == INVALID_SLOT_HANDLE)
+			{// New connections. Take every one that is waiting.
+				SocketHandle tmpsocket;
+				while ((tmpsocket = acceptTcp(server)) != INVALID_SOCKET_HANDLE)
 				{
-					SDLNet_TCP_Send(socketvector[k].socket, tmp, strlen(tmp)+1);	
+					if (connections.size() >= options.maxPlayers)
+					{
+						length = encodeGameOver(tmp, SERVER_ID, WINNER_NONE);
+						socketSend(tmpsocket, tmp, length);
+						closeSocket(tmpsocket);
+						continue;
+					}
+
+					data* player = addPlayer(tmpsocket, tmp);
+					if (recorder.isOpen())
+						recorder.record(RECORD_OPEN, RECORD_TCP, player->id);
 				}
-				SDLNet_TCP_DelSocket(sockets, socketvector[j].socket);
-				SDLNet_TCP_Close(socketvector[j].socket);	
-				socketvector.erase(socketvector.begin()+j);
-				playernum--;	
+				continue;
 			}
-		SDL_Delay(1);	
-	}
-	for (int i = 0; i < socketvector.size(); i++)
-		SDLNet_TCP_Close(socketvector[i].socket);
-	SDLNet_FreeSocketSet(sockets);
-	SDLNet_TCP_Close(server);
-	SDLNet_Quit();
-	SDL_Quit();
-	
+
+			// Anything queued for a player who has since gone no longer resolves.
+			data** found = connections.find(handle);
+			if (found == NULL || (*found)->closing)
+				continue;
+			data* player = *found;
+			if (events[e].readable)
+				readFrom(player);
+			if (events[e].writable && !player->closing)
+				flushOutbound(player);
+			if (events[e].hangup && !player->closing)
+			{
+				if (recorder.isOpen())
+					recorder.record(RECORD_CLOSE, RECORD_TCP, player->id);
+				dropPlayer(player);
+			}
+		}
+
+		// Drops from this batch go first so timers never fire for a player who has already left.
+		reapClosed(tmp);
+		loopTime = nowMs();
+		if (recorder.isOpen())
+			recorder.record(RECORD_TIMERS, RECORD_TCP, loopTime);
+		timers.advance(loopTime);
+		reapClosed(tmp);
+	}
+	printStats();
+	recorder.close();
+	for (int i = 0; i < connections.size(); i++)
+	{
+		closeSocket(connections[i]->socket);
+		delete connections[i];
+	}
+	for (int m = 0; m < matches.size(); m++)
+		delete matches[m];
+	closeSocket(server);
+	if (udpSocket != INVALID_SOCKET_HANDLE)
+		closeSocket(udpSocket);
+	socketCleanup();
+
+	logStop();
+	if (logOutput != stdout)
+		fclose(logOutput);
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,202 @@
+#include "Collision.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLLISION_SSE2
+#include <emmintrin.h>
+#endif
+
+//Touching, as dotsCollide and dotsCollideSwept see it: the squared distance
+//is below this squared. The default reach.
+static const int TOUCH_DISTANCE = FIELD_DOT_SIZE + 1;
+
+//Extra sorted entries past the end, far from everything, so a four-wide load
+//at the last dot stays inside the arrays.
+static const int PADDING = 3;
+static const float FAR_AWAY = 1.0e6f;
+
+//How many cells at least reach wide fit across length. Two would make each
+//cell both neighbours of the other and count its pairs twice, so it's one then.
+static int cellsAcross(int length, int reach)
+{
+	int cells = length / reach;
+	return cells >= 3 ? cells : 1;
+}
+
+CollisionGrid::CollisionGrid()
+	: mReach(0), mColumns(0), mRows(0)
+{
+	clear(TOUCH_DISTANCE);
+}
+
+void CollisionGrid::clear()
+{
+	mX.clear();
+	mY.clear();
+}
+
+void CollisionGrid::clear(int reach)
+{
+	clear();
+	if (reach < 1)
+		reach = 1;
+	if (reach == mReach)
+		return;
+	mReach = reach;
+	mColumns = cellsAcross(FIELD_WIDTH, reach);
+	mRows = cellsAcross(FIELD_HEIGHT, reach);
+	mCellStart.assign(mColumns * mRows + 1, 0);
+}
+
+int CollisionGrid::add(int x, int y)
+{
+	mX.push_back(wrapFieldX(x));
+	mY.push_back(wrapFieldY(y));
+	return (int)mX.size() - 1;
+}
+
+int CollisionGrid::cellOf(int x, int y) const
+{
+	//Positions are already on the field. Cells split it evenly, so each is at
+	//least a reach wide and a pair within reach is never more than one apart.
+	int column = (x - FIELD_MIN_X) * mColumns / FIELD_WIDTH;
+	int row = (y - FIELD_MIN_Y) * mRows / FIELD_HEIGHT;
+	return row * mColumns + column;
+}
+
+//Counting sort by cell: every cell's dots end up next to each other, and
+//since cells are numbered row by row, so do whole runs of neighbouring cells.
+void CollisionGrid::sortIntoCells()
+{
+	int count = (int)mX.size();
+	int cells = mColumns * mRows;
+	mCellOfDot.resize(count);
+	std::fill(mCellStart.begin(), mCellStart.end(), 0);
+	for (int i = 0; i < count; i++)
+	{
+		mCellOfDot[i] = cellOf(mX[i], mY[i]);
+		mCellStart[mCellOfDot[i] + 1]++;
+	}
+	for (int c = 0; c < cells; c++)
+		mCellStart[c + 1] += mCellStart[c];
+
+	mSortedX.assign(count + PADDING, FAR_AWAY);
+	mSortedY.assign(count + PADDING, FAR_AWAY);
+	mSortedIndex.resize(count);
+	mCellNext.assign(mCellStart.begin(), mCellStart.end() - 1);
+	for (int i = 0; i < count; i++)
+	{
+		int slot = mCellNext[mCellOfDot[i]]++;
+		mSortedX[slot] = (float)mX[i];
+		mSortedY[slot] = (float)mY[i];
+		mSortedIndex[slot] = i;
+	}
+}
+
+//Tests sorted dot against sorted dots [begin, end).
+//Positions are floats so SSE2 can multiply them; every coordinate and squared
+//distance on the field is a small whole number, which floats hold exactly.
+//Each distance is the short way round: along an axis, whichever is less of
+//the gap and the field's length minus the gap.
+void CollisionGrid::testRange(int dot, int begin, int end, std::vector<Contact>& out) const
+{
+	int self = mSortedIndex[dot];
+	const float reachSquared = (float)(mReach * mReach);
+#ifdef COLLISION_SSE2
+	__m128 x = _mm_set1_ps(mSortedX[dot]);
+	__m128 y = _mm_set1_ps(mSortedY[dot]);
+	__m128 limit = _mm_set1_ps(reachSquared);
+	__m128 width = _mm_set1_ps((float)FIELD_WIDTH);
+	__m128 height = _mm_set1_ps((float)FIELD_HEIGHT);
+	__m128 sign = _mm_set1_ps(-0.0f);
+	for (int j = begin; j < end; j += 4)
+	{
+		__m128 dx = _mm_andnot_ps(sign, _mm_sub_ps(_mm_loadu_ps(&mSortedX[j]), x));
+		__m128 dy = _mm_andnot_ps(sign, _mm_sub_ps(_mm_loadu_ps(&mSortedY[j]), y));
+		dx = _mm_min_ps(dx, _mm_sub_ps(width, dx));
+		dy = _mm_min_ps(dy, _mm_sub_ps(height, dy));
+		__m128 distance = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		int touching = _mm_movemask_ps(_mm_cmplt_ps(distance, limit));
+		if (end - j < 4)
+			touching &= (1 << (end - j)) - 1;	//lanes past end belong to other cells
+		for (int lane = 0; touching != 0; lane++, touching >>= 1)
+		{
+			if (touching & 1)
+			{
+				int other = mSortedIndex[j + lane];
+				Contact contact = { self < other ? self : other, self < other ? other : self };
+				out.push_back(contact);
+			}
+		}
+	}
+#else
+	float x = mSortedX[dot];
+	float y = mSortedY[dot];
+	for (int j = begin; j < end; j++)
+	{
+		float dx = std::fabs(mSortedX[j] - x);
+		float dy = std::fabs(mSortedY[j] - y);
+		dx = std::min(dx, FIELD_WIDTH - dx);
+		dy = std::min(dy, FIELD_HEIGHT - dy);
+		if (dx * dx + dy * dy < reachSquared)
+		{
+			int other = mSortedIndex[j];
+			Contact contact = { self < other ? self : other, self < other ? other : self };
+			out.push_back(contact);
+		}
+	}
+#endif
+}
+
+void CollisionGrid::findContacts(std::vector<Contact>& out)
+{
+	out.clear();
+	sortIntoCells();
+
+	//Each pair is tested once, from whichever dot sorts first in its own cell,
+	//and from whichever cell has the other as one of its four forward
+	//neighbours: right, and the three below. The other four neighbours test it
+	//instead. Neighbours wrap round the edges. With a single column or row
+	//some of them are the cell itself or each other, so those are skipped.
+	//Only cells with dots in are visited, in order, by walking the sorted dots.
+	const int forward[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+	int count = (int)mX.size();
+	for (int first = 0; first < count;)
+	{
+		int cell = mCellOfDot[mSortedIndex[first]];
+		int row = cell / mColumns;
+		int column = cell % mColumns;
+		int end = mCellStart[cell + 1];
+
+		int neighbours[4];
+		int found = 0;
+		for (int n = 0; n < 4; n++)
+		{
+			if (forward[n][1] != 0 && mRows == 1)
+				continue;	//the row below is this one; right already covers it
+			int neighbour = (row + forward[n][1]) % mRows * mColumns + (column + forward[n][0] + mColumns) % mColumns;
+			bool seen = neighbour == cell;
+			for (int k = 0; k < found; k++)
+				seen = seen || neighbours[k] == neighbour;
+			if (!seen && mCellStart[neighbour] < mCellStart[neighbour + 1])
+				neighbours[found++] = neighbour;
+		}
+
+		for (int dot = first; dot < end; dot++)
+		{
+			testRange(dot, dot + 1, end, out);
+			for (int k = 0; k < found; k++)
+				testRange(dot, mCellStart[neighbours[k]], mCellStart[neighbours[k] + 1], out);
+		}
+		first = end;
+	}
+}
+
+int sweptReach(int travel)
+{
+	//Over the tick the gap between two dots changes by at most both their
+	//travels, so a pair that came within touching ends no further apart than this.
+	return TOUCH_DISTANCE + 2 * travel;
+}
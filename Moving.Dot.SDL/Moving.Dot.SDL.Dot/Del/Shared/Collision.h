@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "InterestGrid.h"
+
+//Two dots that are touching, by the indices CollisionGrid::add gave them. a < b.
+struct Contact
+{
+	int a;
+	int b;
+};
+
+//Finds every pair closer than a reach among a whole set of dots in one call.
+//Positions are kept as structure-of-arrays and bucketed into a uniform grid
+//of cells at least one reach wide (the broadphase), so a dot is only ever
+//tested against the dots in its own and neighbouring cells. Those tests (the
+//narrowphase) compare squared distances four dots at a time with SSE2 where
+//the compiler targets it. Like the field, the grid wraps: the cells on one
+//edge neighbour those on the other, and distances are measured the short way
+//round (fieldDeltaX/Y), so a pair touching across an edge is found too.
+//
+//The default reach is touching, as dotsCollideSwept sees two dots standing
+//still. For catches over a tick, fill it with where the dots ended up and a
+//reach of sweptReach(the furthest any of them moved): every pair
+//dotsCollideSwept could catch is among the contacts, so only those need it.
+//
+//Fill it each frame: clear(), add() every dot, then findContacts().
+class CollisionGrid
+{
+public:
+	CollisionGrid();
+
+	void clear();
+
+	//Empties it, and from now on pairs count if they're closer than reach.
+	void clear(int reach);
+
+	//Adds a dot with its top-left corner at (x, y). Returns its index, counting from 0.
+	int add(int x, int y);
+
+	int size() const { return (int)mX.size(); }
+
+	//Replaces the contents of out with every pair of dots closer than the reach. Order is unspecified.
+	void findContacts(std::vector<Contact>& out);
+
+private:
+	int cellOf(int x, int y) const;
+	void sortIntoCells();
+	void testRange(int dot, int begin, int end, std::vector<Contact>& out) const;
+
+	int mReach;
+	int mColumns;
+	int mRows;
+	std::vector<int> mX;			//as added, wrapped onto the field
+	std::vector<int> mY;
+	std::vector<int> mCellOfDot;	//as added
+	std::vector<int> mCellStart;	//first sorted index of each cell; one more entry marks the end
+	std::vector<int> mCellNext;		//while sorting: where the next dot in each cell goes
+	std::vector<float> mSortedX;	//positions sorted by cell, padded so four can always be loaded at once
+	std::vector<float> mSortedY;
+	std::vector<int> mSortedIndex;	//what add() returned for each sorted position
+};
+
+//The reach that finds every pair dotsCollideSwept could catch over a tick in
+//which no dot moved further than travel (its |dx| + |dy|, the short way round).
+int sweptReach(int travel);
@@ -0,0 +1,212 @@
+#include "DeltaSnapshot.h"
+
+#include <cstddef>
+
+const SnapshotEntry* WorldState::find(uint16_t id) const
+{
+	//Binary search; entries are kept sorted by id.
+	int low = 0;
+	int high = (int)entries.size() - 1;
+	while (low <= high)
+	{
+		int middle = (low + high) / 2;
+		if (entries[middle].id == id)
+			return &entries[middle];
+		if (entries[middle].id < id)
+			low = middle + 1;
+		else
+			high = middle - 1;
+	}
+	return NULL;
+}
+
+WorldState& SnapshotHistory::store(uint32_t tick)
+{
+	WorldState& state = mStates[tick % HISTORY_SIZE];
+	state.tick = tick;
+	state.entries.clear();
+	return state;
+}
+
+const WorldState* SnapshotHistory::find(uint32_t tick) const
+{
+	if (tick == NO_BASELINE)
+		return NULL;
+	const WorldState& state = mStates[tick % HISTORY_SIZE];
+	return state.tick == tick ? &state : NULL;
+}
+
+void SnapshotHistory::clear()
+{
+	for (int i = 0; i < HISTORY_SIZE; i++)
+		mStates[i].tick = NO_BASELINE;
+}
+
+//Writes one axis. Returns the bytes written and sets the flags that describe it.
+static int writeAxis(char* p, int16_t value, const int16_t* base, uint8_t& flags, uint8_t present, uint8_t small)
+{
+	flags |= present;
+	if (base != NULL)
+	{
+		int difference = value - *base;
+		if (difference >= -128 && difference <= 127)
+		{
+			flags |= small;
+			p[0] = (char)(int8_t)difference;
+			return 1;
+		}
+	}
+	writeS16(p, value);
+	return 2;
+}
+
+int encodeDelta(char* buffer, const WorldState& current, const WorldState* baseline)
+{
+	char* start = buffer + HEADER_SIZE;
+	char* end = buffer + MAX_MESSAGE_SIZE;
+	char* p = start + DELTA_HEADER_SIZE;
+	const int MAX_ENTRY_SIZE = 7;
+	int count = 0;
+
+	//Walk both sorted lists together: changed and new dots from current,
+	//removed ones from whatever is left over in the baseline.
+	size_t b = 0;
+	for (size_t i = 0; i < current.entries.size(); i++)
+	{
+		const SnapshotEntry& entry = current.entries[i];
+		const SnapshotEntry* old = NULL;
+		if (baseline != NULL)
+		{
+			while (b < baseline->entries.size() && baseline->entries[b].id < entry.id)
+			{
+				if (end - p < MAX_ENTRY_SIZE)
+					return -1;
+				writeU16(p, baseline->entries[b].id);
+				writeU8(p + 2, DELTA_REMOVED);
+				p += 3;
+				count++;
+				b++;
+			}
+			if (b < baseline->entries.size() && baseline->entries[b].id == entry.id)
+				old = &baseline->entries[b++];
+		}
+
+		bool xChanged = old == NULL || old->x != entry.x;
+		bool yChanged = old == NULL || old->y != entry.y;
+		if (!xChanged && !yChanged)
+			continue;
+
+		if (end - p < MAX_ENTRY_SIZE)
+			return -1;
+		uint8_t flags = 0;
+		char* q = p + 3;
+		if (xChanged)
+			q += writeAxis(q, entry.x, old != NULL ? &old->x : NULL, flags, DELTA_X, DELTA_X_SMALL);
+		if (yChanged)
+			q += writeAxis(q, entry.y, old != NULL ? &old->y : NULL, flags, DELTA_Y, DELTA_Y_SMALL);
+		writeU16(p, entry.id);
+		writeU8(p + 2, flags);
+		p = q;
+		count++;
+	}
+	if (baseline != NULL)
+	{
+		for (; b < baseline->entries.size(); b++)
+		{
+			if (end - p < MAX_ENTRY_SIZE)
+				return -1;
+			writeU16(p, baseline->entries[b].id);
+			writeU8(p + 2, DELTA_REMOVED);
+			p += 3;
+			count++;
+		}
+	}
+
+	if (count == 0 && baseline != NULL)
+		return 0;
+
+	int length = (int)(p - start);
+	writeHeader(buffer, MSG_DELTA, (uint16_t)length, SERVER_ID);
+	writeU32(start, current.tick);
+	writeU32(start + 4, baseline != NULL ? baseline->tick : NO_BASELINE);
+	writeU16(start + 8, (uint16_t)count);
+	return HEADER_SIZE + length;
+}
+
+bool readDeltaTicks(const char* payload, int length, uint32_t& tick, uint32_t& baseTick)
+{
+	if (length < DELTA_HEADER_SIZE)
+		return false;
+	tick = readU32(payload);
+	baseTick = readU32(payload + 4);
+	return true;
+}
+
+bool decodeDelta(const char* payload, int length, const WorldState* baseline, WorldState& out, std::vector<uint16_t>& removed)
+{
+	uint32_t tick, baseTick;
+	if (!readDeltaTicks(payload, length, tick, baseTick))
+		return false;
+	if ((baseTick == NO_BASELINE) != (baseline == NULL))
+		return false;
+
+	int count = readU16(payload + 8);
+	const char* p = payload + DELTA_HEADER_SIZE;
+	const char* end = payload + length;
+
+	//Entries are written in id order, so merge them into the baseline in one pass.
+	out.tick = tick;
+	out.entries.clear();
+	removed.clear();
+	size_t b = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (end - p < 3)
+			return false;
+		uint16_t id = readU16(p);
+		uint8_t flags = readU8(p + 2);
+		p += 3;
+
+		const SnapshotEntry* old = NULL;
+		if (baseline != NULL)
+		{
+			while (b < baseline->entries.size() && baseline->entries[b].id < id)
+				out.entries.push_back(baseline->entries[b++]);
+			if (b < baseline->entries.size() && baseline->entries[b].id == id)
+				old = &baseline->entries[b++];
+		}
+
+		if (flags & DELTA_REMOVED)
+		{
+			removed.push_back(id);
+			continue;
+		}
+
+		SnapshotEntry entry = { id, 0, 0 };
+		if (old != NULL)
+			entry = *old;
+		if (flags & DELTA_X)
+		{
+			int size = (flags & DELTA_X_SMALL) ? 1 : 2;
+			if (end - p < size || (size == 1 && old == NULL))
+				return false;
+			entry.x = size == 1 ? (int16_t)(entry.x + (int8_t)p[0]) : readS16(p);
+			p += size;
+		}
+		if (flags & DELTA_Y)
+		{
+			int size = (flags & DELTA_Y_SMALL) ? 1 : 2;
+			if (end - p < size || (size == 1 && old == NULL))
+				return false;
+			entry.y = size == 1 ? (int16_t)(entry.y + (int8_t)p[0]) : readS16(p);
+			p += size;
+		}
+		out.entries.push_back(entry);
+	}
+	if (baseline != NULL)
+	{
+		while (b < baseline->entries.size())
+			out.entries.push_back(baseline->entries[b++]);
+	}
+	return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+#include "Protocol.h"
+
+//Delta-compressed snapshots.
+//Each side keeps the last few world states by tick. The server encodes a
+//MSG_DELTA against the newest state the client has acknowledged with MSG_ACK,
+//so dots that haven't moved since then cost nothing and an axis that moved a
+//little costs one byte. With no usable baseline it sends every dot in full.
+//
+//MSG_DELTA payload:
+//  u32 tick
+//  u32 base tick (NO_BASELINE for a full snapshot)
+//  u16 count
+//  count entries: u16 id, u8 flags, then x and y if flagged. A changed axis is an
+//  s8 difference from the baseline if DELTA_X_SMALL / DELTA_Y_SMALL is set, an
+//  absolute s16 otherwise. Dots missing from the list are as they were.
+
+const uint32_t NO_BASELINE = 0xFFFFFFFF;
+const int DELTA_HEADER_SIZE = 10;
+
+enum DeltaFlags
+{
+	DELTA_X = 1,		//x is present.
+	DELTA_Y = 2,		//y is present.
+	DELTA_X_SMALL = 4,	//x is an s8 difference from the baseline.
+	DELTA_Y_SMALL = 8,	//y is an s8 difference from the baseline.
+	DELTA_REMOVED = 16	//The dot has left this client's view.
+};
+
+//Every dot one client can see at one tick, sorted by id.
+struct WorldState
+{
+	uint32_t tick;
+	std::vector<SnapshotEntry> entries;
+
+	WorldState() : tick(NO_BASELINE) {}
+	const SnapshotEntry* find(uint16_t id) const;
+};
+
+//The last HISTORY_SIZE world states, looked up by tick.
+class SnapshotHistory
+{
+public:
+	static const int HISTORY_SIZE = 32;
+
+	//The state to fill in for tick, replacing whatever was HISTORY_SIZE ticks ago.
+	WorldState& store(uint32_t tick);
+
+	//NULL if tick is NO_BASELINE or has already been replaced.
+	const WorldState* find(uint32_t tick) const;
+
+	void clear();
+
+private:
+	WorldState mStates[HISTORY_SIZE];
+};
+
+//Writes a MSG_DELTA for current against baseline (NULL for a full snapshot).
+//Returns the message length, 0 if nothing changed since the baseline, or -1
+//if it would not fit in MAX_MESSAGE_SIZE (send plain MSG_SNAPSHOTs instead).
+int encodeDelta(char* buffer, const WorldState& current, const WorldState* baseline);
+
+//Reads the ticks at the front of a MSG_DELTA payload, to pick the baseline.
+bool readDeltaTicks(const char* payload, int length, uint32_t& tick, uint32_t& baseTick);
+
+//Rebuilds the full state a MSG_DELTA describes. baseline must be the state for
+//its base tick (NULL when that is NO_BASELINE). Removed dots are listed in
+//removed rather than out, so the caller can tell them from dots that were
+//never sent. Returns false if the payload is malformed.
+bool decodeDelta(const char* payload, int length, const WorldState* baseline, WorldState& out, std::vector<uint16_t>& removed);
@@ -0,0 +1,65 @@
+#include "FrameBuffer.h"
+
+#include <cstring>
+
+FrameBuffer::FrameBuffer(int capacity)
+	: mData(capacity < MAX_MESSAGE_SIZE ? MAX_MESSAGE_SIZE : capacity), mRead(0), mWrite(0)
+{
+}
+
+char* FrameBuffer::writePtr()
+{
+	//Wrap around: move the leftover partial frame (if any) to the front so
+	//there is always room for a full message after it.
+	if ((int)mData.size() - mWrite < MAX_MESSAGE_SIZE && mRead > 0)
+	{
+		int unread = mWrite - mRead;
+		memmove(&mData[0], &mData[mRead], unread);
+		mRead = 0;
+		mWrite = unread;
+	}
+	return &mData[0] + mWrite;
+}
+
+int FrameBuffer::writeSpace()
+{
+	writePtr();
+	return (int)mData.size() - mWrite;
+}
+
+void FrameBuffer::commit(int bytes)
+{
+	if (bytes > 0)
+		mWrite += bytes;
+}
+
+FrameBuffer::Result FrameBuffer::next(MessageHeader& header, char*& message)
+{
+	int available = mWrite - mRead;
+	if (available < HEADER_SIZE)
+	{
+		if (available == 0)
+			mRead = mWrite = 0;
+		return FRAME_INCOMPLETE;
+	}
+
+	char* start = &mData[0] + mRead;
+	if (!readHeader(start, available, header))
+	{//A bad version or an impossible length means we have lost sync with the stream.
+		return FRAME_ERROR;
+	}
+
+	int size = messageSize(header);
+	if (size > available)
+		return FRAME_INCOMPLETE;
+
+	message = start;
+	mRead += size;
+	return FRAME_READY;
+}
+
+void FrameBuffer::clear()
+{
+	mRead = 0;
+	mWrite = 0;
+}
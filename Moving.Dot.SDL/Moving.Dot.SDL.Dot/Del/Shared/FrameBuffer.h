@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "Protocol.h"
+
+//Reassembles protocol messages from a TCP byte stream.
+//TCP does not preserve write boundaries: one recv can hold several messages,
+//or only part of one. Each connection owns one of these; bytes are received
+//straight into it and complete messages are handed out as pointers into the
+//buffer, so nothing is copied on the normal path.
+//
+//The buffer behaves like a ring that always keeps the unread region
+//contiguous. Once every complete frame has been drained the cursors jump back
+//to the start; if a partial frame is left near the end of the storage it is
+//moved to the front. That move is bounded by one message and only happens
+//when the writer runs out of room, so frames never straddle the wrap point.
+class FrameBuffer
+{
+public:
+	enum Result
+	{
+		FRAME_READY,		//A complete message is available.
+		FRAME_INCOMPLETE,	//Need more bytes before the next message is complete.
+		FRAME_ERROR			//The stream is corrupt; the connection should be dropped.
+	};
+
+	//capacity must be at least MAX_MESSAGE_SIZE.
+	explicit FrameBuffer(int capacity = 8 * MAX_MESSAGE_SIZE);
+
+	//Where the next recv should write to, and how many bytes it may write.
+	//Always at least MAX_MESSAGE_SIZE unless a corrupt stream filled the buffer.
+	char* writePtr();
+	int writeSpace();
+
+	//Marks bytes written at writePtr() as received.
+	void commit(int bytes);
+
+	//Pulls the next complete message out of the buffer. On FRAME_READY,
+	//message points at its header inside the buffer and stays valid until the
+	//next call to writePtr() or commit(). The message may be modified in place.
+	Result next(MessageHeader& header, char*& message);
+
+	//Bytes received but not yet handed out.
+	int pending() const { return mWrite - mRead; }
+
+	//Drops everything, e.g. when the slot is reused for a new connection.
+	void clear();
+
+private:
+	std::vector<char> mData;
+
+	//Offsets into mData. Unread bytes live in [mRead, mWrite).
+	int mRead;
+	int mWrite;
+};
@@ -0,0 +1,127 @@
+#include "InterestGrid.h"
+
+//Folds any coordinate back onto [0, period).
+static int wrap(int value, int period)
+{
+	value %= period;
+	return value < 0 ? value + period : value;
+}
+
+//Shortest distance between two coordinates on a wrapping axis.
+static int wrappedDelta(int a, int b, int period)
+{
+	int delta = wrap(a - b, period);
+	return delta > period / 2 ? period - delta : delta;
+}
+
+//Signed version of the above: negative when b is behind a.
+static int signedDelta(int a, int b, int period)
+{
+	int delta = wrap(b - a, period);
+	return delta > period / 2 ? delta - period : delta;
+}
+
+int fieldDeltaX(int from, int to)
+{
+	return signedDelta(from, to, FIELD_WIDTH);
+}
+
+int fieldDeltaY(int from, int to)
+{
+	return signedDelta(from, to, FIELD_HEIGHT);
+}
+
+int wrapFieldX(int x)
+{
+	return FIELD_MIN_X + wrap(x - FIELD_MIN_X, FIELD_WIDTH);
+}
+
+int wrapFieldY(int y)
+{
+	return FIELD_MIN_Y + wrap(y - FIELD_MIN_Y, FIELD_HEIGHT);
+}
+
+InterestGrid::InterestGrid(int cellSize)
+	: mCellSize(cellSize > 0 ? cellSize : 1)
+{
+	mColumns = (FIELD_WIDTH + mCellSize - 1) / mCellSize;
+	mRows = (FIELD_HEIGHT + mCellSize - 1) / mCellSize;
+	mCells.resize(mColumns * mRows);
+}
+
+int InterestGrid::cellOf(int x, int y) const
+{
+	int column = wrap(x - FIELD_MIN_X, FIELD_WIDTH) / mCellSize;
+	int row = wrap(y - FIELD_MIN_Y, FIELD_HEIGHT) / mCellSize;
+	return row * mColumns + column;
+}
+
+int InterestGrid::distanceSquared(int x1, int y1, int x2, int y2)
+{
+	int dx = wrappedDelta(x1, x2, FIELD_WIDTH);
+	int dy = wrappedDelta(y1, y2, FIELD_HEIGHT);
+	return dx * dx + dy * dy;
+}
+
+void InterestGrid::place(int id, int x, int y)
+{
+	if (id >= (int)mEntries.size())
+	{
+		Entry empty = { -1, 0, 0, 0 };
+		mEntries.resize(id + 1, empty);
+	}
+
+	Entry& entry = mEntries[id];
+	entry.x = x;
+	entry.y = y;
+	int cell = cellOf(x, y);
+	if (entry.cell == cell)
+		return;
+
+	remove(id);
+	entry.cell = cell;
+	entry.position = (int)mCells[cell].size();
+	mCells[cell].push_back(id);
+}
+
+void InterestGrid::remove(int id)
+{
+	if (!contains(id))
+		return;
+
+	//Swap the last ID in the cell into this one's place.
+	Entry& entry = mEntries[id];
+	std::vector<int>& cell = mCells[entry.cell];
+	int moved = cell.back();
+	cell[entry.position] = moved;
+	mEntries[moved].position = entry.position;
+	cell.pop_back();
+	entry.cell = -1;
+}
+
+void InterestGrid::query(int x, int y, int radius, std::vector<int>& out) const
+{
+	//One extra cell each way covers the narrower last row and column.
+	int reach = radius / mCellSize + 2;
+	int columns = 2 * reach + 1 < mColumns ? 2 * reach + 1 : mColumns;
+	int rows = 2 * reach + 1 < mRows ? 2 * reach + 1 : mRows;
+	int centre = cellOf(x, y);
+	int firstColumn = centre % mColumns - (columns - 1) / 2;
+	int firstRow = centre / mColumns - (rows - 1) / 2;
+	int radiusSquared = radius * radius;
+
+	for (int r = 0; r < rows; r++)
+	{
+		int row = wrap(firstRow + r, mRows);
+		for (int c = 0; c < columns; c++)
+		{
+			const std::vector<int>& cell = mCells[row * mColumns + wrap(firstColumn + c, mColumns)];
+			for (int i = 0; i < (int)cell.size(); i++)
+			{
+				const Entry& entry = mEntries[cell[i]];
+				if (distanceSquared(x, y, entry.x, entry.y) <= radiusSquared)
+					out.push_back(cell[i]);
+			}
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+//The play field as Dot::move sees it: a dot's top-left corner ranges over
+//[-DOT, SCREEN] on each axis and wraps from one edge to the other, so the
+//field is a torus slightly larger than the screen.
+const int FIELD_DOT_SIZE = 20;
+const int FIELD_MIN_X = -FIELD_DOT_SIZE;
+const int FIELD_MIN_Y = -FIELD_DOT_SIZE;
+const int FIELD_WIDTH = 640 + FIELD_DOT_SIZE;
+const int FIELD_HEIGHT = 480 + FIELD_DOT_SIZE;
+
+//Shortest signed distance from one coordinate to another along a wrapping axis.
+int fieldDeltaX(int from, int to);
+int fieldDeltaY(int from, int to);
+
+//Folds a coordinate back onto the field.
+int wrapFieldX(int x);
+int wrapFieldY(int y);
+
+//Uniform grid over the play field for area-of-interest queries.
+//Entities are small integer IDs (the caller's own numbering, e.g. a match
+//slot) with a position. Each cell keeps the IDs inside it, so finding who is
+//near a point only looks at the handful of cells the radius touches instead
+//of every entity. Distances wrap the way dots do.
+class InterestGrid
+{
+public:
+	explicit InterestGrid(int cellSize = 80);
+
+	//Adds the entity, or moves it if it is already in the grid.
+	void place(int id, int x, int y);
+	void remove(int id);
+	bool contains(int id) const { return id < (int)mEntries.size() && mEntries[id].cell >= 0; }
+
+	//Appends every entity within radius of (x, y) to out, including one at
+	//(x, y) itself. Order is unspecified.
+	void query(int x, int y, int radius, std::vector<int>& out) const;
+
+	//Wrapped squared distance between two field positions.
+	static int distanceSquared(int x1, int y1, int x2, int y2);
+
+private:
+	struct Entry
+	{
+		int cell;		//-1 when not in the grid
+		int position;	//index in that cell's list
+		int x;
+		int y;
+	};
+
+	int cellOf(int x, int y) const;
+
+	int mCellSize;
+	int mColumns;
+	int mRows;
+	std::vector<Entry> mEntries;			//by ID
+	std::vector<std::vector<int> > mCells;	//IDs in each cell
+};
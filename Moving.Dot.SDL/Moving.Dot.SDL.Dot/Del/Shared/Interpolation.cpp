@@ -0,0 +1,78 @@
+#include "Interpolation.h"
+
+#include "InterestGrid.h"
+
+InterpolationBuffer::InterpolationBuffer()
+	: mFirst(0), mCount(0)
+{
+}
+
+void InterpolationBuffer::add(uint32_t time, int x, int y)
+{
+	PositionSample sample = { time, (int16_t)x, (int16_t)y };
+	if (mCount > 0 && at(mCount - 1).time == time)
+	{
+		mSamples[(mFirst + mCount - 1) % CAPACITY] = sample;
+		return;
+	}
+	if (mCount == CAPACITY)
+	{
+		mFirst = (mFirst + 1) % CAPACITY;
+		mCount--;
+	}
+	mSamples[(mFirst + mCount) % CAPACITY] = sample;
+	mCount++;
+}
+
+//Position part of the way from a to b, going the short way round the field.
+//step and steps may run past each other to extrapolate.
+static void blend(const PositionSample& a, const PositionSample& b, int step, int steps, int& x, int& y)
+{
+	int dx = fieldDeltaX(a.x, b.x);
+	int dy = fieldDeltaY(a.y, b.y);
+	if (steps <= 0 || dx > InterpolationBuffer::SNAP_DISTANCE || dx < -InterpolationBuffer::SNAP_DISTANCE ||
+		dy > InterpolationBuffer::SNAP_DISTANCE || dy < -InterpolationBuffer::SNAP_DISTANCE)
+	{//Teleported, or no time between them: nothing to slide along.
+		x = step < steps ? a.x : b.x;
+		y = step < steps ? a.y : b.y;
+		return;
+	}
+	x = wrapFieldX(a.x + dx * step / steps);
+	y = wrapFieldY(a.y + dy * step / steps);
+}
+
+bool InterpolationBuffer::sample(uint32_t time, uint32_t extrapolateMs, int& x, int& y) const
+{
+	if (mCount == 0)
+		return false;
+
+	const PositionSample& oldest = at(0);
+	const PositionSample& newest = at(mCount - 1);
+	if ((int32_t)(time - oldest.time) <= 0 || mCount == 1)
+	{
+		const PositionSample& only = (int32_t)(time - oldest.time) <= 0 ? oldest : newest;
+		x = only.x;
+		y = only.y;
+		return true;
+	}
+
+	if ((int32_t)(time - newest.time) >= 0)
+	{//Nothing newer has arrived yet. Keep going the way it was, for a little while.
+		const PositionSample& previous = at(mCount - 2);
+		uint32_t ahead = time - newest.time;
+		if (ahead > extrapolateMs)
+			ahead = extrapolateMs;
+		int steps = (int)(newest.time - previous.time);
+		blend(previous, newest, steps + (int)ahead, steps, x, y);
+		return true;
+	}
+
+	//Newest first: the render time is usually near the end.
+	int i = mCount - 2;
+	while (i > 0 && (int32_t)(time - at(i).time) < 0)
+		i--;
+	const PositionSample& before = at(i);
+	const PositionSample& after = at(i + 1);
+	blend(before, after, (int)(time - before.time), (int)(after.time - before.time), x, y);
+	return true;
+}
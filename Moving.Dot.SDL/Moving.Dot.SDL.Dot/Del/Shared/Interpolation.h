@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+//Smoothing for dots that belong to other players.
+//Positions arrive whenever the network gets round to delivering them: some
+//close together, some late, some not at all. Instead of drawing each one the
+//moment it lands, the client keeps the last few with the time they arrived
+//and draws the dot a fixed delay in the past, in between the two positions
+//either side of that moment. As long as the delay covers the usual gap
+//between positions the dot moves smoothly; if the next one is late, the dot
+//carries on the way it was going for a short while before stopping.
+//
+//Positions are on the wrapping field, so a dot leaving one edge slides in at
+//the other instead of sweeping back across the screen.
+
+struct PositionSample
+{
+	uint32_t time;	//ms, on the caller's clock
+	int16_t x;
+	int16_t y;
+};
+
+class InterpolationBuffer
+{
+public:
+	static const int CAPACITY = 32;
+
+	//Jumps further than this are drawn as jumps, not slides.
+	static const int SNAP_DISTANCE = 100;
+
+	InterpolationBuffer();
+
+	//Records where the dot was at time. Times must not go backwards; a sample
+	//at the same time as the newest replaces it.
+	void add(uint32_t time, int x, int y);
+
+	//Where to draw the dot at time (normally now minus the interpolation delay).
+	//Past the newest sample it extrapolates for at most extrapolateMs. Returns
+	//false if there are no samples yet.
+	bool sample(uint32_t time, uint32_t extrapolateMs, int& x, int& y) const;
+
+	void clear() { mCount = 0; }
+	bool empty() const { return mCount == 0; }
+
+private:
+	const PositionSample& at(int index) const { return mSamples[(mFirst + index) % CAPACITY]; }
+
+	PositionSample mSamples[CAPACITY];
+	int mFirst;
+	int mCount;
+};
@@ -0,0 +1,257 @@
+#include "Log.h"
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string.h>
+
+#include "SpscQueue.h"
+
+std::atomic<int> logLevel(LOG_INFO);
+
+namespace
+{
+	//Per thread, about 200KB. The writer empties it every IDLE_MS at worst, so
+	//a thread can log a couple of hundred thousand records a second before any drop.
+	const int RING_RECORDS = 1024;
+
+	//How long the writer sleeps when every ring is empty. Producers never wake it.
+	const int IDLE_MS = 5;
+
+	struct LogRecord
+	{
+		uint64_t time;		//us since the clock below started
+		const char* format;
+		uint8_t level;
+		uint8_t count;
+		LogArg args[LOG_MAX_ARGS];
+	};
+
+	struct LogRing
+	{
+		SpscQueue<LogRecord, RING_RECORDS> records;
+		std::atomic<uint32_t> dropped;
+
+		LogRing() : dropped(0) {}
+	};
+
+	const char* LEVEL_NAMES[] = { "DEBUG", "INFO ", "WARN ", "ERROR" };
+
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	//Every thread's ring. A thread adds its own the first time it logs; they
+	//are kept until the program exits, since the thread may log again.
+	std::mutex ringsLock;
+	std::vector<LogRing*> rings;
+
+	std::mutex outputLock;	//Only for writing straight away, when the writer isn't running.
+	FILE* output = stdout;
+	std::atomic<bool> started(false);
+	std::atomic<bool> running(false);
+	std::thread writer;
+
+	thread_local LogRing* threadRing = NULL;
+
+	uint64_t nowUs()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+	}
+
+	LogRing* ringForThisThread()
+	{
+		if (threadRing == NULL)
+		{
+			threadRing = new LogRing();
+			std::lock_guard<std::mutex> lock(ringsLock);
+			rings.push_back(threadRing);
+		}
+		return threadRing;
+	}
+
+	//Appends at most space - 1 characters and keeps the text terminated. Returns
+	//how many were appended.
+	int append(char* out, int space, const char* text, int length)
+	{
+		if (length > space - 1)
+			length = space - 1;
+		if (length > 0)
+			memcpy(out, text, length);
+		out[length > 0 ? length : 0] = '\0';
+		return length > 0 ? length : 0;
+	}
+
+	int appendArg(char* out, int space, const LogArg& arg)
+	{
+		char text[32];
+		int length = 0;
+		switch (arg.type)
+		{
+		case LOG_ARG_INT: length = snprintf(text, sizeof(text), "%lld", (long long)arg.i); break;
+		case LOG_ARG_UINT: length = snprintf(text, sizeof(text), "%llu", (unsigned long long)arg.u); break;
+		case LOG_ARG_DOUBLE: length = snprintf(text, sizeof(text), "%.3f", arg.d); break;
+		case LOG_ARG_STRING: return append(out, space, arg.s != NULL ? arg.s : "(null)", (int)strlen(arg.s != NULL ? arg.s : "(null)"));
+		}
+		return append(out, space, text, length);
+	}
+
+	//One line, newline included. Returns its length.
+	int formatRecord(const LogRecord& record, char* out, int space)
+	{
+		int used = snprintf(out, space, "%11.6f %s ", record.time / 1000000.0, LEVEL_NAMES[record.level]);
+		if (used < 0 || used >= space)
+			return 0;
+
+		int next = 0;
+		for (const char* p = record.format; *p != '\0'; p++)
+		{
+			if (p[0] == '{' && p[1] == '}' && next < record.count)
+			{
+				used += appendArg(out + used, space - used, record.args[next++]);
+				p++;
+			}
+			else
+				used += append(out + used, space - used, p, 1);
+		}
+		used += append(out + used, space - used, "\n", 1);
+		return used;
+	}
+
+	//Writes everything queued so far, oldest first across all the rings.
+	//Returns false if there was nothing.
+	bool drain()
+	{
+		static char batch[16384];
+		const int LINE = 512;
+		int used = 0;
+		bool any = false;
+
+		//A copy, so a thread logging for the first time doesn't wait for the whole batch.
+		static std::vector<LogRing*> current;
+		{
+			std::lock_guard<std::mutex> lock(ringsLock);
+			current = rings;
+		}
+
+		for (size_t i = 0; i < current.size(); i++)
+		{
+			uint32_t dropped = current[i]->dropped.exchange(0, std::memory_order_relaxed);
+			if (dropped > 0)
+			{
+				used += snprintf(batch + used, sizeof(batch) - used, "%11.6f WARN  %u log records dropped\n", nowUs() / 1000000.0, dropped);
+				any = true;
+			}
+		}
+		for (;;)
+		{
+			LogRing* oldest = NULL;
+			for (size_t i = 0; i < current.size(); i++)
+			{
+				LogRecord* record = current[i]->records.front();
+				if (record != NULL && (oldest == NULL || record->time < oldest->records.front()->time))
+					oldest = current[i];
+			}
+			if (oldest == NULL)
+				break;
+
+			if ((int)sizeof(batch) - used < LINE)
+			{
+				fwrite(batch, 1, used, output);
+				used = 0;
+			}
+			used += formatRecord(*oldest->records.front(), batch + used, LINE);
+			oldest->records.release();
+			any = true;
+		}
+		if (used > 0)
+			fwrite(batch, 1, used, output);
+		if (any)
+			fflush(output);
+		return any;
+	}
+
+	void writerMain()
+	{
+		while (running.load(std::memory_order_acquire))
+		{
+			if (!drain())
+				std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_MS));
+		}
+		drain();
+	}
+}
+
+void logStart(FILE* out, LogLevel level)
+{
+	if (started.load(std::memory_order_acquire))
+		return;
+	output = out;
+	setLogLevel(level);
+	running.store(true, std::memory_order_release);
+	writer = std::thread(writerMain);
+	started.store(true, std::memory_order_release);
+}
+
+void logStop()
+{
+	if (!started.load(std::memory_order_acquire))
+		return;
+	started.store(false, std::memory_order_release);
+	running.store(false, std::memory_order_release);
+	writer.join();
+}
+
+void setLogLevel(LogLevel level)
+{
+	logLevel.store(level, std::memory_order_relaxed);
+}
+
+bool parseLogLevel(const char* name, LogLevel& level)
+{
+	const char* names[] = { "debug", "info", "warning", "error", "off" };
+	for (int i = 0; i <= LOG_OFF; i++)
+	{
+		if (strcmp(name, names[i]) == 0)
+		{
+			level = (LogLevel)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void logSubmit(LogLevel level, const char* format, const LogArg* args, int count)
+{
+	if (count > LOG_MAX_ARGS)
+		count = LOG_MAX_ARGS;
+
+	if (!started.load(std::memory_order_acquire))
+	{//No writer: format it here.
+		LogRecord record;
+		record.time = nowUs();
+		record.format = format;
+		record.level = (uint8_t)level;
+		record.count = (uint8_t)count;
+		memcpy(record.args, args, count * sizeof(LogArg));
+		char line[512];
+		int length = formatRecord(record, line, sizeof(line));
+		std::lock_guard<std::mutex> lock(outputLock);
+		fwrite(line, 1, length, output);
+		fflush(output);
+		return;
+	}
+
+	LogRing* ring = ringForThisThread();
+	LogRecord* record = ring->records.claim();
+	if (record == NULL)
+	{
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	record->time = nowUs();
+	record->format = format;
+	record->level = (uint8_t)level;
+	record->count = (uint8_t)count;
+	memcpy(record->args, args, count * sizeof(LogArg));
+	ring->records.publish();
+}
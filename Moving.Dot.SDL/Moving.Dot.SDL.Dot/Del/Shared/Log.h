@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+
+//Asynchronous, level-filtered logging.
+//A log call doesn't format or write anything. It copies the level, the time,
+//a pointer to the format string and the raw argument values into a fixed-size
+//record in its thread's own ring (an SpscQueue), and returns. A background
+//thread takes records from every ring, formats them and writes them out in
+//batches. A call below the current level costs one relaxed load and a branch.
+//
+//Formats use {} for each argument, in order:
+//
+//  logInfo("Disconnected: {} (match {})", player->id, match->id);
+//
+//Arguments may be integers, floating point or strings. Strings are kept as
+//pointers, so they must still be around when the record is written; literals
+//are fine, buffers that get reused are not.
+//
+//Records are never waited for. If a thread logs faster than the writer keeps
+//up and its ring fills, new records are dropped and the writer reports how
+//many. Until logStart() is called (and after logStop()) records are formatted
+//and written straight away on the calling thread instead.
+
+enum LogLevel
+{
+	LOG_DEBUG,
+	LOG_INFO,
+	LOG_WARNING,
+	LOG_ERROR,
+	LOG_OFF
+};
+
+const int LOG_MAX_ARGS = 12;
+
+enum LogArgType
+{
+	LOG_ARG_INT,
+	LOG_ARG_UINT,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_STRING
+};
+
+struct LogArg
+{
+	uint8_t type;
+	union
+	{
+		int64_t i;
+		uint64_t u;
+		double d;
+		const char* s;
+	};
+};
+
+inline LogArg logArg(int v) { LogArg a; a.type = LOG_ARG_INT; a.i = v; return a; }
+inline LogArg logArg(long v) { LogArg a; a.type = LOG_ARG_INT; a.i = v; return a; }
+inline LogArg logArg(long long v) { LogArg a; a.type = LOG_ARG_INT; a.i = v; return a; }
+inline LogArg logArg(unsigned int v) { LogArg a; a.type = LOG_ARG_UINT; a.u = v; return a; }
+inline LogArg logArg(unsigned long v) { LogArg a; a.type = LOG_ARG_UINT; a.u = v; return a; }
+inline LogArg logArg(unsigned long long v) { LogArg a; a.type = LOG_ARG_UINT; a.u = v; return a; }
+inline LogArg logArg(double v) { LogArg a; a.type = LOG_ARG_DOUBLE; a.d = v; return a; }
+inline LogArg logArg(const char* v) { LogArg a; a.type = LOG_ARG_STRING; a.s = v; return a; }
+
+extern std::atomic<int> logLevel;
+
+//Starts the writer thread. Records at level and above are written to out.
+void logStart(FILE* out = stdout, LogLevel level = LOG_INFO);
+
+//Writes everything still queued and stops the writer thread.
+void logStop();
+
+void setLogLevel(LogLevel level);
+
+//"debug", "info", "warning", "error" or "off". Returns false for anything else.
+bool parseLogLevel(const char* name, LogLevel& level);
+
+inline bool logEnabled(LogLevel level) { return level >= logLevel.load(std::memory_order_relaxed); }
+
+//Queues one record. Use the templates below rather than calling this directly.
+void logSubmit(LogLevel level, const char* format, const LogArg* args, int count);
+
+template <typename... Args>
+inline void logWrite(LogLevel level, const char* format, Args... args)
+{
+	static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+	if (!logEnabled(level))
+		return;
+	LogArg values[sizeof...(Args) + 1] = { logArg(args)... };
+	logSubmit(level, format, values, (int)sizeof...(Args));
+}
+
+template <typename... Args>
+inline void logDebug(const char* format, Args... args) { logWrite(LOG_DEBUG, format, args...); }
+template <typename... Args>
+inline void logInfo(const char* format, Args... args) { logWrite(LOG_INFO, format, args...); }
+template <typename... Args>
+inline void logWarning(const char* format, Args... args) { logWrite(LOG_WARNING, format, args...); }
+template <typename... Args>
+inline void logError(const char* format, Args... args) { logWrite(LOG_ERROR, format, args...); }
@@ -0,0 +1,83 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile()
+	: mData(NULL), mSize(0), mMapping(NULL)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char* path, bool sequential)
+{
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);	//The mapping keeps the file open.
+	if (mapping == NULL)
+		return false;
+	mData = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (mData == NULL)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+	mMapping = mapping;
+	mSize = (size_t)size.QuadPart;
+#else
+	int file = ::open(path, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		::close(file);
+		return false;
+	}
+	void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);	//The mapping keeps the file open.
+	if (data == MAP_FAILED)
+		return false;
+	if (sequential)
+		madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+	mData = (const char*)data;
+	mSize = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mData != NULL)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(mData);
+		CloseHandle((HANDLE)mMapping);
+#else
+		munmap((void*)mData, mSize);
+#endif
+	}
+	mData = NULL;
+	mMapping = NULL;
+	mSize = 0;
+}
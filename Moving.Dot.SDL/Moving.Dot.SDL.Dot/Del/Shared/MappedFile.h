@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+
+//A whole file mapped read-only into memory.
+//Reading through the mapping never copies or buffers the file, however large:
+//the OS pages it in as it is touched, and pages it shares with other processes
+//mapping the same file. Recordings (Recording.h) and the client's asset pack
+//are read this way.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	//The mapping belongs to this object alone.
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	//Maps the file. sequential tells the OS it will be read front to back, so
+	//it can read ahead. Returns false if it can't be opened or is empty.
+	bool open(const char* path, bool sequential = false);
+	void close();
+
+	bool isOpen() const { return mData != NULL; }
+	const char* data() const { return mData; }
+	size_t size() const { return mSize; }
+
+private:
+	const char* mData;
+	size_t mSize;
+	void* mMapping;		//Windows: the file mapping's handle
+};
@@ -0,0 +1,153 @@
+#include "Poller.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+
+Poller::Poller() : mEpoll(-1)
+{
+}
+
+Poller::~Poller()
+{
+	if (mEpoll >= 0)
+		close(mEpoll);
+}
+
+bool Poller::open()
+{
+	mEpoll = epoll_create1(0);
+	return mEpoll >= 0;
+}
+
+bool Poller::add(SocketHandle socket, void* key)
+{
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+	event.data.ptr = key;
+	return epoll_ctl(mEpoll, EPOLL_CTL_ADD, socket, &event) == 0;
+}
+
+bool Poller::setWritable(SocketHandle socket, void* key, bool wantWrite)
+{
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (wantWrite ? (uint32_t)EPOLLOUT : 0u);
+	event.data.ptr = key;
+	return epoll_ctl(mEpoll, EPOLL_CTL_MOD, socket, &event) == 0;
+}
+
+void Poller::remove(SocketHandle socket)
+{
+	epoll_event unused;
+	epoll_ctl(mEpoll, EPOLL_CTL_DEL, socket, &unused);
+}
+
+int Poller::wait(PollEvent* events, int maxEvents, int timeoutMs)
+{
+	const int BATCH = 256;
+	epoll_event ready[BATCH];
+	if (maxEvents > BATCH)
+		maxEvents = BATCH;
+
+	int count = epoll_wait(mEpoll, ready, maxEvents, timeoutMs);
+	if (count < 0)
+		return 0; //EINTR; the caller just goes round again.
+
+	for (int i = 0; i < count; i++)
+	{
+		events[i].key = ready[i].data.ptr;
+		events[i].readable = (ready[i].events & (EPOLLIN | EPOLLRDHUP)) != 0;
+		events[i].writable = (ready[i].events & EPOLLOUT) != 0;
+		events[i].hangup = (ready[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+	}
+	return count;
+}
+
+#else
+
+#ifdef _WIN32
+#define pollSockets WSAPoll
+#else
+#define pollSockets poll
+#endif
+
+Poller::Poller()
+{
+}
+
+Poller::~Poller()
+{
+}
+
+bool Poller::open()
+{
+	return true;
+}
+
+int Poller::find(SocketHandle socket)
+{
+	for (int i = 0; i < (int)mFds.size(); i++)
+		if (mFds[i].fd == socket)
+			return i;
+	return -1;
+}
+
+bool Poller::add(SocketHandle socket, void* key)
+{
+	PollFd fd;
+	fd.fd = socket;
+	fd.events = POLLIN;
+	fd.revents = 0;
+	mFds.push_back(fd);
+	mKeys.push_back(key);
+	return true;
+}
+
+bool Poller::setWritable(SocketHandle socket, void* key, bool wantWrite)
+{
+	int i = find(socket);
+	if (i < 0)
+		return false;
+	mFds[i].events = POLLIN | (wantWrite ? POLLOUT : 0);
+	mKeys[i] = key;
+	return true;
+}
+
+void Poller::remove(SocketHandle socket)
+{
+	int i = find(socket);
+	if (i < 0)
+		return;
+	//Order doesn't matter, so swap with the last entry instead of shifting.
+	mFds[i] = mFds.back();
+	mKeys[i] = mKeys.back();
+	mFds.pop_back();
+	mKeys.pop_back();
+}
+
+int Poller::wait(PollEvent* events, int maxEvents, int timeoutMs)
+{
+	if (mFds.empty())
+		return 0;
+
+	int result = pollSockets(&mFds[0], (unsigned long)mFds.size(), timeoutMs);
+	if (result <= 0)
+		return 0;
+
+	int count = 0;
+	for (int i = 0; i < (int)mFds.size() && count < maxEvents; i++)
+	{
+		short revents = mFds[i].revents;
+		if (revents == 0)
+			continue;
+		events[count].key = mKeys[i];
+		events[count].readable = (revents & POLLIN) != 0;
+		events[count].writable = (revents & POLLOUT) != 0;
+		events[count].hangup = (revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+		count++;
+	}
+	return count;
+}
+
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include "Socket.h"
+
+#ifndef __linux__
+#ifdef _WIN32
+typedef WSAPOLLFD PollFd;
+#else
+#include <poll.h>
+typedef pollfd PollFd;
+#endif
+#endif
+
+//One readiness notification. key is whatever was passed to add().
+struct PollEvent
+{
+	void* key;
+	bool readable;
+	bool writable;
+	bool hangup;	//Error or hang-up; the connection should be dropped.
+};
+
+//Socket readiness notification.
+//On Linux this is edge-triggered epoll: the server only wakes for sockets that
+//have something to do, and a wakeup costs the same whether ten or ten thousand
+//sockets are connected. Elsewhere it falls back to (WSA)poll, which is
+//level-triggered; the server always reads and writes until SOCKET_AGAIN, so it
+//behaves the same with either.
+class Poller
+{
+public:
+	Poller();
+	~Poller();
+
+	bool open();
+
+	//Watches socket for reads. key is handed back in every PollEvent for it.
+	bool add(SocketHandle socket, void* key);
+
+	//Turns write notifications on or off; only wanted while output is queued.
+	bool setWritable(SocketHandle socket, void* key, bool wantWrite);
+
+	//Stops watching socket. Call before closing it.
+	void remove(SocketHandle socket);
+
+	//Waits up to timeoutMs (-1 = forever) and fills events. Returns how many.
+	int wait(PollEvent* events, int maxEvents, int timeoutMs);
+
+private:
+#ifdef __linux__
+	int mEpoll;
+#else
+	std::vector<PollFd> mFds;
+	std::vector<void*> mKeys;
+
+	int find(SocketHandle socket);
+#endif
+};
@@ -0,0 +1,57 @@
+#include "Prediction.h"
+
+#include "InterestGrid.h"
+#include "Protocol.h"
+
+InputBuffer::InputBuffer()
+	: mFirst(0), mCount(0), mNextSequence(1)
+{
+}
+
+uint32_t InputBuffer::record(int velX, int velY)
+{
+	if (mCount == CAPACITY)
+	{
+		mFirst = (mFirst + 1) % CAPACITY;
+		mCount--;
+	}
+
+	InputCommand& command = mCommands[(mFirst + mCount) % CAPACITY];
+	command.sequence = mNextSequence++;
+	command.velX = (int8_t)velX;
+	command.velY = (int8_t)velY;
+	mCount++;
+
+	if (mNextSequence == 0)
+		mNextSequence = 1;
+	return command.sequence;
+}
+
+void InputBuffer::acknowledge(uint32_t sequence)
+{
+	while (mCount > 0 && !sequenceNewer(mCommands[mFirst].sequence, sequence))
+	{
+		mFirst = (mFirst + 1) % CAPACITY;
+		mCount--;
+	}
+}
+
+//Clamps one axis. Returns true if the value was already within reach.
+static bool limitAxis(int from, int& value, int reach, int delta)
+{
+	if (delta >= -reach && delta <= reach)
+		return true;
+	value = from + (delta < 0 ? -reach : reach);
+	return false;
+}
+
+bool limitMove(int fromX, int fromY, int& x, int& y, int reach)
+{
+	bool xFine = limitAxis(fromX, x, reach, fieldDeltaX(fromX, x));
+	bool yFine = limitAxis(fromY, y, reach, fieldDeltaY(fromY, y));
+	if (xFine && yFine)
+		return true;
+	x = wrapFieldX(x);
+	y = wrapFieldY(y);
+	return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+//Client-side prediction.
+//The local dot moves the moment a key is pressed; the server only hears about
+//it half a round trip later. Each frame's input is numbered and sent along
+//with the position it produced (MSG_MOVE), and the client keeps the inputs the
+//server has not confirmed yet in an InputBuffer. If the server disagrees it
+//sends a MSG_CORRECTION: where the dot was as of one of those inputs. The
+//client puts the dot there and replays every newer input on top, so the dot
+//lands where it would have been had the server agreed all along, without the
+//player waiting on the network for anything.
+
+//How far a dot moves along each axis per frame (Dot::DOT_VEL on the client).
+const int DOT_SPEED = 2;
+
+//Frames per second the client runs at, and so inputs per second.
+const int FRAMES_PER_SECOND = 60;
+
+//Most frames the server will believe one MSG_MOVE covers.
+const uint32_t MAX_FRAMES_PER_MOVE = 120;
+
+//One frame's worth of input: the dot's velocity during that frame.
+struct InputCommand
+{
+	uint32_t sequence;
+	int8_t velX;
+	int8_t velY;
+};
+
+//Inputs the server hasn't confirmed yet, oldest first.
+//Once CAPACITY inputs are waiting the oldest are forgotten; a correction for
+//an input that old is already a couple of seconds late, and replaying what is
+//left still gets the dot close enough for the next correction to finish the job.
+class InputBuffer
+{
+public:
+	static const int CAPACITY = 128;
+
+	InputBuffer();
+
+	//Numbers and keeps this frame's input. Returns its sequence number, never 0.
+	uint32_t record(int velX, int velY);
+
+	//Forgets every input up to and including sequence.
+	void acknowledge(uint32_t sequence);
+
+	int size() const { return mCount; }
+	const InputCommand& operator[](int index) const { return mCommands[(mFirst + index) % CAPACITY]; }
+
+private:
+	InputCommand mCommands[CAPACITY];
+	int mFirst;
+	int mCount;
+	uint32_t mNextSequence;
+};
+
+//Pulls (x, y) back to within reach pixels of (fromX, fromY) on each axis,
+//measured the way the field wraps. Returns false if it had to.
+bool limitMove(int fromX, int fromY, int& x, int& y, int reach);
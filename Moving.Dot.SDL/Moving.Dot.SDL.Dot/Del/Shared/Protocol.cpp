@@ -0,0 +1,236 @@
+#include "Protocol.h"
+
+int writeHeader(char* buffer, uint8_t type, uint16_t length, uint16_t sender)
+{
+	writeU8(buffer, PROTOCOL_VERSION);
+	writeU8(buffer + 1, type);
+	writeU16(buffer + 2, length);
+	writeU16(buffer + 4, sender);
+	return HEADER_SIZE;
+}
+
+bool readHeader(const char* data, int size, MessageHeader& out)
+{
+	if (size < HEADER_SIZE)
+		return false;
+
+	out.version = readU8(data);
+	out.type = readU8(data + 1);
+	out.length = readU16(data + 2);
+	out.sender = readU16(data + 4);
+
+	//Reject anything we would not be able to build ourselves.
+	return out.version == PROTOCOL_VERSION && out.length <= MAX_PAYLOAD_SIZE;
+}
+
+int writeDatagramPrefix(char* buffer, uint32_t token, uint32_t sequence)
+{
+	writeU32(buffer, token);
+	writeU32(buffer + 4, sequence);
+	return DATAGRAM_PREFIX_SIZE;
+}
+
+bool readDatagram(const char* data, int size, uint32_t& token, uint32_t& sequence, MessageHeader& out)
+{
+	if (size < DATAGRAM_PREFIX_SIZE)
+		return false;
+	token = readU32(data);
+	sequence = readU32(data + 4);
+	if (!readHeader(data + DATAGRAM_PREFIX_SIZE, size - DATAGRAM_PREFIX_SIZE, out))
+		return false;
+	return DATAGRAM_PREFIX_SIZE + messageSize(out) == size && isUnreliableType(out.type);
+}
+
+int encodeWelcome(char* buffer, uint16_t playerID, uint8_t flags)
+{
+	writeHeader(buffer, MSG_WELCOME, 3, SERVER_ID);
+	writeU16(buffer + HEADER_SIZE, playerID);
+	writeU8(buffer + HEADER_SIZE + 2, flags);
+	return HEADER_SIZE + 3;
+}
+
+int encodeMove(char* buffer, uint16_t sender, int16_t x, int16_t y, uint32_t input)
+{
+	int length = input != 0 ? 8 : 4;
+	writeHeader(buffer, MSG_MOVE, (uint16_t)length, sender);
+	writeS16(buffer + HEADER_SIZE, x);
+	writeS16(buffer + HEADER_SIZE + 2, y);
+	if (input != 0)
+		writeU32(buffer + HEADER_SIZE + 4, input);
+	return HEADER_SIZE + length;
+}
+
+int encodeDisconnect(char* buffer, uint16_t playerID)
+{
+	writeHeader(buffer, MSG_DISCONNECT, 2, SERVER_ID);
+	writeU16(buffer + HEADER_SIZE, playerID);
+	return HEADER_SIZE + 2;
+}
+
+int encodeGameOver(char* buffer, uint16_t sender, uint8_t winner)
+{
+	writeHeader(buffer, MSG_GAMEOVER, 1, sender);
+	writeU8(buffer + HEADER_SIZE, winner);
+	return HEADER_SIZE + 1;
+}
+
+int encodeStart(char* buffer)
+{
+	return writeHeader(buffer, MSG_START, 0, SERVER_ID);
+}
+
+int encodePing(char* buffer, uint16_t sender, uint32_t timestamp)
+{
+	writeHeader(buffer, MSG_PING, 4, sender);
+	writeU32(buffer + HEADER_SIZE, timestamp);
+	return HEADER_SIZE + 4;
+}
+
+int encodeAck(char* buffer, uint16_t sender, uint32_t tick)
+{
+	writeHeader(buffer, MSG_ACK, 4, sender);
+	writeU32(buffer + HEADER_SIZE, tick);
+	return HEADER_SIZE + 4;
+}
+
+int encodeChannel(char* buffer, uint16_t sender, uint32_t token)
+{
+	writeHeader(buffer, MSG_CHANNEL, 4, sender);
+	writeU32(buffer + HEADER_SIZE, token);
+	return HEADER_SIZE + 4;
+}
+
+int encodeCorrection(char* buffer, uint32_t input, int16_t x, int16_t y)
+{
+	writeHeader(buffer, MSG_CORRECTION, 8, SERVER_ID);
+	writeS16(buffer + HEADER_SIZE, x);
+	writeS16(buffer + HEADER_SIZE + 2, y);
+	writeU32(buffer + HEADER_SIZE + 4, input);
+	return HEADER_SIZE + 8;
+}
+
+int encodeInput(char* buffer, uint16_t sender, uint32_t newest, const uint8_t* buttons, int count)
+{
+	writeHeader(buffer, MSG_INPUT, (uint16_t)(INPUT_HEADER_SIZE + count), sender);
+	writeU32(buffer + HEADER_SIZE, newest);
+	writeU8(buffer + HEADER_SIZE + 4, (uint8_t)count);
+	for (int i = 0; i < count; i++)
+		writeU8(buffer + HEADER_SIZE + INPUT_HEADER_SIZE + i, buttons[i]);
+	return HEADER_SIZE + INPUT_HEADER_SIZE + count;
+}
+
+int encodeSnapshot(char* buffer, uint32_t tick, const SnapshotEntry* entries, int count)
+{
+	if (count > MAX_SNAPSHOT_ENTRIES)
+		count = MAX_SNAPSHOT_ENTRIES;
+
+	int length = SNAPSHOT_HEADER_SIZE + count * SNAPSHOT_ENTRY_SIZE;
+	writeHeader(buffer, MSG_SNAPSHOT, (uint16_t)length, SERVER_ID);
+
+	char* p = buffer + HEADER_SIZE;
+	writeU32(p, tick);
+	writeU16(p + 4, (uint16_t)count);
+	p += SNAPSHOT_HEADER_SIZE;
+	for (int i = 0; i < count; i++)
+	{
+		writeU16(p, entries[i].id);
+		writeS16(p + 2, entries[i].x);
+		writeS16(p + 4, entries[i].y);
+		p += SNAPSHOT_ENTRY_SIZE;
+	}
+	return HEADER_SIZE + length;
+}
+
+bool decodeWelcome(const char* payload, int length, uint16_t& playerID, uint8_t& flags)
+{
+	if (length < 2)
+		return false;
+	playerID = readU16(payload);
+	flags = length >= 3 ? readU8(payload + 2) : 0;
+	return true;
+}
+
+bool decodeMove(const char* payload, int length, MoveMessage& out)
+{
+	if (length < 4)
+		return false;
+	out.x = readS16(payload);
+	out.y = readS16(payload + 2);
+	out.input = length >= 8 ? readU32(payload + 4) : 0;
+	return true;
+}
+
+bool decodeDisconnect(const char* payload, int length, uint16_t& playerID)
+{
+	if (length < 2)
+		return false;
+	playerID = readU16(payload);
+	return true;
+}
+
+bool decodeGameOver(const char* payload, int length, uint8_t& winner)
+{
+	if (length < 1)
+		return false;
+	winner = readU8(payload);
+	return true;
+}
+
+bool decodePing(const char* payload, int length, uint32_t& timestamp)
+{
+	if (length < 4)
+		return false;
+	timestamp = readU32(payload);
+	return true;
+}
+
+bool decodeAck(const char* payload, int length, uint32_t& tick)
+{
+	if (length < 4)
+		return false;
+	tick = readU32(payload);
+	return true;
+}
+
+bool decodeChannel(const char* payload, int length, uint32_t& token)
+{
+	if (length < 4)
+		return false;
+	token = readU32(payload);
+	return true;
+}
+
+bool decodeCorrection(const char* payload, int length, MoveMessage& out)
+{
+	if (length < 8)
+		return false;
+	return decodeMove(payload, length, out);
+}
+
+bool decodeSnapshot(const char* payload, int length, uint32_t& tick, int& count)
+{
+	if (length < SNAPSHOT_HEADER_SIZE)
+		return false;
+	tick = readU32(payload);
+	count = readU16(payload + 4);
+	return SNAPSHOT_HEADER_SIZE + count * SNAPSHOT_ENTRY_SIZE <= length;
+}
+
+SnapshotEntry snapshotEntry(const char* payload, int index)
+{
+	const char* p = payload + SNAPSHOT_HEADER_SIZE + index * SNAPSHOT_ENTRY_SIZE;
+	SnapshotEntry entry;
+	entry.id = readU16(p);
+	entry.x = readS16(p + 2);
+	entry.y = readS16(p + 4);
+	return entry;
+}
+
+bool decodeInput(const char* payload, int length, uint32_t& newest, int& count)
+{
+	if (length < INPUT_HEADER_SIZE)
+		return false;
+	newest = readU32(payload);
+	count = readU8(payload + 4);
+	return count <= MAX_INPUTS_PER_MESSAGE && INPUT_HEADER_SIZE + count <= length;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdint.h>
+
+//Binary wire protocol shared by the client and the relay server.
+//Every message starts with a fixed 6 byte header followed by a packed payload.
+//All multi-byte fields are little-endian regardless of the host.
+//
+//  offset  size  field
+//  0       1     version  (PROTOCOL_VERSION)
+//  1       1     type     (MessageType)
+//  2       2     length   (payload bytes that follow the header)
+//  4       2     sender   (player ID, 0 for the server)
+
+const uint8_t PROTOCOL_VERSION = 1;
+const int HEADER_SIZE = 6;
+
+//Largest message either side will ever build; matches the receive buffers.
+const int MAX_MESSAGE_SIZE = 1400;
+const int MAX_PAYLOAD_SIZE = MAX_MESSAGE_SIZE - HEADER_SIZE;
+
+//Sender ID used for messages that originate on the server.
+const uint16_t SERVER_ID = 0;
+
+enum MessageType
+{
+	MSG_WELCOME = 0,	//Server -> client: your player ID, and how the server runs the game.
+	MSG_MOVE = 1,		//Client -> server -> clients: a dot's new position.
+	MSG_DISCONNECT = 2,	//A player has left.
+	MSG_GAMEOVER = 3,	//The match has ended; payload says who won.
+	MSG_START = 4,		//Server -> clients: enough players have joined, start the match.
+	MSG_SNAPSHOT = 5,	//Server -> clients: every position that changed during one server tick.
+	MSG_PING = 6,		//Client -> server: echo this back. Payload is opaque to the server.
+	MSG_PONG = 7,		//Server -> client: the echoed MSG_PING payload.
+	MSG_ACK = 8,		//Client -> server: the newest MSG_DELTA tick this client has applied.
+	MSG_DELTA = 9,		//Server -> client: positions as changes against an acknowledged tick (see DeltaSnapshot.h).
+	MSG_CHANNEL = 10,	//Server -> client over TCP: token for the UDP channel. Client -> server over UDP: open it.
+	MSG_CORRECTION = 11,	//Server -> client: where your dot really was as of one of your inputs (see Prediction.h).
+	MSG_INPUT = 12		//Client -> server, authoritative mode: the keys held in each of its recent frames (see Simulation.h).
+};
+
+//MSG_WELCOME payload: u16 player ID, then optionally u8 flags.
+//With WELCOME_AUTHORITATIVE the server moves every dot itself: send MSG_INPUT, not MSG_MOVE, and leave game over to it.
+const uint8_t WELCOME_AUTHORITATIVE = 1;
+
+//Winner values carried by MSG_GAMEOVER.
+enum Winner
+{
+	WINNER_NONE = 0,	//Sent to a client the server has no room for.
+	WINNER_RUNNER = 1,	//Player 1 survived until the timer ran out.
+	WINNER_CHASERS = 2	//Player 1 was caught by player 2 or 3.
+};
+
+struct MessageHeader
+{
+	uint8_t version;
+	uint8_t type;
+	uint16_t length;
+	uint16_t sender;
+};
+
+//MSG_MOVE payload: s16 x, s16 y, then u32 input if the sender numbered it.
+//MSG_CORRECTION carries the same fields, always with the input.
+struct MoveMessage
+{
+	int16_t x;
+	int16_t y;
+	uint32_t input;	//Client input sequence this position is the result of; 0 if none.
+};
+
+//MSG_SNAPSHOT payload: u32 tick, u16 count, then count packed entries.
+struct SnapshotEntry
+{
+	uint16_t id;
+	int16_t x;
+	int16_t y;
+};
+
+const int SNAPSHOT_HEADER_SIZE = 6;
+const int SNAPSHOT_ENTRY_SIZE = 6;
+const int MAX_SNAPSHOT_ENTRIES = (MAX_PAYLOAD_SIZE - SNAPSHOT_HEADER_SIZE) / SNAPSHOT_ENTRY_SIZE;
+
+//MSG_INPUT payload: u32 sequence of the newest input, u8 count, then count
+//button bytes (INPUT_UP etc.), oldest first. Each message repeats every input
+//the server hasn't confirmed yet, up to MAX_INPUTS_PER_MESSAGE, so one lost
+//datagram loses nothing.
+const int INPUT_HEADER_SIZE = 5;
+const int MAX_INPUTS_PER_MESSAGE = 16;
+
+//UDP channel.
+//Positions go out as datagrams so one lost packet never holds up the ones
+//behind it the way a lost TCP segment does. Joining, starting, leaving and
+//game over stay on TCP. Each datagram is one message behind an 8 byte prefix:
+//
+//  offset  size  field
+//  0       4     token     (from MSG_CHANNEL; tells the server who sent it)
+//  4       4     sequence  (per sender, starting at 1)
+//
+//Nothing is resent. A receiver drops any datagram whose sequence is not newer
+//than the last one it took, so a late position never overwrites a fresher one.
+const int DATAGRAM_PREFIX_SIZE = 8;
+const int MAX_DATAGRAM_SIZE = DATAGRAM_PREFIX_SIZE + MAX_MESSAGE_SIZE;
+
+//Message types that may travel over UDP. Everything else needs TCP.
+inline bool isUnreliableType(uint8_t type)
+{
+	return type == MSG_MOVE || type == MSG_SNAPSHOT || type == MSG_DELTA || type == MSG_ACK || type == MSG_CHANNEL ||
+		type == MSG_INPUT || type == MSG_CORRECTION;
+}
+
+//True if sequence a came after b, allowing for wrap-around.
+inline bool sequenceNewer(uint32_t a, uint32_t b) { return (int32_t)(a - b) > 0; }
+
+//Little-endian field access. These never touch unaligned memory directly so
+//they are safe on any buffer offset.
+inline void writeU8(char* p, uint8_t v) { p[0] = (char)v; }
+inline void writeU16(char* p, uint16_t v) { p[0] = (char)(v & 0xFF); p[1] = (char)(v >> 8); }
+inline void writeS16(char* p, int16_t v) { writeU16(p, (uint16_t)v); }
+inline void writeU32(char* p, uint32_t v) { writeU16(p, (uint16_t)(v & 0xFFFF)); writeU16(p + 2, (uint16_t)(v >> 16)); }
+
+inline uint8_t readU8(const char* p) { return (uint8_t)p[0]; }
+inline uint16_t readU16(const char* p) { return (uint16_t)((uint8_t)p[0] | ((uint8_t)p[1] << 8)); }
+inline int16_t readS16(const char* p) { return (int16_t)readU16(p); }
+inline uint32_t readU32(const char* p) { return (uint32_t)readU16(p) | ((uint32_t)readU16(p + 2) << 16); }
+
+//Writes a header at the start of buffer. Returns HEADER_SIZE.
+int writeHeader(char* buffer, uint8_t type, uint16_t length, uint16_t sender);
+
+//Reads the header at the start of data. Returns false if fewer than HEADER_SIZE
+//bytes are available, the version does not match or the payload is too large.
+bool readHeader(const char* data, int size, MessageHeader& out);
+
+//Writes the datagram prefix at the start of buffer; the message follows it.
+//Returns DATAGRAM_PREFIX_SIZE.
+int writeDatagramPrefix(char* buffer, uint32_t token, uint32_t sequence);
+
+//Reads the prefix and the header of the message behind it. Returns false unless
+//the datagram holds exactly one whole message of a type UDP may carry.
+bool readDatagram(const char* data, int size, uint32_t& token, uint32_t& sequence, MessageHeader& out);
+
+//Rewrites the sender field of an already encoded message in place.
+inline void setSender(char* message, uint16_t sender) { writeU16(message + 4, sender); }
+
+//Total size of a message (header plus payload) once its header has been read.
+inline int messageSize(const MessageHeader& header) { return HEADER_SIZE + header.length; }
+
+//Encoders. Each writes a complete message into buffer, which must hold at least
+//MAX_MESSAGE_SIZE bytes, and returns the number of bytes written.
+int encodeWelcome(char* buffer, uint16_t playerID, uint8_t flags);
+//input 0 leaves it out, as for moves the server passes on to other players.
+int encodeMove(char* buffer, uint16_t sender, int16_t x, int16_t y, uint32_t input);
+int encodeDisconnect(char* buffer, uint16_t playerID);
+int encodeGameOver(char* buffer, uint16_t sender, uint8_t winner);
+int encodeStart(char* buffer);
+int encodePing(char* buffer, uint16_t sender, uint32_t timestamp);
+int encodeAck(char* buffer, uint16_t sender, uint32_t tick);
+int encodeChannel(char* buffer, uint16_t sender, uint32_t token);
+int encodeCorrection(char* buffer, uint32_t input, int16_t x, int16_t y);
+//buttons holds count inputs, oldest first, ending with input number newest. At most MAX_INPUTS_PER_MESSAGE.
+int encodeInput(char* buffer, uint16_t sender, uint32_t newest, const uint8_t* buttons, int count);
+//Writes at most MAX_SNAPSHOT_ENTRIES entries; callers split larger worlds over several messages.
+int encodeSnapshot(char* buffer, uint32_t tick, const SnapshotEntry* entries, int count);
+
+//Decoders. payload points just past the header and length is header.length.
+//Each returns false if the payload is too short for its message type.
+//flags is 0 if the server didn't send any.
+bool decodeWelcome(const char* payload, int length, uint16_t& playerID, uint8_t& flags);
+bool decodeMove(const char* payload, int length, MoveMessage& out);
+bool decodeDisconnect(const char* payload, int length, uint16_t& playerID);
+bool decodeGameOver(const char* payload, int length, uint8_t& winner);
+//Reads the timestamp from a MSG_PING or MSG_PONG.
+bool decodePing(const char* payload, int length, uint32_t& timestamp);
+bool decodeAck(const char* payload, int length, uint32_t& tick);
+bool decodeChannel(const char* payload, int length, uint32_t& token);
+bool decodeCorrection(const char* payload, int length, MoveMessage& out);
+//Validates the snapshot and returns its tick and entry count; entries are then
+//read one at a time with snapshotEntry so nothing is copied out up front.
+bool decodeSnapshot(const char* payload, int length, uint32_t& tick, int& count);
+SnapshotEntry snapshotEntry(const char* payload, int index);
+//Same for MSG_INPUT: input index has sequence newest - count + 1 + index.
+bool decodeInput(const char* payload, int length, uint32_t& newest, int& count);
+inline uint8_t inputEntry(const char* payload, int index) { return readU8(payload + INPUT_HEADER_SIZE + index); }
@@ -0,0 +1,147 @@
+#include "Recording.h"
+
+#include <string.h>
+
+Recorder::Recorder()
+	: mFile(NULL), mBuffer(NULL), mUsed(0), mWritten(0), mLastUs(0)
+{
+}
+
+Recorder::~Recorder()
+{
+	close();
+}
+
+bool Recorder::open(const char* path, RecordSource source)
+{
+	close();
+	mFile = fopen(path, "wb");
+	if (mFile == NULL)
+		return false;
+	mBuffer = new char[BUFFER_SIZE];
+	mWritten = 0;
+	mLastUs = 0;
+	mStart = std::chrono::steady_clock::now();
+
+	memset(mBuffer, 0, RECORDING_FILE_HEADER_SIZE);
+	memcpy(mBuffer, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+	writeU8(mBuffer + sizeof(RECORDING_MAGIC), RECORDING_VERSION);
+	writeU8(mBuffer + sizeof(RECORDING_MAGIC) + 1, (uint8_t)source);
+	mUsed = RECORDING_FILE_HEADER_SIZE;
+	return true;
+}
+
+void Recorder::close()
+{
+	if (mFile != NULL)
+	{
+		flush();
+		fclose(mFile);
+		mFile = NULL;
+	}
+	delete[] mBuffer;
+	mBuffer = NULL;
+	mUsed = 0;
+}
+
+void Recorder::record(RecordKind kind, RecordChannel channel, uint32_t connection, const char* message, int length)
+{
+	if (mFile == NULL)
+		return;
+	if (BUFFER_SIZE - mUsed < RECORD_HEADER_SIZE + length && !flush())
+	{//The disk is full or gone. Stop rather than write a recording with holes in it.
+		fclose(mFile);
+		mFile = NULL;
+		return;
+	}
+
+	uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mStart).count();
+	uint64_t gap = now - mLastUs;
+	mLastUs = now;
+
+	char* out = mBuffer + mUsed;
+	writeU32(out, gap > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)gap);
+	writeU8(out + 4, (uint8_t)kind);
+	writeU8(out + 5, (uint8_t)channel);
+	writeU32(out + 6, connection);
+	if (length > 0)
+		memcpy(out + RECORD_HEADER_SIZE, message, length);
+	mUsed += RECORD_HEADER_SIZE + length;
+}
+
+bool Recorder::flush()
+{
+	if (mUsed == 0)
+		return true;
+	bool written = fwrite(mBuffer, 1, mUsed, mFile) == (size_t)mUsed;
+	mWritten += mUsed;
+	mUsed = 0;
+	return written;
+}
+
+ReplayFile::ReplayFile()
+	: mOffset(0), mTime(0), mSource(RECORD_SERVER)
+{
+}
+
+bool ReplayFile::open(const char* path)
+{
+	close();
+	if (!mFile.open(path, true))
+		return false;
+	if (mFile.size() < (size_t)RECORDING_FILE_HEADER_SIZE || memcmp(mFile.data(), RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0 ||
+		readU8(mFile.data() + sizeof(RECORDING_MAGIC)) != RECORDING_VERSION)
+	{
+		close();
+		return false;
+	}
+	mSource = (RecordSource)readU8(mFile.data() + sizeof(RECORDING_MAGIC) + 1);
+	rewind();
+	return true;
+}
+
+void ReplayFile::close()
+{
+	mFile.close();
+	mOffset = 0;
+}
+
+void ReplayFile::rewind()
+{
+	mOffset = RECORDING_FILE_HEADER_SIZE;
+	mTime = 0;
+}
+
+bool ReplayFile::next(ReplayRecord& record)
+{
+	size_t size = mFile.size();
+	if (!mFile.isOpen() || size - mOffset < (size_t)RECORD_HEADER_SIZE)
+		return false;
+
+	const char* in = mFile.data() + mOffset;
+	uint8_t kind = readU8(in + 4);
+	if (kind > RECORD_TIMERS)
+		return false;
+	record.kind = (RecordKind)kind;
+	record.channel = (RecordChannel)readU8(in + 5);
+	record.connection = readU32(in + 6);
+	record.message = NULL;
+	record.length = 0;
+
+	size_t length = RECORD_HEADER_SIZE;
+	if (kind == RECORD_IN || kind == RECORD_OUT)
+	{
+		const char* message = in + RECORD_HEADER_SIZE;
+		int available = (int)(size - mOffset - RECORD_HEADER_SIZE < (size_t)MAX_MESSAGE_SIZE ? size - mOffset - RECORD_HEADER_SIZE : MAX_MESSAGE_SIZE);
+		if (!readHeader(message, available, record.header) || messageSize(record.header) > available)
+			return false;
+		record.message = message;
+		record.length = messageSize(record.header);
+		length += record.length;
+	}
+
+	mTime += readU32(in);
+	record.time = mTime;
+	mOffset += length;
+	return true;
+}
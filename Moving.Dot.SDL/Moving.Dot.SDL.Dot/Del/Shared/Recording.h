@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+
+#include "Protocol.h"
+#include "MappedFile.h"
+
+//Recordings of network traffic, and playing them back.
+//The server and the client can each write every message they receive and
+//send to an append-only binary file (--record). A recording of the server
+//can be played back through the server's own message handling (--replay),
+//and a recording of a client through the client's, to reproduce a real load
+//or session offline, profile it, or time a build against the last one.
+//
+//File layout, little-endian like the protocol:
+//  RECORDING_FILE_HEADER_SIZE bytes: RECORDING_MAGIC, format version (u8),
+//    which end recorded it (u8), zero padding.
+//  Records, one after the other, each RECORD_HEADER_SIZE bytes of
+//    u32 microseconds since the previous record (the first: since recording began)
+//    u8  RecordKind
+//    u8  RecordChannel
+//    u32 connection: the server's handle for the player; always 0 from a client.
+//        For RECORD_WAKE and RECORD_TIMERS, the server's clock (ms) instead.
+//  followed, for RECORD_IN and RECORD_OUT, by the message itself (header
+//  included, so its length is in there). A record cut short at the end of the
+//  file, as when the process was killed, is ignored.
+
+const char RECORDING_MAGIC[6] = { 'D', 'O', 'T', 'R', 'E', 'C' };
+const uint8_t RECORDING_VERSION = 1;
+const int RECORDING_FILE_HEADER_SIZE = 16;
+const int RECORD_HEADER_SIZE = 10;
+
+enum RecordSource
+{
+	RECORD_SERVER = 0,
+	RECORD_CLIENT = 1
+};
+
+enum RecordKind
+{
+	RECORD_OPEN = 0,	//a player connected (server only)
+	RECORD_CLOSE = 1,	//the other end hung up
+	RECORD_IN = 2,		//a message received
+	RECORD_OUT = 3,		//a message sent
+	RECORD_WAKE = 4,	//server: the network loop woke up to handle a batch of events
+	RECORD_TIMERS = 5	//server: the batch is done; due timers ran
+};
+
+enum RecordChannel
+{
+	RECORD_TCP = 0,
+	RECORD_UDP = 1
+};
+
+//Writes a recording. Records are gathered in memory and written in large
+//blocks, so recording costs a copy per message. Not thread safe: one thread
+//at a time may record.
+class Recorder
+{
+public:
+	Recorder();
+	~Recorder();
+
+	//Creates (or replaces) the file at path. Returns false if it can't.
+	bool open(const char* path, RecordSource source);
+
+	//Writes out whatever is still buffered and closes the file.
+	void close();
+
+	bool isOpen() const { return mFile != NULL; }
+
+	//Adds one record, timed now. message and length only for RECORD_IN and RECORD_OUT.
+	void record(RecordKind kind, RecordChannel channel, uint32_t connection, const char* message = NULL, int length = 0);
+
+	//Bytes in the file so far, buffered ones included.
+	long long bytes() const { return mWritten + mUsed; }
+
+private:
+	static const int BUFFER_SIZE = 64 * 1024;
+
+	bool flush();
+
+	FILE* mFile;
+	char* mBuffer;
+	int mUsed;
+	long long mWritten;
+	std::chrono::steady_clock::time_point mStart;
+	uint64_t mLastUs;
+};
+
+//One record, as ReplayFile hands it out.
+struct ReplayRecord
+{
+	uint64_t time;			//microseconds since recording began
+	RecordKind kind;
+	RecordChannel channel;
+	uint32_t connection;
+	MessageHeader header;	//RECORD_IN and RECORD_OUT only
+	const char* message;	//header and payload, inside the mapping; NULL for other kinds
+	int length;				//of message
+};
+
+//Reads a recording straight out of a read-only memory mapping, so playing
+//one back never copies or buffers the file, however large.
+class ReplayFile
+{
+public:
+	ReplayFile();
+
+	//Maps the file. Returns false if it can't be read or isn't a recording.
+	bool open(const char* path);
+	void close();
+
+	bool isOpen() const { return mFile.isOpen(); }
+	RecordSource source() const { return mSource; }
+
+	//The next record, or false once there are no more.
+	bool next(ReplayRecord& record);
+
+	//Back to the first record.
+	void rewind();
+
+private:
+	MappedFile mFile;
+	size_t mOffset;
+	uint64_t mTime;
+	RecordSource mSource;
+};
@@ -0,0 +1,156 @@
+#include "Simulation.h"
+
+#include "InterestGrid.h"
+
+//Right and bottom edges a dot wraps at: the screen size.
+static const int EDGE_X = FIELD_MIN_X + FIELD_WIDTH;
+static const int EDGE_Y = FIELD_MIN_Y + FIELD_HEIGHT;
+
+uint8_t inputButtons(int velX, int velY)
+{
+	uint8_t buttons = 0;
+	if (velY < 0)
+		buttons |= INPUT_UP;
+	else if (velY > 0)
+		buttons |= INPUT_DOWN;
+	if (velX < 0)
+		buttons |= INPUT_LEFT;
+	else if (velX > 0)
+		buttons |= INPUT_RIGHT;
+	return buttons;
+}
+
+void inputVelocity(uint8_t buttons, int& velX, int& velY)
+{
+	velX = 0;
+	velY = 0;
+	if (buttons & INPUT_UP)
+		velY -= DOT_SPEED;
+	if (buttons & INPUT_DOWN)
+		velY += DOT_SPEED;
+	if (buttons & INPUT_LEFT)
+		velX -= DOT_SPEED;
+	if (buttons & INPUT_RIGHT)
+		velX += DOT_SPEED;
+}
+
+//Players past 3 start on a grid of spots two dots apart across the screen.
+static const int START_SPACING = 2 * FIELD_DOT_SIZE;
+static const int START_COLUMNS = EDGE_X / START_SPACING;
+static const int START_ROWS = EDGE_Y / START_SPACING;
+//The spots are taken this many apart (it shares no factor with the count of
+//spots), so a few extra players land all over the field, not along one edge.
+static const int START_STRIDE = 7;
+//No spot this close to the runner, measured round the wrap, is used.
+static const int START_CLEARANCE = 6 * FIELD_DOT_SIZE;
+
+//True if a dot at (x, y) would start too close to the runner or on top of player 2 or 3.
+static bool startTaken(int x, int y)
+{
+	int runnerX, runnerY;
+	startPosition(1, runnerX, runnerY);
+	int dx = fieldDeltaX(runnerX, x);
+	int dy = fieldDeltaY(runnerY, y);
+	if (dx * dx + dy * dy < START_CLEARANCE * START_CLEARANCE)
+		return true;
+	for (int playerNum = 2; playerNum <= 3; playerNum++)
+	{
+		int otherX, otherY;
+		startPosition(playerNum, otherX, otherY);
+		dx = fieldDeltaX(otherX, x);
+		dy = fieldDeltaY(otherY, y);
+		if (dx * dx + dy * dy < START_SPACING * START_SPACING)
+			return true;
+	}
+	return false;
+}
+
+void startPosition(int playerNum, int& x, int& y)
+{
+	//Each player starts in a different position.
+	if (playerNum == 2)
+	{
+		x = (EDGE_X / 3) - FIELD_DOT_SIZE;
+		y = (EDGE_Y / 3) - FIELD_DOT_SIZE;
+	}
+	else if (playerNum == 3)
+	{
+		x = (EDGE_X * 2 / 3) - FIELD_DOT_SIZE;
+		y = (EDGE_Y * 2 / 3) - FIELD_DOT_SIZE;
+	}
+	else if (playerNum >= 4)
+	{
+		//The (playerNum - 3)th free spot. A match bigger than the grid goes
+		//round it again, so only then do two players share a spot.
+		const int spots = START_COLUMNS * START_ROWS;
+		int spare = 0;
+		for (int spot = 0; spot < spots; spot++)
+			if (!startTaken((spot % START_COLUMNS) * START_SPACING, (spot / START_COLUMNS) * START_SPACING))
+				spare++;
+		int wanted = (playerNum - 4) % spare;
+		int spot = 0;
+		for (;; spot = (spot + START_STRIDE) % spots)
+		{
+			x = (spot % START_COLUMNS) * START_SPACING;
+			y = (spot / START_COLUMNS) * START_SPACING;
+			if (!startTaken(x, y) && wanted-- == 0)
+				break;
+		}
+	}
+	else
+	{
+		x = 0;
+		y = 0;
+	}
+}
+
+void stepDot(int& x, int& y, int velX, int velY)
+{
+	//Off one side comes back on at the other. (Not quite modular: a dot that
+	//overshoots lands exactly on the far edge, as it always has.)
+	x += velX;
+	if (x < FIELD_MIN_X)
+		x = EDGE_X;
+	else if (x > EDGE_X)
+		x = FIELD_MIN_X;
+
+	y += velY;
+	if (y < FIELD_MIN_Y)
+		y = EDGE_Y;
+	else if (y > EDGE_Y)
+		y = FIELD_MIN_Y;
+}
+
+bool dotsCollide(int ax, int ay, int bx, int by)
+{
+	//Same test as the whole-pixel distance being at most one dot wide, without the square root.
+	int dx = bx - ax;
+	int dy = by - ay;
+	return dx * dx + dy * dy < (FIELD_DOT_SIZE + 1) * (FIELD_DOT_SIZE + 1);
+}
+
+bool dotsCollideSwept(int aFromX, int aFromY, int aToX, int aToY, int bFromX, int bFromY, int bToX, int bToY)
+{
+	//Watched from a, b starts at d and moves by v over the tick, so it is at
+	//d + v*t for t from 0 to 1. They touch if that line comes within reach of
+	//a. All integers, so the client and the server always agree.
+	int64_t dx = fieldDeltaX(aFromX, bFromX);
+	int64_t dy = fieldDeltaY(aFromY, bFromY);
+	int64_t vx = fieldDeltaX(bFromX, bToX) - fieldDeltaX(aFromX, aToX);
+	int64_t vy = fieldDeltaY(bFromY, bToY) - fieldDeltaY(aFromY, aToY);
+	const int64_t reach = (FIELD_DOT_SIZE + 1) * (FIELD_DOT_SIZE + 1);
+
+	int64_t along = dx * vx + dy * vy;
+	int64_t speed = vx * vx + vy * vy;
+	if (along >= 0)
+	{//Not closing in (or not moving): nearest at the start.
+		return dx * dx + dy * dy < reach;
+	}
+	if (-along >= speed)
+	{//Still closing in at the end: nearest there.
+		return (dx + vx) * (dx + vx) + (dy + vy) * (dy + vy) < reach;
+	}
+	//Nearest part way, at t = -along / speed. The squared distance there is
+	//|d|^2 - along^2 / speed; multiplied through by speed to stay exact.
+	return (dx * dx + dy * dy) * speed - along * along < reach * speed;
+}
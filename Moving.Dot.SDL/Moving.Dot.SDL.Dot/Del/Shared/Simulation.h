@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Prediction.h"
+
+//The game's rules, in one place for both ends.
+//The client runs them to move its dots and predict its own; in authoritative
+//mode the server runs the same code on the inputs players send and its answer
+//is final. Everything is integer maths on the same inputs, so as long as both
+//sides apply the same inputs in the same order they land on the same pixel.
+
+//Keys held during one frame, as carried by MSG_INPUT.
+const uint8_t INPUT_UP = 1;
+const uint8_t INPUT_DOWN = 2;
+const uint8_t INPUT_LEFT = 4;
+const uint8_t INPUT_RIGHT = 8;
+
+//If the runner survives this many frames, they win.
+const int ENDGAME_FRAMES = 30 * FRAMES_PER_SECOND;
+
+//Which way a dot with this velocity is being steered.
+uint8_t inputButtons(int velX, int velY);
+
+//The velocity those buttons give a dot. Opposite keys cancel out.
+void inputVelocity(uint8_t buttons, int& velX, int& velY);
+
+//Where player number playerNum starts (1 is the runner). Every player up to
+//the number of spots on the start grid gets a spot of their own, well away
+//from the runner.
+void startPosition(int playerNum, int& x, int& y);
+
+//Moves a dot one frame, wrapping it round the edges of the screen.
+void stepDot(int& x, int& y, int velX, int velY);
+
+//True if two dots at these positions are touching.
+bool dotsCollide(int ax, int ay, int bx, int by);
+
+//True if two dots touch at any moment while moving from their from positions
+//to their to positions over one tick, each in a straight line. Unlike
+//dotsCollide this is measured round the field the short way, so a dot that
+//wrapped off one edge is swept through the gap rather than back across the
+//screen, and dots either side of an edge can touch across it. Checked only at
+//the ends of each tick, a fast dot can jump clean over another; this can't
+//miss it however far they move, as long as each goes less than half the field.
+bool dotsCollideSwept(int aFromX, int aFromY, int aToX, int aToY, int bFromX, int bFromY, int bToX, int bToY);
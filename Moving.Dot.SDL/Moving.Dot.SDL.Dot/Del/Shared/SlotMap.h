@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+//Handle to an entry in a SlotMap: slot index in the low 16 bits, generation in
+//the high 16. A slot's generation changes every time its entry is removed, so a
+//handle kept after removal stops resolving instead of finding whoever reused
+//the slot. 0 is never a valid handle.
+typedef uint32_t SlotHandle;
+const SlotHandle INVALID_SLOT_HANDLE = 0;
+
+inline uint16_t slotIndex(SlotHandle handle) { return (uint16_t)(handle & 0xFFFF); }
+inline uint16_t slotGeneration(SlotHandle handle) { return (uint16_t)(handle >> 16); }
+
+//Generational slot map.
+//Values are kept packed in one array, so iterating them is as cheap as
+//iterating a vector. A sparse slot array maps handles to positions in it.
+//Insert, lookup and remove are all O(1): removal moves the last value into the
+//hole, and freed slots go on a free list to be reused. Values do move when
+//something else is removed, so hold handles, not pointers into the map.
+template <typename T>
+class SlotMap
+{
+public:
+	static const int MAX_SLOTS = 0x10000;
+
+	SlotMap() : mFreeHead(NO_SLOT) {}
+
+	//Returns INVALID_SLOT_HANDLE if every slot is in use.
+	SlotHandle insert(const T& value)
+	{
+		uint32_t index;
+		if (mFreeHead != NO_SLOT)
+		{
+			index = mFreeHead;
+			mFreeHead = mSlots[index].position;
+		}
+		else
+		{
+			if (mSlots.size() >= MAX_SLOTS)
+				return INVALID_SLOT_HANDLE;
+			index = (uint32_t)mSlots.size();
+			Slot slot = { 0, 1 };
+			mSlots.push_back(slot);
+		}
+
+		mSlots[index].position = (uint32_t)mValues.size();
+		mValues.push_back(value);
+		mOwners.push_back(index);
+		return makeHandle(index, mSlots[index].generation);
+	}
+
+	//NULL if the handle is stale or was never valid.
+	T* find(SlotHandle handle)
+	{
+		uint32_t index = slotIndex(handle);
+		if (index >= mSlots.size() || mSlots[index].generation != slotGeneration(handle))
+			return NULL;
+		return &mValues[mSlots[index].position];
+	}
+
+	bool contains(SlotHandle handle) { return find(handle) != NULL; }
+
+	//Returns false if the handle was already stale.
+	bool remove(SlotHandle handle)
+	{
+		if (find(handle) == NULL)
+			return false;
+
+		uint32_t index = slotIndex(handle);
+		uint32_t position = mSlots[index].position;
+		uint32_t last = (uint32_t)mValues.size() - 1;
+		if (position != last)
+		{
+			mValues[position] = mValues[last];
+			mOwners[position] = mOwners[last];
+			mSlots[mOwners[position]].position = position;
+		}
+		mValues.pop_back();
+		mOwners.pop_back();
+
+		//Retire the handle and put the slot on the free list.
+		Slot& slot = mSlots[index];
+		slot.generation++;
+		if (slot.generation == 0)
+			slot.generation = 1;
+		slot.position = mFreeHead;
+		mFreeHead = index;
+		return true;
+	}
+
+	//Packed access, for iterating. Order changes as values are removed.
+	int size() const { return (int)mValues.size(); }
+	bool empty() const { return mValues.empty(); }
+	T& operator[](int position) { return mValues[position]; }
+	const T& operator[](int position) const { return mValues[position]; }
+	SlotHandle handleAt(int position) const
+	{
+		uint32_t index = mOwners[position];
+		return makeHandle(index, mSlots[index].generation);
+	}
+
+	void clear()
+	{
+		while (!mValues.empty())
+			remove(handleAt(size() - 1));
+	}
+
+private:
+	static const uint32_t NO_SLOT = 0xFFFFFFFF;
+
+	struct Slot
+	{
+		uint32_t position;		//into mValues while in use; next free slot otherwise
+		uint16_t generation;
+	};
+
+	static SlotHandle makeHandle(uint32_t index, uint16_t generation)
+	{
+		return ((SlotHandle)generation << 16) | index;
+	}
+
+	std::vector<Slot> mSlots;
+	std::vector<T> mValues;
+	std::vector<uint32_t> mOwners;	//slot index of each packed value
+	uint32_t mFreeHead;
+};
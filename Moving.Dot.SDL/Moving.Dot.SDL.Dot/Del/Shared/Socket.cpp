@@ -0,0 +1,260 @@
+#include "Socket.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/resource.h>
+#endif
+
+static void setNonBlocking(SocketHandle socket)
+{
+#ifdef _WIN32
+	u_long mode = 1;
+	ioctlsocket(socket, FIONBIO, &mode);
+#else
+	fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+static void setNoDelay(SocketHandle socket)
+{
+	//Position updates are tiny and latency sensitive; don't let Nagle hold them back.
+	int noDelay = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+}
+
+static bool wouldBlock()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+bool socketStartup()
+{
+#ifdef _WIN32
+	//set up winsock 2.2
+	WSADATA wsaData;
+	return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+	//A peer that disappears mid-send must not kill the whole server.
+	signal(SIGPIPE, SIG_IGN);
+	return true;
+#endif
+}
+
+void socketCleanup()
+{
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+int raiseFileLimit()
+{
+#ifdef _WIN32
+	//Winsock has no per-process socket limit to raise.
+	return 0;
+#else
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+		return 0;
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+	getrlimit(RLIMIT_NOFILE, &limit);
+	return (int)limit.rlim_cur;
+#endif
+}
+
+SocketHandle listenTcp(uint16_t port)
+{
+	SocketHandle listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == INVALID_SOCKET_HANDLE)
+		return INVALID_SOCKET_HANDLE;
+
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+	{
+		closeSocket(listener);
+		return INVALID_SOCKET_HANDLE;
+	}
+
+	setNonBlocking(listener);
+	return listener;
+}
+
+SocketHandle acceptTcp(SocketHandle listener)
+{
+	SocketHandle client = accept(listener, NULL, NULL);
+	if (client == INVALID_SOCKET_HANDLE)
+		return INVALID_SOCKET_HANDLE;
+
+	setNonBlocking(client);
+	setNoDelay(client);
+	return client;
+}
+
+SocketHandle connectTcp(const char* host, uint16_t port)
+{
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* result = NULL;
+	if (getaddrinfo(host, NULL, &hints, &result) != 0 || result == NULL)
+		return INVALID_SOCKET_HANDLE;
+
+	sockaddr_in address;
+	memcpy(&address, result->ai_addr, sizeof(address));
+	address.sin_port = htons(port);
+	freeaddrinfo(result);
+
+	SocketHandle client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (client == INVALID_SOCKET_HANDLE)
+		return INVALID_SOCKET_HANDLE;
+
+	if (connect(client, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		closeSocket(client);
+		return INVALID_SOCKET_HANDLE;
+	}
+
+	setNonBlocking(client);
+	setNoDelay(client);
+	return client;
+}
+
+void setSendBuffer(SocketHandle socket, int bytes)
+{
+	setsockopt(socket, SOL_SOCKET, SO_SNDBUF, (const char*)&bytes, sizeof(bytes));
+}
+
+int socketRecv(SocketHandle socket, char* buffer, int size)
+{
+	int received = (int)recv(socket, buffer, size, 0);
+	if (received > 0)
+		return received;
+	if (received == 0)
+		return SOCKET_CLOSED;
+	return wouldBlock() ? SOCKET_AGAIN : SOCKET_FAILED;
+}
+
+int socketSend(SocketHandle socket, const char* data, int size)
+{
+#ifdef MSG_NOSIGNAL
+	int sent = (int)send(socket, data, size, MSG_NOSIGNAL);
+#else
+	int sent = (int)send(socket, data, size, 0);
+#endif
+	if (sent >= 0)
+		return sent;
+	return wouldBlock() ? SOCKET_AGAIN : SOCKET_FAILED;
+}
+
+static void toSockaddr(const UdpAddress& in, sockaddr_in& out)
+{
+	memset(&out, 0, sizeof(out));
+	out.sin_family = AF_INET;
+	out.sin_addr.s_addr = htonl(in.host);
+	out.sin_port = htons(in.port);
+}
+
+bool resolveUdp(const char* host, uint16_t port, UdpAddress& out)
+{
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	addrinfo* result = NULL;
+	if (getaddrinfo(host, NULL, &hints, &result) != 0 || result == NULL)
+		return false;
+	out.host = ntohl(((sockaddr_in*)result->ai_addr)->sin_addr.s_addr);
+	out.port = port;
+	freeaddrinfo(result);
+	return true;
+}
+
+SocketHandle openUdp(uint16_t port)
+{
+	SocketHandle udp = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (udp == INVALID_SOCKET_HANDLE)
+		return INVALID_SOCKET_HANDLE;
+
+	UdpAddress any = { INADDR_ANY, port };
+	sockaddr_in address;
+	toSockaddr(any, address);
+	if (bind(udp, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		closeSocket(udp);
+		return INVALID_SOCKET_HANDLE;
+	}
+
+	setNonBlocking(udp);
+	return udp;
+}
+
+int udpRecvFrom(SocketHandle socket, char* buffer, int size, UdpAddress& from)
+{
+	for (;;)
+	{
+		sockaddr_in address;
+		socklen_t addressSize = sizeof(address);
+		int received = (int)recvfrom(socket, buffer, size, 0, (sockaddr*)&address, &addressSize);
+		if (received >= 0)
+		{
+			from.host = ntohl(address.sin_addr.s_addr);
+			from.port = ntohs(address.sin_port);
+			return received;
+		}
+#ifdef _WIN32
+		//Oversized datagrams and ICMP port unreachable from an earlier send show
+		//up as errors here; neither means the socket is broken.
+		int error = WSAGetLastError();
+		if (error == WSAEMSGSIZE || error == WSAECONNRESET)
+			continue;
+#else
+		if (errno == ECONNREFUSED)
+			continue;
+#endif
+		return wouldBlock() ? SOCKET_AGAIN : SOCKET_FAILED;
+	}
+}
+
+int udpSendTo(SocketHandle socket, const char* data, int size, const UdpAddress& to)
+{
+	sockaddr_in address;
+	toSockaddr(to, address);
+	int sent = (int)sendto(socket, data, size, 0, (sockaddr*)&address, sizeof(address));
+	if (sent >= 0)
+		return sent;
+	return wouldBlock() ? SOCKET_AGAIN : SOCKET_FAILED;
+}
+
+void closeSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+	closesocket(socket);
+#else
+	close(socket);
+#endif
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+//Thin non-blocking TCP and UDP wrapper over Winsock / BSD sockets.
+//SDL_net hides the OS socket handle, which the epoll backend in Poller needs,
+//so the server and the headless tools talk to the OS directly. The game client
+//keeps using SDL_net; both ends speak the same byte stream.
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")	// Winsock library file
+typedef SOCKET SocketHandle;
+const SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+#else
+typedef int SocketHandle;
+const SocketHandle INVALID_SOCKET_HANDLE = -1;
+#endif
+
+//socketRecv / socketSend return a byte count, or one of these.
+const int SOCKET_CLOSED = 0;	//Peer closed the connection (recv only).
+const int SOCKET_AGAIN = -1;	//Nothing more can be done without blocking.
+const int SOCKET_FAILED = -2;	//The connection is broken.
+
+//Starts up / shuts down the socket library (Winsock needs this, BSD doesn't).
+bool socketStartup();
+void socketCleanup();
+
+//Lifts the per-process open file limit as far as the OS allows, so one process
+//can hold thousands of sockets. Returns the new limit (0 if not applicable).
+int raiseFileLimit();
+
+//Opens a non-blocking listening socket on every interface.
+SocketHandle listenTcp(uint16_t port);
+
+//Accepts one pending connection, already non-blocking with Nagle disabled.
+//Returns INVALID_SOCKET_HANDLE when nothing is waiting.
+SocketHandle acceptTcp(SocketHandle listener);
+
+//Connects to host:port (blocking), then switches the socket to non-blocking
+//with Nagle disabled. Returns INVALID_SOCKET_HANDLE on failure.
+SocketHandle connectTcp(const char* host, uint16_t port);
+
+int socketRecv(SocketHandle socket, char* buffer, int size);
+int socketSend(SocketHandle socket, const char* data, int size);
+
+//Caps how much the OS queues for sending before socketSend starts taking
+//less than it is given. The server uses a small one to test its own queueing.
+void setSendBuffer(SocketHandle socket, int bytes);
+
+//IPv4 address and port of a UDP peer, both in host byte order.
+struct UdpAddress
+{
+	uint32_t host;
+	uint16_t port;
+};
+
+inline bool operator==(const UdpAddress& a, const UdpAddress& b) { return a.host == b.host && a.port == b.port; }
+inline bool operator!=(const UdpAddress& a, const UdpAddress& b) { return !(a == b); }
+
+//Looks up host:port for udpSendTo. Returns false if the name can't be resolved.
+bool resolveUdp(const char* host, uint16_t port, UdpAddress& out);
+
+//Opens a non-blocking UDP socket bound to port on every interface (0 = any free port).
+SocketHandle openUdp(uint16_t port);
+
+//One datagram each. udpRecvFrom returns its size and who sent it, or
+//SOCKET_AGAIN once nothing is waiting. Datagrams bigger than size are dropped.
+//udpSendTo returns the size, SOCKET_AGAIN if the send buffer is full (the
+//datagram is lost, as it could have been on the wire) or SOCKET_FAILED.
+int udpRecvFrom(SocketHandle socket, char* buffer, int size, UdpAddress& from);
+int udpSendTo(SocketHandle socket, const char* data, int size, const UdpAddress& to);
+
+void closeSocket(SocketHandle socket);
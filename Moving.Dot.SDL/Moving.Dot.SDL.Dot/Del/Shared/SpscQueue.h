@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+//Lock-free queue between exactly one producer thread and one consumer thread.
+//Items live in a fixed ring, so nothing is allocated once the queue exists.
+//The producer fills a slot in place (claim, then publish) and the consumer
+//reads it in place (front, then release), so large items aren't copied
+//either. Each index is only ever written by one side: the producer's release
+//store of mTail publishes the item, the consumer's release store of mHead
+//hands the slot back. They are padded a cache line apart so the two threads
+//don't keep stealing the same line from each other. (Padding rather than
+//alignas, since new won't honour over-alignment before C++17.)
+//
+//CAPACITY must be a power of two.
+template <typename T, int CAPACITY>
+class SpscQueue
+{
+	static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+public:
+	SpscQueue() : mHead(0), mTail(0) {}
+
+	//Producer: the next free slot, or NULL if the queue is full. Nothing is
+	//visible to the consumer until publish().
+	T* claim()
+	{
+		uint32_t tail = mTail.load(std::memory_order_relaxed);
+		if (tail - mHead.load(std::memory_order_acquire) == CAPACITY)
+			return NULL;
+		return &mItems[tail & (CAPACITY - 1)];
+	}
+
+	//Producer: hands the claimed slot to the consumer.
+	void publish()
+	{
+		mTail.store(mTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	//Consumer: the oldest published item, or NULL if there is none. Stays
+	//valid until release().
+	T* front()
+	{
+		uint32_t head = mHead.load(std::memory_order_relaxed);
+		if (head == mTail.load(std::memory_order_acquire))
+			return NULL;
+		return &mItems[head & (CAPACITY - 1)];
+	}
+
+	//Consumer: gives the front slot back to the producer.
+	void release()
+	{
+		mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+private:
+	static const int CACHE_LINE = 64;
+
+	std::atomic<uint32_t> mHead;	//next slot to read; written by the consumer
+	char mHeadPadding[CACHE_LINE];
+	std::atomic<uint32_t> mTail;	//next slot to write; written by the producer
+	char mTailPadding[CACHE_LINE];
+	T mItems[CAPACITY];
+};
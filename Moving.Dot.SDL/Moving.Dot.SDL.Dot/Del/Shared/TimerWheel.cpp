@@ -0,0 +1,198 @@
+#include "TimerWheel.h"
+
+static void unlink(Timer& timer)
+{
+	timer.prev->next = timer.next;
+	timer.next->prev = timer.prev;
+	timer.next = NULL;
+	timer.prev = NULL;
+}
+
+static void pushBack(Timer& head, Timer& timer)
+{
+	timer.prev = head.prev;
+	timer.next = &head;
+	head.prev->next = &timer;
+	head.prev = &timer;
+}
+
+static bool isEmpty(const Timer& head)
+{
+	return head.next == &head;
+}
+
+TimerWheel::TimerWheel(uint32_t resolutionMs)
+	: mResolution(resolutionMs > 0 ? resolutionMs : 1), mNext(0), mCount(0)
+{
+	for (int level = 0; level < LEVELS; level++)
+	{
+		for (int i = 0; i < SLOTS; i++)
+		{
+			mSlots[level][i].next = &mSlots[level][i];
+			mSlots[level][i].prev = &mSlots[level][i];
+		}
+	}
+}
+
+void TimerWheel::schedule(Timer& timer, uint32_t atMs)
+{
+	if (timer.scheduled())
+		cancel(timer);
+
+	//Round up so a timer never fires before its time.
+	uint32_t tick = (atMs + mResolution - 1) / mResolution;
+	timer.expires = tick < mNext ? mNext : tick;
+	insert(timer);
+	mCount++;
+}
+
+void TimerWheel::cancel(Timer& timer)
+{
+	if (!timer.scheduled())
+		return;
+	unlink(timer);
+	mCount--;
+}
+
+void TimerWheel::insert(Timer& timer)
+{
+	uint32_t expires = timer.expires;
+	uint32_t delta = expires - mNext;
+
+	//Beyond the top level: park it in the furthest slot. It is re-filed when
+	//that slot cascades, and keeps its real expiry throughout.
+	const uint32_t span = 1u << (SLOT_BITS * LEVELS);
+	if (delta >= span)
+	{
+		delta = span - 1;
+		expires = mNext + delta;
+	}
+
+	int level = 0;
+	while (level < LEVELS - 1 && delta >= (1u << (SLOT_BITS * (level + 1))))
+		level++;
+
+	int index = (expires >> (SLOT_BITS * level)) & SLOT_MASK;
+	pushBack(mSlots[level][index], timer);
+}
+
+void TimerWheel::cascade(int level, int index)
+{
+	//Detach the whole slot first; re-filing may put timers back into this level.
+	Timer& head = mSlots[level][index];
+	Timer pending;
+	if (isEmpty(head))
+		return;
+	pending.next = head.next;
+	pending.prev = head.prev;
+	pending.next->prev = &pending;
+	pending.prev->next = &pending;
+	head.next = &head;
+	head.prev = &head;
+
+	while (!isEmpty(pending))
+	{
+		Timer& timer = *pending.next;
+		unlink(timer);
+		insert(timer);
+	}
+}
+
+void TimerWheel::advance(uint32_t nowMs)
+{
+	uint32_t now = nowMs / mResolution;
+	if (mCount == 0)
+	{//Nothing to fire or cascade, so there's no need to step through the gap.
+		if ((int32_t)(now - mNext) >= 0)
+			mNext = now + 1;
+		return;
+	}
+
+	while ((int32_t)(now - mNext) >= 0)
+	{
+		uint32_t tick = mNext;
+		int index = tick & SLOT_MASK;
+
+		//Level 0 has wrapped: bring down the timers that now fall inside it.
+		for (int level = 1; level < LEVELS && index == 0; level++)
+		{
+			index = (tick >> (SLOT_BITS * level)) & SLOT_MASK;
+			cascade(level, index);
+		}
+
+		//Move the due slot to a local list before firing. Callbacks may
+		//schedule or cancel anything, including timers still waiting to fire
+		//here; cancelling just unlinks them from this list.
+		Timer& head = mSlots[0][tick & SLOT_MASK];
+		Timer due;
+		due.next = &due;
+		due.prev = &due;
+		if (!isEmpty(head))
+		{
+			due.next = head.next;
+			due.prev = head.prev;
+			due.next->prev = &due;
+			due.prev->next = &due;
+			head.next = &head;
+			head.prev = &head;
+		}
+		mNext++;
+
+		while (!isEmpty(due))
+		{
+			Timer& timer = *due.next;
+			if ((int32_t)(timer.expires - tick) > 0)
+			{//Parked past the top level; not actually due yet.
+				unlink(timer);
+				insert(timer);
+				continue;
+			}
+			unlink(timer);
+			mCount--;
+			if (timer.callback != NULL)
+				timer.callback(timer, nowMs);
+		}
+	}
+}
+
+int TimerWheel::timeUntilNext(uint32_t nowMs, int limitMs) const
+{
+	if (mCount == 0)
+		return limitMs;
+
+	//The earliest tick anything can happen on is either the first non-empty
+	//level 0 slot or the first cascade of a non-empty higher slot. Cascades
+	//don't fire anything themselves, so this can wake early, never late.
+	uint32_t best = mNext + (1u << (SLOT_BITS * LEVELS));
+	for (int i = 0; i < SLOTS; i++)
+	{
+		uint32_t tick = mNext + i;
+		if (!isEmpty(mSlots[0][tick & SLOT_MASK]))
+		{
+			best = tick;
+			break;
+		}
+	}
+	for (int level = 1; level < LEVELS; level++)
+	{
+		int shift = SLOT_BITS * level;
+		uint32_t first = ((mNext + (1u << shift) - 1) >> shift); //first boundary at or after mNext
+		for (int k = 0; k < SLOTS; k++)
+		{
+			uint32_t tick = (first + k) << shift;
+			if ((int32_t)(tick - best) >= 0)
+				break;
+			if (!isEmpty(mSlots[level][(first + k) & SLOT_MASK]))
+			{
+				best = tick;
+				break;
+			}
+		}
+	}
+
+	uint32_t atMs = best * mResolution;
+	if ((int32_t)(atMs - nowMs) <= 0)
+		return 0;
+	uint32_t wait = atMs - nowMs;
+	return wait < (uint32_t)limitMs ? (int)wait : limitMs;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+struct Timer;
+
+//Called when a timer expires. The timer is no longer scheduled at that point,
+//so the callback is free to schedule it again.
+typedef void (*TimerCallback)(Timer& timer, uint32_t now);
+
+//One pending event. Owned by whatever it belongs to (usually embedded in a
+//connection) so scheduling never allocates. Must be cancelled before it is
+//destroyed.
+struct Timer
+{
+	Timer* next;
+	Timer* prev;
+	uint32_t expires;		//in wheel ticks
+	TimerCallback callback;
+	void* context;			//for the callback; the wheel never touches it
+
+	Timer() : next(NULL), prev(NULL), expires(0), callback(NULL), context(NULL) {}
+
+	bool scheduled() const { return prev != NULL; }
+};
+
+//Hierarchical timing wheel.
+//Four levels of 64 slots. Level 0 holds timers due in the next 64 ticks, one
+//slot per tick; each level above covers 64 times the span of the one below.
+//When level 0 wraps, the matching slot of level 1 is emptied down into level 0
+//(and so on up), so a timer is moved at most once per level over its life.
+//Scheduling and cancelling are O(1), and advancing costs one slot per tick plus
+//whatever actually expires. Nothing is spent on timers that are far off.
+class TimerWheel
+{
+public:
+	//resolutionMs is the length of one tick; timers fire up to one tick late.
+	//Times are milliseconds from a clock that starts near zero (like nowMs() in
+	//the server) and are not expected to wrap.
+	explicit TimerWheel(uint32_t resolutionMs = 10);
+
+	//Schedules (or moves) timer to fire at atMs. Times in the past fire on the next advance.
+	void schedule(Timer& timer, uint32_t atMs);
+
+	//Unschedules timer. Safe to call on a timer that isn't scheduled.
+	void cancel(Timer& timer);
+
+	//Fires every timer due at or before nowMs, in expiry order (to the tick).
+	void advance(uint32_t nowMs);
+
+	//How long until the earliest possible expiry, capped at limitMs.
+	//Used as the poller timeout, so an idle process sleeps until it has work.
+	int timeUntilNext(uint32_t nowMs, int limitMs) const;
+
+	int size() const { return mCount; }
+
+private:
+	static const int LEVELS = 4;
+	static const int SLOT_BITS = 6;
+	static const int SLOTS = 1 << SLOT_BITS;
+	static const uint32_t SLOT_MASK = SLOTS - 1;
+
+	void insert(Timer& timer);
+	void cascade(int level, int index);
+
+	//Each slot is a circular list with a sentinel head.
+	Timer mSlots[LEVELS][SLOTS];
+	uint32_t mResolution;
+	uint32_t mNext;	//the next tick to be processed
+	int mCount;
+};